@@ -0,0 +1,76 @@
+#!/bin/sh
+#
+# End-to-end benchmark: simulates genomes of increasing size with `lava sim`,
+# then times each stage (dict, filt, lava) on them and checks the calls
+# against the simulated genotypes with `lava concord`.
+#
+# Settings come from the environment:
+#   SCALES    genome lengths to run, in bases (default: "1000000 4000000 16000000")
+#   COVERAGE  read depth (default: 10)
+#   THREADS   threads for `lava lava` (default: all online CPUs)
+#   SEED      seed for `lava sim` (default: 1)
+#   WORKDIR   where the data goes (default: a temporary directory, removed afterwards)
+#   LAVA      the binary to benchmark (default: ./lava)
+#
+set -e
+
+LAVA=${LAVA:-./lava}
+SCALES=${SCALES:-"1000000 4000000 16000000"}
+COVERAGE=${COVERAGE:-10}
+THREADS=${THREADS:-$(getconf _NPROCESSORS_ONLN)}
+SEED=${SEED:-1}
+READ_LEN=101
+
+if [ -z "$WORKDIR" ]; then
+	WORKDIR=$(mktemp -d)
+	trap 'rm -rf "$WORKDIR"' EXIT
+fi
+mkdir -p "$WORKDIR"
+
+# runs a command, setting $secs to its wall time and $rss_mb to its peak
+# resident set size (sampled from /proc, as GNU time may not be installed)
+measure() {
+	start=$(date +%s.%N)
+	"$@" >"$WORKDIR/stage.log" 2>&1 &
+	pid=$!
+	hwm=0
+	while kill -0 $pid 2>/dev/null; do
+		kb=$(awk '/^VmHWM:/ { print $2 }' /proc/$pid/status 2>/dev/null || true)
+		[ -n "$kb" ] && hwm=$kb
+		sleep 0.05
+	done
+	if ! wait $pid; then
+		echo "Failed: $*" >&2
+		cat "$WORKDIR/stage.log" >&2
+		exit 1
+	fi
+	end=$(date +%s.%N)
+	secs=$(echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }')
+	rss_mb=$(echo "$hwm" | awk '{ printf "%.1f", $1 / 1024 }')
+}
+
+rate() {
+	echo "$1 $2" | awk '{ printf "%.3g", ($2 > 0) ? $1 / $2 : 0 }'
+}
+
+printf '%-10s %-6s %9s %10s %12s %12s %10s\n' genome stage seconds peak_MiB reads/sec kmers/sec concord
+
+for genome in $SCALES; do
+	p="$WORKDIR/sim$genome"
+	"$LAVA" sim "$p" --genome="$genome" --coverage="$COVERAGE" --read-len=$READ_LEN --seed="$SEED" >/dev/null
+	reads=$(($(wc -l <"$p.fq") / 4))
+	read_kmers=$((reads * (READ_LEN - 31)))
+
+	measure "$LAVA" dict "$p.fa" "$p.snps.txt" "$p.ref" "$p.snp"
+	printf '%-10s %-6s %9s %10s %12s %12s %10s\n' "$genome" dict "$secs" "$rss_mb" - "$(rate "$genome" "$secs")" -
+
+	measure "$LAVA" filt "$p.ref" "$p.snp_locs" "$p.reff"
+	printf '%-10s %-6s %9s %10s %12s %12s %10s\n' "$genome" filt "$secs" "$rss_mb" - - -
+
+	measure "$LAVA" lava "$p.reff" "$p.snp" "$p.fq" "$p.fa.chrlens" "$p.calls" --binary --threads="$THREADS"
+	concord=$("$LAVA" concord "$p.truth" "$p.calls" | awk '$1 == "concordance" { print $2 }')
+	printf '%-10s %-6s %9s %10s %12s %12s %10s\n' "$genome" lava "$secs" "$rss_mb" \
+	       "$(rate "$reads" "$secs")" "$(rate "$read_kmers" "$secs")" "$concord"
+
+	rm -f "$p".*
+done
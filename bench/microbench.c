@@ -0,0 +1,442 @@
+/*
+ * Microbenchmarks of the kernels on the read path
+ *
+ *     make microbench
+ *     bench/microbench [<ref dict> <SNP dict>] [--ops=N] [--hit-rate=H] [--cpu=C] [--seed=S] [--packed]
+ *
+ * Times the dictionary probes (`query_ref_dict`, `query_snp_dict`, the
+ * grouped and filtered neighbor search of `query_neighbors`), the k-mer
+ * kernels (`encode_kmer`, `shift_kmer`, `rev_compl`), `index_table_add` and
+ * the pileup update on the given dictionaries or, without any, on ones
+ * built from a `lava sim` genome in a temporary directory. With
+ * `--packed`, the reference dictionary is packed, as a memory budget may
+ * have it (see `struct ref_dict`).
+ *
+ * Probe keys are drawn to look like those of real reads: k-mers of the
+ * dictionary (hits), random k-mers (misses), a mix of the two with `H`
+ * hits, and the 96 hamming neighbors of hits (which nearly all miss, but
+ * mostly land in the bucket of the k-mer). Keys come from a pool larger
+ * than the last-level cache, so probes pay for their cache misses.
+ *
+ * This file includes `lava.c` itself, so that its static (and mostly
+ * inlined) functions are timed as the read path compiles them. Each kernel
+ * is run for a tenth of its operations to warm up, then in batches of
+ * `BENCH_BATCH` operations, each timed with the monotonic clock. We report
+ * the mean time per operation, the throughput and percentiles of the
+ * per-operation time of the batches.
+ */
+#include "../src/lava.c"
+#include <time.h>
+#include "fasta_parser.h"
+#include "dictgen.h"
+#include "dict_filt.h"
+#include "sim.h"
+
+#define BENCH_BATCH     64
+#define BENCH_POOL      (1 << 20)  /* keys per pool; 8 MiB of them */
+#define BENCH_READ_BUF  (1 << 16)  /* bases of random sequence for the k-mer kernels */
+#define SIM_GENOME_LEN  16000000
+
+static volatile uint64_t sink;  /* results go here, so that the compiler can't drop the work */
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void)
+{
+	uint64_t z = (rng_state += 0x9E3779B97F4A7C15UL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+	return z ^ (z >> 31);
+}
+
+static double now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+static int cmp_double(const void *p1, const void *p2)
+{
+	const double a = *(const double *)p1;
+	const double b = *(const double *)p2;
+	return (a > b) - (a < b);
+}
+
+static void report(const char *name, double *batch_ns, const size_t n_batches, const double total_ns)
+{
+	qsort(batch_ns, n_batches, sizeof(*batch_ns), cmp_double);
+	const double ops = (double)n_batches * BENCH_BATCH;
+
+#define PCT(p) batch_ns[(size_t)((p) * (n_batches - 1))]
+	printf("%-24s %8.2f %9.2f %8.2f %8.2f %8.2f %9.2f\n",
+	       name, total_ns/ops, ops/total_ns*1e3, PCT(0.5), PCT(0.9), PCT(0.99), batch_ns[n_batches - 1]);
+#undef PCT
+}
+
+/*
+ * Runs `body` (which sees the operation number `i`) `n_ops` times after a
+ * warmup, and reports it as `name`.
+ */
+#define BENCH(name, n_ops, body) do { \
+	const size_t n_batches_ = ((n_ops) + BENCH_BATCH - 1)/BENCH_BATCH; \
+	double *batch_ns_ = malloc(n_batches_ * sizeof(*batch_ns_)); \
+	assert(batch_ns_); \
+	for (size_t i = 0; i < n_batches_*BENCH_BATCH/10; i++) { \
+		body; \
+	} \
+	const double start_ = now_ns(); \
+	for (size_t b_ = 0; b_ < n_batches_; b_++) { \
+		const double t_ = now_ns(); \
+		for (size_t i = b_*BENCH_BATCH; i < (b_ + 1)*BENCH_BATCH; i++) { \
+			body; \
+		} \
+		batch_ns_[b_] = (now_ns() - t_)/BENCH_BATCH; \
+	} \
+	report((name), batch_ns_, n_batches_, now_ns() - start_); \
+	free(batch_ns_); \
+} while (0)
+
+/* the k-mer of entry `i` of a dictionary, found from its jumpgate bucket */
+static kmer_t dict_kmer(const uint32_t *jumpgate, const size_t *wraps, const unsigned n_wraps,
+                        const unsigned jumpgate_bits, const struct dict_keys *k, const unsigned hi_bytes,
+                        const size_t i)
+{
+	size_t lo = 0;
+	size_t hi = 1UL << jumpgate_bits;  /* bucket `hi` starts after entry `i` */
+
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo)/2;
+		if (jumpgate_get(jumpgate, wraps, n_wraps, mid) <= i)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return ((kmer_t)lo << k->bits) | dict_key(k, hi_bytes, i);
+}
+
+static kmer_t ref_dict_kmer(const struct ref_dict *d, const size_t i)
+{
+	const struct dict_keys k = ref_dict_keys(d);
+	return dict_kmer(d->jumpgate, d->jumpgate_wraps, d->n_jumpgate_wraps, d->jumpgate_bits, &k, d->key_hi_bytes, i);
+}
+
+static kmer_t snp_dict_kmer(const struct snp_dict *d, const size_t i)
+{
+	const struct dict_keys k = snp_dict_keys(d);
+	return dict_kmer(d->jumpgate, d->jumpgate_wraps, d->n_jumpgate_wraps, d->jumpgate_bits, &k, d->key_hi_bytes, i);
+}
+
+static void print_buckets(const char *name, const uint32_t *jumpgate, const size_t *wraps, const unsigned n_wraps,
+                          const unsigned jumpgate_bits, const size_t size)
+{
+	const size_t n_buckets = 1UL << jumpgate_bits;
+	double *sizes = malloc(n_buckets * sizeof(*sizes));
+	assert(sizes);
+
+	size_t n_nonempty = 0;
+	size_t start = jumpgate_get(jumpgate, wraps, n_wraps, 0);
+	for (size_t b = 0; b < n_buckets; b++) {
+		const size_t end = jumpgate_get(jumpgate, wraps, n_wraps, b + 1);
+		if (end > start)
+			sizes[n_nonempty++] = end - start;
+		start = end;
+	}
+	qsort(sizes, n_nonempty, sizeof(*sizes), cmp_double);
+
+	printf("%s: %lu k-mers, %u jumpgate bits, %lu of %lu buckets used, bucket size p50 %.0f p99 %.0f max %.0f\n",
+	       name, size, jumpgate_bits, n_nonempty, n_buckets,
+	       n_nonempty ? sizes[n_nonempty/2] : 0.0,
+	       n_nonempty ? sizes[(size_t)(0.99 * (n_nonempty - 1))] : 0.0,
+	       n_nonempty ? sizes[n_nonempty - 1] : 0.0);
+	free(sizes);
+}
+
+/*
+ * Simulates a genome and builds filtered dictionaries of it in `dir`, as
+ * `lava sim`, `lava dict` and `lava filt` would, and returns them opened.
+ */
+static void make_sim_dicts(const char *dir, FILE **refdict_file, FILE **snpdict_file)
+{
+	char prefix[4096], fa[4096], snps[4096], locs[4096], ref[4096], ref_filt[4096], snp[4096];
+	snprintf(prefix, sizeof(prefix), "%s/sim", dir);
+	snprintf(fa, sizeof(fa), "%s.fa", prefix);
+	snprintf(snps, sizeof(snps), "%s.snps.txt", prefix);
+	snprintf(locs, sizeof(locs), "%s.snp_locs", prefix);
+	snprintf(ref, sizeof(ref), "%s.ref", prefix);
+	snprintf(ref_filt, sizeof(ref_filt), "%s.ref.filt", prefix);
+	snprintf(snp, sizeof(snp), "%s.snp", prefix);
+
+	SimOptions sim_opts;
+	sim_options_default(&sim_opts);
+	sim_opts.genome_len = SIM_GENOME_LEN;
+	sim_opts.coverage = 0;
+	sim_generate(&sim_opts, prefix);
+
+	SeqVec seqs = parse_fasta(fa);
+	const DictOptions dict_opts = {.half_index = false, .wide_pos = false, .max_positions = AUX_TABLE_COLS};
+
+	FILE *snp_file = fopen(snps, "r");
+	assert(snp_file);
+	FILE *out = fopen(snp, "wb");
+	assert(out);
+	bool *snp_locations;
+	size_t snp_locs_size;
+	make_snp_dict(seqs, snp_file, out, &snp_locations, &snp_locs_size, &dict_opts);
+	free(snp_locations);
+	fclose(snp_file);
+	fclose(out);
+
+	out = fopen(ref, "wb");
+	assert(out);
+	make_ref_dict(seqs, out, &dict_opts);
+	fclose(out);
+	seqvec_dealloc(&seqs);
+
+	FILE *in = fopen(ref, "rb");
+	assert(in);
+	FILE *locs_file = fopen(locs, "rb");
+	assert(locs_file);
+	out = fopen(ref_filt, "wb");
+	assert(out);
+	dict_filt(in, locs_file, out);  /* closes `locs_file` and `out` */
+	fclose(in);
+
+	*refdict_file = fopen(ref_filt, "rb");
+	assert(*refdict_file);
+	*snpdict_file = fopen(snp, "rb");
+	assert(*snpdict_file);
+
+	const char *files[] = {fa, snps, locs, ref, ref_filt, snp};
+	for (size_t i = 0; i < sizeof(files)/sizeof(files[0]); i++) {
+		unlink(files[i]);
+	}
+	for (const char *ext = ".fq\0.truth\0.fa.chrlens\0"; *ext; ext += strlen(ext) + 1) {
+		char path[4096];
+		snprintf(path, sizeof(path), "%s%s", prefix, ext);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+static const char *flag_value(int argc, char *argv[], const char *flag)
+{
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], flag, strlen(flag)) == 0)
+			return argv[i] + strlen(flag);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dict_files[2];
+	int n_dict_files = 0;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-' && argv[i][1] == '-') {
+			if (strncmp(argv[i], "--ops=", 6) && strncmp(argv[i], "--hit-rate=", 11) &&
+			    strncmp(argv[i], "--cpu=", 6) && strncmp(argv[i], "--seed=", 7) && strcmp(argv[i], "--packed")) {
+				fprintf(stderr, "Unknown flag: %s\n", argv[i]);
+				exit(EXIT_FAILURE);
+			}
+		} else if (n_dict_files < 2) {
+			dict_files[n_dict_files++] = argv[i];
+		} else {
+			n_dict_files = 3;
+		}
+	}
+
+	if (n_dict_files == 1 || n_dict_files > 2) {
+		fprintf(stderr, "Usage: microbench [<ref dict> <SNP dict>] [--ops=N] [--hit-rate=H] [--cpu=C] [--seed=S] [--packed]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const char *value;
+	const size_t n_ops = (value = flag_value(argc, argv, "--ops=")) ? strtoul(value, NULL, 10) : 2000000;
+	const double hit_rate = (value = flag_value(argc, argv, "--hit-rate=")) ? atof(value) : 0.5;
+	const int cpu = (value = flag_value(argc, argv, "--cpu=")) ? atoi(value) : 0;
+	rng_state = (value = flag_value(argc, argv, "--seed=")) ? strtoul(value, NULL, 10) : 1;
+
+	if (n_ops < BENCH_BATCH || hit_rate < 0 || hit_rate > 1) {
+		fprintf(stderr, "Invalid --ops or --hit-rate\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* on one CPU, so that migrations don't show up in the tail */
+	if (!pin_thread(cpu))
+		fprintf(stderr, "Could not pin to CPU %d; timings may be noisy\n", cpu);
+
+	FILE *refdict_file, *snpdict_file;
+	if (n_dict_files == 2) {
+		refdict_file = fopen(dict_files[0], "rb");
+		assert(refdict_file);
+		snpdict_file = fopen(dict_files[1], "rb");
+		assert(snpdict_file);
+	} else {
+		char dir[] = "/tmp/lava-microbench-XXXXXX";
+		assert(mkdtemp(dir));
+		fprintf(stderr, "No dictionaries given; simulating a %u-base genome\n", SIM_GENOME_LEN);
+		make_sim_dicts(dir, &refdict_file, &snpdict_file);
+	}
+
+	const MemOptions mem_opts = {.hugetlb = false, .prefault = true, .lock = false, .threads = 1, .interleave = NULL};
+	HugeMem mem;
+	hugemem_init(&mem, &mem_opts);
+
+	struct dict_shape ref_shape, snp_shape;
+	dict_shape_read(refdict_file, false, &ref_shape);
+	dict_shape_read(snpdict_file, true, &snp_shape);
+	const struct mem_plan plan = {.compact = PCOMPACT,
+	                              .ref_packed = (flag_value(argc, argv, "--packed") != NULL),
+	                              .ref_jumpgate_bits = dict_jumpgate_bits(&ref_shape.header),
+	                              .snp_jumpgate_bits = dict_jumpgate_bits(&snp_shape.header)};
+
+	struct lookup lk;
+	struct pileup pileup;
+	load_dicts(refdict_file, snpdict_file, &plan, &mem, &lk, &pileup);
+	fclose(refdict_file);
+	fclose(snpdict_file);
+
+	const struct ref_dict *ref_dict = &lk.ref_dict;
+	const struct snp_dict *snp_dict = &lk.snp_dict;
+	assert(ref_dict->size > 0 && snp_dict->size > 0);
+
+	print_buckets(plan.ref_packed ? "ref dict (packed)" : "ref dict", ref_dict->jumpgate, ref_dict->jumpgate_wraps, ref_dict->n_jumpgate_wraps,
+	              ref_dict->jumpgate_bits, ref_dict->size);
+	print_buckets("SNP dict", snp_dict->jumpgate, snp_dict->jumpgate_wraps, snp_dict->n_jumpgate_wraps,
+	              snp_dict->jumpgate_bits, snp_dict->size);
+
+	/* === Inputs === */
+	const size_t mask = BENCH_POOL - 1;
+	kmer_t *ref_hits = malloc(BENCH_POOL * sizeof(*ref_hits));
+	kmer_t *snp_hits = malloc(BENCH_POOL * sizeof(*snp_hits));
+	kmer_t *misses = malloc(BENCH_POOL * sizeof(*misses));
+	kmer_t *ref_mixed = malloc(BENCH_POOL * sizeof(*ref_mixed));
+	kmer_t *snp_mixed = malloc(BENCH_POOL * sizeof(*snp_mixed));
+	kmer_t *ref_neighbors = malloc(BENCH_POOL * sizeof(*ref_neighbors));
+	kmer_t *snp_neighbors = malloc(BENCH_POOL * sizeof(*snp_neighbors));
+	assert(ref_hits && snp_hits && misses && ref_mixed && snp_mixed && ref_neighbors && snp_neighbors);
+
+	for (size_t i = 0; i < BENCH_POOL; i++) {
+		ref_hits[i] = ref_dict_kmer(ref_dict, rng_next() % ref_dict->size);
+		snp_hits[i] = snp_dict_kmer(snp_dict, rng_next() % snp_dict->size);
+		misses[i] = rng_next();
+		const bool hit = (rng_next() >> 11) * (1.0 / (1UL << 53)) < hit_rate;
+		ref_mixed[i] = hit ? ref_hits[i] : misses[i];
+		snp_mixed[i] = hit ? snp_hits[i] : misses[i];
+	}
+
+	/* the neighbors of each hit in turn, as the read path probes them */
+	kmer_t keys[NEIGHBOR_COUNT + 1];
+	for (size_t i = 0; i < BENCH_POOL; i += NEIGHBOR_COUNT) {
+		kmer_neighbors(ref_hits[i], keys);
+		memcpy(&ref_neighbors[i], &keys[1], ((BENCH_POOL - i < NEIGHBOR_COUNT) ? BENCH_POOL - i : NEIGHBOR_COUNT) * sizeof(*keys));
+		kmer_neighbors(snp_hits[i], keys);
+		memcpy(&snp_neighbors[i], &keys[1], ((BENCH_POOL - i < NEIGHBOR_COUNT) ? BENCH_POOL - i : NEIGHBOR_COUNT) * sizeof(*keys));
+	}
+
+	char *bases = malloc(BENCH_READ_BUF + 32);
+	assert(bases);
+	for (size_t i = 0; i < BENCH_READ_BUF + 32; i++) {
+		bases[i] = "ACGT"[rng_next() & 3];
+	}
+
+	size_t n_sites;
+	struct pileup_site *sites = pileup_sites(&pileup, &n_sites);
+	assert(n_sites > 0);
+	uint64_t *site_pos = malloc(BENCH_POOL * sizeof(*site_pos));
+	uint8_t *site_base = malloc(BENCH_POOL * sizeof(*site_base));
+	assert(site_pos && site_base);
+	for (size_t i = 0; i < BENCH_POOL; i++) {
+		const struct pileup_site *site = &sites[rng_next() % n_sites];
+		site_pos[i] = site->pos;
+		site_base[i] = (rng_next() & 1) ? site->ref : site->alt;
+	}
+	free(sites);
+
+	/* read indices for `index_table_add`: most k-mers of a read agree, a few are stray hits */
+	pos_t *indices = malloc(BENCH_POOL * sizeof(*indices));
+	assert(indices);
+	pos_t read_index = 0;
+	for (size_t i = 0; i < BENCH_POOL; i++) {
+		if (i % 8 == 0)
+			read_index = rng_next() % (1UL << 32);
+		indices[i] = (rng_next() % 4 == 0) ? rng_next() % (1UL << 32) : read_index;
+	}
+
+	IndexTable *index_table = malloc(sizeof(*index_table));
+	assert(index_table);
+	index_table_clear(index_table);
+
+	size_t *ref_results = malloc((NEIGHBOR_COUNT + 1) * sizeof(*ref_results));
+	size_t *snp_results = malloc((NEIGHBOR_COUNT + 1) * sizeof(*snp_results));
+	assert(ref_results && snp_results);
+
+	/* === Benchmarks === */
+	printf("\n%-24s %8s %9s %8s %8s %8s %9s\n", "kernel", "ns/op", "Mops/s", "p50", "p90", "p99", "max");
+
+	uint64_t acc = 0;
+	kmer_t rolling = 0;
+	bool had_n;
+
+	BENCH("encode_kmer", n_ops, acc += encode_kmer(&bases[(i*7) & (BENCH_READ_BUF - 1)], &had_n));
+	BENCH("shift_kmer", n_ops, rolling = shift_kmer(rolling, bases[i & (BENCH_READ_BUF - 1)]));
+	acc += rolling;
+	BENCH("rev_compl", n_ops, acc += rev_compl(misses[i & mask]));
+
+	BENCH("query_ref_dict hit", n_ops, acc += query_ref_dict(ref_hits[i & mask], ref_dict));
+	BENCH("query_ref_dict miss", n_ops, acc += query_ref_dict(misses[i & mask], ref_dict));
+	BENCH("query_ref_dict mixed", n_ops, acc += query_ref_dict(ref_mixed[i & mask], ref_dict));
+	BENCH("query_ref_dict neighbor", n_ops, acc += query_ref_dict(ref_neighbors[i & mask], ref_dict));
+	BENCH("query_snp_dict hit", n_ops, acc += query_snp_dict(snp_hits[i & mask], snp_dict));
+	BENCH("query_snp_dict miss", n_ops, acc += query_snp_dict(misses[i & mask], snp_dict));
+	BENCH("query_snp_dict mixed", n_ops, acc += query_snp_dict(snp_mixed[i & mask], snp_dict));
+	BENCH("query_snp_dict neighbor", n_ops, acc += query_snp_dict(snp_neighbors[i & mask], snp_dict));
+
+	/* the whole search for a hit's 96 neighbors, in both dictionaries, per operation */
+	BENCH("query_neighbors", n_ops/NEIGHBOR_COUNT, {
+		kmer_neighbors(ref_hits[(i*NEIGHBOR_COUNT) & mask], keys);
+		query_neighbors(keys, ref_dict, snp_dict, ref_results, snp_results);
+		acc += ref_results[i % (NEIGHBOR_COUNT + 1)] + snp_results[i % (NEIGHBOR_COUNT + 1)];
+	});
+
+	/* as for reads, the slots used are cleared every 8 k-mers */
+	BENCH("index_table_add", n_ops, {
+		index_table_add(index_table, indices[i & mask]);
+		if (i % 8 == 7) {
+			acc += index_table->best->freq;
+			for (size_t j = i - 7; j <= i; j++)
+				index_table_clear_index(index_table, indices[j & mask]);
+			index_table->best = NULL;
+			index_table->ambiguous = false;
+		}
+	});
+
+	BENCH("pileup update", n_ops, {
+		struct pileup_entry *p = pileup.compact ? &ptable_get(&pileup.ptable, site_pos[i & mask])->entry :
+		                                          &pileup.table[site_pos[i & mask]];
+		acc += pileup_count(p, site_base[i & mask]);
+	});
+
+	sink = acc;
+
+	free(ref_hits);
+	free(snp_hits);
+	free(misses);
+	free(ref_mixed);
+	free(snp_mixed);
+	free(ref_neighbors);
+	free(snp_neighbors);
+	free(bases);
+	free(site_pos);
+	free(site_base);
+	free(indices);
+	free(index_table);
+	free(ref_results);
+	free(snp_results);
+	pileup_dealloc(&pileup, &mem);
+	lookup_release(&lk, &mem);
+	hugemem_dealloc(&mem);
+	return EXIT_SUCCESS;
+}
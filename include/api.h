@@ -0,0 +1,11 @@
+#ifndef API_H
+#define API_H
+
+/*
+ * `liblava.so` is built with `-fvisibility=hidden`; only the functions
+ * declared with `LAVA_API` (those of `liblava.h`, and the `perf.h` ones its
+ * users need for `lava_sample_set_perf`) are exported from it.
+ */
+#define LAVA_API __attribute__((visibility("default")))
+
+#endif /* API_H */
@@ -0,0 +1,95 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "hugemem.h"
+
+/*
+ * Cache-line-blocked Bloom filter over k-mers
+ *
+ * Each key is hashed to a single 512-bit block, in which `BLOOM_HASHES`
+ * bits are set. A membership test therefore costs at most one cache miss.
+ * The number of blocks is a power of 2, which lets us shrink a filter
+ * after the fact by folding its halves together (see `bloom_fold`).
+ */
+
+#define BLOOM_BLOCK_WORDS  8  /* 64-bit words per block (512 bits) */
+#define BLOOM_HASHES       5
+#define BLOOM_BITS_PER_KEY 8  /* lower bound, before rounding up to a power of 2 */
+
+typedef struct {
+	uint64_t *blocks;      /* NULL if the filter is absent, in which case it contains everything */
+	uint64_t n_blocks;
+	unsigned log2_blocks;
+} BloomFilter;
+
+void bloom_init(BloomFilter *b, const size_t expected_keys);
+void bloom_dealloc(BloomFilter *b);
+void bloom_fold(BloomFilter *b, const size_t expected_keys);
+void bloom_serialize(const BloomFilter *b, FILE *out);
+/* allocates the blocks from `mem` (so they are freed with `hugemem_free`, not `bloom_dealloc`) */
+void bloom_deserialize(BloomFilter *b, FILE *in, const uint64_t len, HugeMem *mem, const char *name);
+uint64_t bloom_serialized_size(const BloomFilter *b);
+
+static inline uint64_t bloom_hash(uint64_t x)
+{
+	/* splitmix64 finalizer */
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9UL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebUL;
+	x ^= x >> 31;
+	return x;
+}
+
+static inline uint64_t *bloom_block(const BloomFilter *b, const uint64_t h)
+{
+	/* the high bits of the hash pick the block */
+	const uint64_t block = b->log2_blocks ? (h >> (64 - b->log2_blocks)) : 0;
+	return &b->blocks[block * BLOOM_BLOCK_WORDS];
+}
+
+static inline unsigned bloom_bit(const uint64_t h, const unsigned i)
+{
+	/* re-mix so that the bits within a block don't depend on the block */
+	const uint64_t g = h * 0x9e3779b97f4a7c15UL;
+	return (g >> (64 - 9*(i + 1))) & 0x1FF;
+}
+
+static inline void bloom_add(BloomFilter *b, const uint64_t key)
+{
+	const uint64_t h = bloom_hash(key);
+	uint64_t *block = bloom_block(b, h);
+
+	for (unsigned i = 0; i < BLOOM_HASHES; i++) {
+		const unsigned bit = bloom_bit(h, i);
+		block[bit >> 6] |= (1UL << (bit & 0x3F));
+	}
+}
+
+static inline bool bloom_contains(const BloomFilter *b, const uint64_t key)
+{
+	if (b->blocks == NULL)
+		return true;
+
+	const uint64_t h = bloom_hash(key);
+	const uint64_t *block = bloom_block(b, h);
+
+	uint64_t found = 1;
+	for (unsigned i = 0; i < BLOOM_HASHES; i++) {
+		const unsigned bit = bloom_bit(h, i);
+		found &= (block[bit >> 6] >> (bit & 0x3F));
+	}
+	return found;
+}
+
+static inline void bloom_prefetch(const BloomFilter *b, const uint64_t key)
+{
+	if (b->blocks != NULL)
+		__builtin_prefetch(bloom_block(b, bloom_hash(key)));
+}
+
+#endif /* BLOOM_H */
@@ -0,0 +1,80 @@
+#ifndef CALLING_H
+#define CALLING_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "lava.h"
+#include "pileup.h"
+
+/*
+ * Genotype calling engine
+ *
+ * All per-site likelihood terms depend only on the (capped) read counts
+ * and the 8-bit encoded allele frequencies, so they are tabulated once up
+ * front. Sites are then called in fixed-size batches stored as arrays, a
+ * branch-free loop the compiler can vectorize. The tables are read-only
+ * after `call_tables_init`, so any number of threads may share them.
+ */
+
+#define CALL_COUNTS (MAX_COV + 1)
+#define CALL_BATCH  256
+
+typedef struct {
+	/* P(counts|Gi)/(ref_cnt + alt_cnt choose ref_cnt), indexed by ref_cnt*CALL_COUNTS + alt_cnt */
+	double g0[CALL_COUNTS * CALL_COUNTS];
+	double g1[CALL_COUNTS * CALL_COUNTS];
+	double g2[CALL_COUNTS * CALL_COUNTS];
+	double poisson[2*MAX_COV + 1];  /* P(coverage = n) */
+	double freq_sq[256];            /* (enc/255)^2 */
+} CallTables;
+
+typedef struct {
+	size_t n;
+	size_t index[CALL_BATCH];  /* pileup index (i.e. 1-based genome position) */
+	uint8_t ref_cnt[CALL_BATCH];
+	uint8_t alt_cnt[CALL_BATCH];
+	uint8_t ref_freq[CALL_BATCH];
+	uint8_t alt_freq[CALL_BATCH];
+
+	/* outputs */
+	uint8_t genotype[CALL_BATCH];
+	double confidence[CALL_BATCH];
+} CallBatch;
+
+struct site_call {
+	size_t index;
+	double confidence;
+	int genotype;
+};
+
+typedef struct {
+	struct site_call *calls;  /* non-reference calls, in pileup order */
+	size_t count;
+	size_t cap;
+
+	size_t ref_calls;
+	size_t alt_calls;
+	size_t het_calls;
+} CallList;
+
+void call_tables_init(CallTables *t);
+
+void call_batch(const CallTables *t, CallBatch *b);
+
+/*
+ * Calls every SNP site in the pileup, splitting it into up to `threads`
+ * ranges that are called in parallel. `out` must be freed with
+ * `call_list_dealloc`.
+ */
+void call_pileup(const CallTables *t,
+                 const struct pileup_entry *pileup_table,
+                 const size_t pileup_size,
+                 unsigned threads,
+                 CallList *out);
+
+/* the same for a compact pileup table */
+void call_ptable(const CallTables *t, const PileupTable *ptable, unsigned threads, CallList *out);
+
+void call_list_dealloc(CallList *list);
+
+#endif /* CALLING_H */
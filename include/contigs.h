@@ -0,0 +1,71 @@
+#ifndef CONTIGS_H
+#define CONTIGS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Table of the reference's contigs (chromosomes, scaffolds, ...)
+ *
+ * Contigs are concatenated in the order they are added, and positions in
+ * the concatenated genome are 1-based. Names are found through an
+ * open-addressing hash table, and positions through binary search over
+ * the sorted contig end offsets, so references with many thousands of
+ * contigs cost no more per lookup than those with a handful.
+ */
+
+#define CONTIG_NONE ((size_t)(-1))
+
+typedef struct {
+	char **names;
+	uint64_t *lens;
+	uint64_t *ends;    /* 1-based position of each contig's last base, ascending */
+	size_t count;
+	size_t cap;
+
+	size_t *slots;     /* hash slots holding contig indices, or CONTIG_NONE */
+	size_t n_slots;    /* power of 2 */
+} ContigTable;
+
+void contig_table_init(ContigTable *t);
+void contig_table_dealloc(ContigTable *t);
+
+/* returns the index of the new contig; names must be unique */
+size_t contig_table_add(ContigTable *t, const char *name, const uint64_t len);
+
+/* reads a .chrlens file ("<name> <length>" per line) */
+void contig_table_load(ContigTable *t, FILE *chrlens_file);
+
+size_t contig_table_find(const ContigTable *t, const char *name);
+
+static inline uint64_t contig_start(const ContigTable *t, const size_t i)
+{
+	return t->ends[i] - t->lens[i] + 1;
+}
+
+/*
+ * Returns the contig containing the 1-based concatenated position `pos`,
+ * or CONTIG_NONE if it is past the end. Lookups mostly come in increasing
+ * order, so we first try `hint` (the previous answer) and its successor.
+ */
+static inline size_t contig_for_pos(const ContigTable *t, const uint64_t pos, const size_t hint)
+{
+	for (size_t i = hint; i < t->count && i < hint + 2; i++) {
+		if (pos <= t->ends[i] && (i == 0 || pos > t->ends[i - 1]))
+			return i;
+	}
+
+	size_t lo = 0;
+	size_t hi = t->count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo)/2;
+		if (t->ends[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < t->count) ? lo : CONTIG_NONE;
+}
+
+#endif /* CONTIGS_H */
@@ -0,0 +1,15 @@
+#ifndef DICT_STATS_H
+#define DICT_STATS_H
+
+#include <stdio.h>
+
+/*
+ * Streams the dictionary `dict` (reference or SNP, told apart by their
+ * layouts) and writes to `out` what is needed to tune its index: the
+ * distribution of jumpgate bucket sizes for every jumpgate width, the
+ * occupancy of the aux table's rows, the k-mers dropped as too ambiguous
+ * and the memory that the dictionary would take in other layouts.
+ */
+void dict_stats(FILE *dict, FILE *out);
+
+#endif /* DICT_STATS_H */
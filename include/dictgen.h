@@ -2,11 +2,21 @@
 #define DICTGEN_H
 
 #include <stdio.h>
+#include <stdbool.h>
 #include "fasta_parser.h"
 
-void make_ref_dict(SeqVec ref, FILE *out);
+typedef struct {
+	bool half_index;  /* also write the pigeonhole index for 1-mismatch search */
+	bool wide_pos;    /* 40-bit positions, for genomes of 2^32 - 1 bases or more */
+	unsigned max_positions;  /* k-mers with more positions are dropped (left `POS_AMBIGUOUS`) */
+} DictOptions;
 
-void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations, size_t *snp_locs_size);
+void make_ref_dict(SeqVec ref, FILE *out, const DictOptions *opts);
+
+void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations, size_t *snp_locs_size, const DictOptions *opts);
+
+/* writes the half index section of sorted k-mers, see `struct half_index` */
+void write_half_index_section(const void *kmers, const size_t stride, const size_t kmers_len, FILE *out);
 
 #endif /* DICTGEN_H */
 
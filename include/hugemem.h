@@ -0,0 +1,89 @@
+#ifndef HUGEMEM_H
+#define HUGEMEM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "topology.h"
+
+/*
+ * Allocator for the large, randomly accessed arrays of `lava lava` (the
+ * dictionaries, their aux tables and the pileup table). With 4 KiB pages
+ * nearly every probe of these arrays misses the TLB, so we back them with
+ * huge pages wherever we can get them:
+ *
+ *  - reserved huge pages (`MAP_HUGETLB`, 1 GiB then 2 MiB), if requested,
+ *  - otherwise 2 MiB-aligned mappings advised with `MADV_HUGEPAGE`, which
+ *    transparent huge pages will back when the kernel allows it.
+ *
+ * On NUMA machines mapped allocations can be interleaved over all nodes
+ * (`MemOptions.interleave`) or placed on one node (`hugemem_alloc_node`).
+ *
+ * Allocations below `HUGEMEM_MIN_SIZE` just use the heap, aligned to a
+ * cache line like Bloom filter blocks must be. All memory is zeroed. Every allocation is recorded, so the backing that was obtained
+ * can be reported and everything can be released at once.
+ */
+
+#define HUGEMEM_MIN_SIZE (1UL << 21)
+
+typedef enum {
+	BACKING_MALLOC,
+	BACKING_PAGES,       /* regular pages (no huge page support) */
+	BACKING_THP,         /* transparent huge pages advised */
+	BACKING_HUGETLB_2M,
+	BACKING_HUGETLB_1G,
+	BACKING_COUNT
+} MemBacking;
+
+typedef struct {
+	bool hugetlb;      /* try reserved huge pages first */
+	bool prefault;     /* fault pages in up front rather than on first touch */
+	bool lock;         /* `mlock` mapped allocations */
+	unsigned threads;  /* threads used to prefault */
+	const Topology *interleave;  /* interleave mapped allocations over these nodes, if set */
+
+	/* for `lava_dicts_load` and `lava_dicts_attach` (see `--max-mem`), not the allocator */
+	size_t max_mem;    /* bytes the dictionaries and pileup tables may take, or 0 for no limit */
+	unsigned samples;  /* pileup tables to leave room for (0 is taken as 1) */
+} MemOptions;
+
+struct mem_region {
+	void *p;
+	size_t size;       /* requested size */
+	size_t map_size;   /* mapped size (0 for `BACKING_MALLOC`) */
+	MemBacking backing;
+	const char *name;
+};
+
+typedef struct {
+	MemOptions opts;
+	struct mem_region *regions;
+	size_t count;
+	size_t cap;
+	bool lock_failed;  /* so that we only warn once */
+} HugeMem;
+
+void hugemem_init(HugeMem *m, const MemOptions *opts);
+
+/* frees everything still allocated from `m` */
+void hugemem_dealloc(HugeMem *m);
+
+/* returns zeroed memory; `name` (a string literal) is used for reporting */
+void *hugemem_alloc(HugeMem *m, const size_t size, const char *name);
+
+/* like `hugemem_alloc`, but places mapped memory on node `node` of `topo` */
+void *hugemem_alloc_node(HugeMem *m, const size_t size, const char *name,
+                         const Topology *topo, const unsigned node);
+
+/* like `realloc`; any new space is zeroed */
+void *hugemem_realloc(HugeMem *m, void *p, const size_t size);
+
+void hugemem_free(HugeMem *m, void *p);
+
+/* total bytes currently allocated from `m` */
+size_t hugemem_total(const HugeMem *m);
+
+/* prints how much memory got each kind of backing */
+void hugemem_report(const HugeMem *m, FILE *out);
+
+#endif /* HUGEMEM_H */
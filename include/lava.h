@@ -2,11 +2,12 @@
 #define LAVA_H
 
 #include <stdint.h>
+#include "bloom.h"
 
 /////////////////////////////
 #define DEBUG        0
-#define REF_LITE     0
-#define PCOMPACT     0
+#define PCOMPACT     0  /* the pileup layout used when no memory budget forces one (see `--max-mem`) */
+#define REF_PACKED   0  /* likewise for the ref dictionary layout, see `struct ref_dict` */
 #define GEN_FLT_DATA 0
 
 #define READ_LEN       101
@@ -28,7 +29,17 @@ enum {
 	GTYPE_NONE, GTYPE_REF, GTYPE_ALT, GTYPE_HET
 };
 
-#define POS_AMBIGUOUS ((uint32_t)(-1))
+/*
+ * 1-based position in the concatenated genome. Dictionaries store either
+ * 32-bit ("narrow") or 40-bit ("wide") positions, see `struct dict_header`;
+ * in memory the upper 8 bits of wide positions are kept in separate
+ * `pos_hi` arrays, which are NULL for narrow dictionaries.
+ */
+typedef uint64_t pos_t;
+
+#define POS_AMBIGUOUS    ((pos_t)0xFFFFFFFFFF)  /* largest 40-bit value; narrow files store it truncated */
+#define POS_NARROW_LIMIT ((pos_t)0xFFFFFFFF)    /* positions must stay below this in narrow dictionaries */
+#define POS_WIDE_LIMIT   POS_AMBIGUOUS
 
 #define FLAG_UNAMBIGUOUS 0x00
 #define FLAG_AMBIGUOUS   0x01
@@ -49,34 +60,166 @@ typedef uint8_t snp_info;  /* 5 bits: pos in kmer, 3 bits: ref base */
 struct kmer_info {
 	kmer_t kmer;
 	uint32_t pos;
+	uint8_t pos_hi;
 } __attribute__((packed));
 
 struct snp_kmer_info {
 	kmer_t kmer;
 	uint32_t pos;
+	uint8_t pos_hi;
 	snp_info snp;
 	uint8_t ref_freq;
 	uint8_t alt_freq;
 } __attribute__((packed));
 
-struct kmer_entry {
-#if REF_LITE
-	uint64_t kmer_lo40 : 40;
-#else
-	uint32_t kmer_lo;
-#endif
-	uint32_t pos;
-	uint8_t ambig_flag;
-} __attribute__((packed));
+/* for both `struct kmer_info` and `struct snp_kmer_info` */
+#define KMER_INFO_POS(info)          ((((pos_t)(info).pos_hi) << 32) | (info).pos)
+#define KMER_INFO_SET_POS(info, p)   ((info).pos = (uint32_t)(p), (info).pos_hi = (uint8_t)((pos_t)(p) >> 32))
 
-struct snp_kmer_entry {
-	uint64_t kmer_lo40 : 40;
-	snp_info snp;
-	uint32_t pos;
-	uint8_t ambig_flag;
-} __attribute__((packed));
+/*
+ * In-memory dictionaries, stored as a structure of arrays so that searches
+ * only touch the (aligned) key arrays. Entry `i` of a dictionary is given
+ * by `keys[i]`, `pos[i]`, etc. Entries are sorted by k-mer, and bucket
+ * `hi` (the top `jumpgate_bits` bits of a k-mer) spans [`jumpgate[hi]`,
+ * `jumpgate[hi + 1]`); the jumpgate has a final entry holding `size`.
+ *
+ * Keys are the remaining 64 - `jumpgate_bits` low bits of each k-mer:
+ * `keys` holds the low 32 bits and `keys_hi` the rest, in elements of
+ * `key_hi_bytes` bytes (1 for jumpgates of 24 to 31 bits, 2 for narrower
+ * ones; `keys_hi` is NULL for 32-bit jumpgates). Positions are split
+ * between `pos` and `pos_hi` in the same way, with `pos_hi` NULL unless the
+ * dictionary has wide positions.
+ *
+ * `jumpgate` holds the low 32 bits of each bucket's start index. With more
+ * than 2^32 entries, `jumpgate_wraps[w]` is the first bucket whose start
+ * index is at least (w + 1)*2^32.
+ *
+ * The reference dictionary may instead be packed, with `key_hi_bytes` set
+ * to `KEYS_PACKED` and `keys`, `keys_hi`, `pos`, `pos_hi` and `ambig_flags`
+ * NULL. Its keys then take exactly 64 - `jumpgate_bits` bits each, back to
+ * back in `packed_keys` (the jumpgate already gives their top bits), and
+ * `packed_values` holds a `value_bits`-bit value per entry that replaces
+ * both its position and its flag: the position itself if at most
+ * `ambig_base`, `ambig_base` + 1 + its aux table row if it is ambiguous,
+ * or all 1s for `POS_AMBIGUOUS`.
+ */
+#define DICT_MISS ((size_t)(-1))
+#define JUMPGATE_MAX_WRAPS 16
+#define KEYS_PACKED 3  /* as `key_hi_bytes` */
+
+/*
+ * `lava dict` sizes jumpgates for about `JUMPGATE_BUCKET_TARGET` entries
+ * per bucket, so small panels and filtered dictionaries get a jumpgate
+ * that fits in cache and large ones need few probes per lookup.
+ */
+#define JUMPGATE_MIN_BITS      16
+#define JUMPGATE_MAX_BITS      32
+#define JUMPGATE_BUCKET_TARGET 4
+
+/*
+ * Pigeonhole index for 1-mismatch search: a k-mer within hamming distance
+ * 1 of a query shares one of its two 16-base halves with it. The entries
+ * that share a high half (`HI`) are contiguous in the dictionary itself,
+ * so we only need an index by low half (`LO`). `lo`, `hi` and `idx` give
+ * the low half, high half and dictionary index of every entry, sorted by
+ * low half, and bucket `b` of `jumpgate` spans the entries whose low half
+ * has `b` as its top `jumpgate_bits` bits. The jumpgate is sized like that
+ * of the dictionary (see `jumpgate_bits_for`), up to
+ * `HALF_JUMPGATE_MAX_BITS`.
+ */
+#define HALF_JUMPGATE_MAX_BITS 24
+
+struct half_index {
+	size_t size;  /* 0 if the dictionary has no such index */
+	unsigned jumpgate_bits;
+	uint32_t *jumpgate;
+	uint32_t *lo;
+	uint32_t *hi;
+	uint32_t *idx;
+};
+
+struct ref_dict {
+	size_t size;
+	unsigned jumpgate_bits;
+	uint32_t *jumpgate;
+	size_t jumpgate_wraps[JUMPGATE_MAX_WRAPS];
+	unsigned n_jumpgate_wraps;
+	uint32_t *keys;
+	void *keys_hi;
+	unsigned key_hi_bytes;
+	uint32_t *pos;
+	uint8_t *pos_hi;
+	uint8_t *ambig_flags;
+	uint8_t *packed_keys;    /* NULL unless packed */
+	uint8_t *packed_values;
+	unsigned value_bits;
+	pos_t ambig_base;
+	BloomFilter filter;  /* tested before any lookup */
+	struct half_index halves;
+};
+
+struct snp_dict {
+	size_t size;
+	unsigned jumpgate_bits;
+	uint32_t *jumpgate;
+	size_t jumpgate_wraps[JUMPGATE_MAX_WRAPS];
+	unsigned n_jumpgate_wraps;
+	uint32_t *keys;
+	void *keys_hi;
+	unsigned key_hi_bytes;
+	uint32_t *pos;
+	uint8_t *pos_hi;
+	snp_info *snps;
+	uint8_t *ambig_flags;
+	BloomFilter filter;  /* tested before any lookup */
+	struct half_index halves;
+	BloomFilter read_seeds;  /* read prefilter, tested once per read */
+};
 
-#if !PCOMPACT
+/*
+ * Dictionary files consist of a header (see `struct dict_header`), the
+ * entries, the aux table and then any number of optional sections, each
+ * of which starts with its tag and its length in bytes (excluding this
+ * header). Readers skip sections they don't know about.
+ *
+ * The header is `DICT_MAGIC`, the format version, flags, the entry/aux
+ * table counts, (from version 2) the jumpgate width, (from version 3)
+ * the count of aux table positions and the cap on positions per k-mer and
+ * (from version 4) the largest position. From version 5, the half index
+ * section records its jumpgate width, and from version 6, the flags tell
+ * SNP dictionaries apart (earlier ones can only be told by their layout).
+ * Files written before the header existed start directly with the counts;
+ * they are recognized by the missing magic and have narrow positions. For
+ * those and version 1 files, readers choose the jumpgate width themselves.
+ *
+ * From version 3, each row of the aux table is its length (32 bits)
+ * followed by its positions (each followed by its SNP info in SNP
+ * dictionaries). Earlier versions have rows of `AUX_TABLE_COLS` columns,
+ * padded with 0s, and, in SNP dictionaries, a k-mer before each row and
+ * frequencies after each SNP info.
+ */
+#define DICT_MAGIC   0x5443494456414c4cUL  /* "LLAVDICT" */
+#define DICT_VERSION 6
+
+#define DICT_FLAG_WIDE_POS 0x1  /* positions (and aux table indices) are 40 bits */
+#define DICT_FLAG_SNP      0x2  /* a SNP dictionary (from version 6) */
+
+struct dict_header {
+	uint64_t version;  /* 0 for files without a header */
+	uint64_t flags;
+	uint64_t size;
+	uint64_t aux_size;
+	uint64_t jumpgate_bits;  /* 0 if not recorded */
+	uint64_t aux_positions;  /* 0 if not recorded */
+	uint64_t max_positions;  /* k-mers with more positions are `POS_AMBIGUOUS` */
+	uint64_t max_pos;        /* 0 if not recorded */
+};
+
+#define SECTION_BLOOM      0x1  /* `BloomFilter` over all k-mers in the dictionary */
+#define SECTION_HALF_INDEX 0x2  /* `struct half_index`: its size, jumpgate width, `lo`, `hi` and `idx` */
+#define SECTION_READ_SEEDS 0x3  /* `BloomFilter` over SNP-proximal 16-mer seeds (SNP dict only) */
+
+/* one aligned word, so that read workers can update it atomically */
 struct pileup_entry {
 	unsigned ref : 2;
 	unsigned alt : 2;
@@ -84,32 +227,30 @@ struct pileup_entry {
 	unsigned alt_cnt : 6;
 	uint8_t ref_freq;
 	uint8_t alt_freq;
-} __attribute__((packed));
-#endif
+} __attribute__((packed, aligned(4)));
 
-/* table for storing multiple positions in case of ambiguous k-mers */
+/* the default cap on positions per k-mer, and the row width of dictionaries before version 3 */
 #define AUX_TABLE_COLS 10
 
 #define AUX_TABLE_INIT_SIZE 75000000
-
-struct aux_table {
-	uint32_t pos_list[AUX_TABLE_COLS];
-} __attribute__((packed));
-
 #define SNP_AUX_TABLE_INIT_SIZE 10000000
 
-struct snp_aux_table_dictgen {
-	kmer_t kmer;
-	uint32_t pos_list[AUX_TABLE_COLS];
-	snp_info snp_list[AUX_TABLE_COLS];
-	uint8_t ref_freqs[AUX_TABLE_COLS];
-	uint8_t alt_freqs[AUX_TABLE_COLS];
-} __attribute__((packed));
-
-struct snp_aux_table {
-	uint32_t pos_list[AUX_TABLE_COLS];
-	snp_info snp_list[AUX_TABLE_COLS];
-} __attribute__((packed));
+/*
+ * The positions of k-mers that occur more than once (with their SNP info
+ * in the SNP dictionary's table), in compressed sparse rows: row `i`, the
+ * one an ambiguous entry points to, is positions `offsets[i]` up to (but
+ * excluding) `offsets[i + 1]`. Positions are split as in the dictionaries,
+ * and offsets likewise, with `offsets_hi` NULL below 2^32 positions.
+ */
+struct aux_table {
+	size_t rows;
+	size_t size;       /* positions */
+	uint32_t *offsets; /* `rows + 1` of them */
+	uint8_t *offsets_hi;
+	uint32_t *pos;
+	uint8_t *pos_hi;
+	snp_info *snps;    /* NULL in the reference dictionary's table */
+};
 
 #endif /* LAVA_H */
 
@@ -0,0 +1,145 @@
+#ifndef LIBLAVA_H
+#define LIBLAVA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "api.h"
+#include "hugemem.h"
+#include "topology.h"
+#include "perf.h"
+
+/*
+ * liblava: genotyping without the `lava` front-end
+ *
+ * A `LavaDicts` holds everything that doesn't depend on the sample: the
+ * dictionaries, the contig table and the calling tables. It is loaded once
+ * and is read-only afterwards, so any number of threads and samples may
+ * use it at the same time.
+ *
+ * A `LavaSample` is the pileup of one sample: reads are added to it, either
+ * from FASTQ files (`lava_sample_add_fastq`, which runs its own threads) or
+ * one at a time by `LavaWorker`s, and then its genotypes are called. A
+ * sample can be reset and reused for the next one, which is much cheaper
+ * than making a new one.
+ *
+ * A `LavaWorker` holds the buffers needed to place reads, and must only be
+ * used by one thread at a time. Any number of workers may add reads to the
+ * same sample concurrently.
+ *
+ * Errors in the dictionary files are fatal, as they are for `lava`.
+ */
+
+typedef struct lava_dicts LavaDicts;
+typedef struct lava_sample LavaSample;
+typedef struct lava_worker LavaWorker;
+
+/*
+ * How much of a sample has been read so far. Readers add to it as they
+ * take reads, and other threads may watch it (with relaxed atomic loads)
+ * while they run.
+ */
+typedef struct {
+	uint64_t reads;
+	uint64_t bytes;
+	uint64_t placed;  /* of the reads, once processed */
+} LavaProgress;
+
+/* what happened to the reads of a sample, see `lava_sample_stats` */
+typedef struct {
+	uint64_t reads;
+	uint64_t placed;        /* at one position, agreed on by at least 2 k-mer hits */
+	uint64_t multi;         /* at several positions equally well, so not used */
+	uint64_t unplaced;      /* too few hits, or an N in a k-mer */
+	uint64_t skipped;       /* rejected by the read prefilter (no SNP-proximal seed) */
+	uint64_t informative;   /* placed over the ref or alt base of at least one SNP */
+	uint64_t unambig_hits;  /* k-mers (and neighbors) found at one position */
+	uint64_t ambig_hits;    /* ... found at too many positions to be used */
+	uint64_t ref_covs;      /* SNP bases of placed reads that are the ref base */
+	uint64_t alt_covs;      /* ... the alt base */
+	uint64_t other_covs;    /* ... neither */
+} LavaStats;
+
+typedef struct {
+	size_t ref_calls;
+	size_t alt_calls;
+	size_t het_calls;
+} LavaCallCounts;
+
+/* loads the dictionaries from the files written by `lava dict` */
+LAVA_API LavaDicts *lava_dicts_load(FILE *refdict_file,
+                                    FILE *snpdict_file,
+                                    FILE *chrlens_file,
+                                    const MemOptions *mem_opts,
+                                    const NumaPolicy numa);
+
+/* maps the dictionaries of a segment written by `lava_dicts_publish` */
+LAVA_API LavaDicts *lava_dicts_attach(const char *segment_name,
+                                      FILE *chrlens_file,
+                                      const MemOptions *mem_opts,
+                                      const NumaPolicy numa);
+
+/* loads the dictionaries into a new shared memory segment, see `segment.h` */
+LAVA_API void lava_dicts_publish(FILE *refdict_file, FILE *snpdict_file, const char *segment_name);
+
+/* all samples (and so workers) of `d` must have been freed */
+LAVA_API void lava_dicts_free(LavaDicts *d);
+
+/* a sample with nothing read yet */
+LAVA_API LavaSample *lava_sample_new(LavaDicts *d);
+LAVA_API void lava_sample_reset(LavaSample *s);
+LAVA_API void lava_sample_free(LavaSample *s);
+
+/*
+ * Has `s` record its stages ("reads", "calling" and "output") in `perf`,
+ * or stop doing so if `perf` is NULL. See `perf.h` for the restrictions.
+ */
+LAVA_API void lava_sample_set_perf(LavaSample *s, PerfStats *perf);
+
+/*
+ * The counts of what happened to the reads of `s` so far, taken from its
+ * workers as they are freed (i.e. once `lava_sample_add_fastq` returns).
+ */
+LAVA_API void lava_sample_stats(const LavaSample *s, LavaStats *stats);
+
+/*
+ * Adds the reads of `fastq_files`, read in turn, to `s` with `threads`
+ * threads. Threads are numbered from `first_worker` for NUMA placement, so
+ * that samples read concurrently spread over the machine. If `progress`
+ * isn't NULL, reads are added to it as they are taken.
+ */
+LAVA_API void lava_sample_add_fastq(LavaSample *s,
+                                    FILE **fastq_files,
+                                    const size_t n_fastq_files,
+                                    const unsigned threads,
+                                    const unsigned first_worker,
+                                    LavaProgress *progress);
+
+/*
+ * Calls the genotypes of `s` with `threads` threads and writes them to
+ * `out`, as text or in the binary format of `lava lava --binary`. If
+ * `counts` isn't NULL, it is set to the number of calls of each kind.
+ */
+LAVA_API void lava_sample_write_calls(const LavaSample *s,
+                                      FILE *out,
+                                      const bool binary_out,
+                                      const unsigned threads,
+                                      LavaCallCounts *counts);
+
+/*
+ * A worker adding reads to `s`. Workers are spread over the NUMA nodes by
+ * `index`, and read the dictionaries placed on their node; see
+ * `lava_worker_cpu`.
+ */
+LAVA_API LavaWorker *lava_worker_new(LavaSample *s, const unsigned index);
+
+/* a CPU on the worker's node that we may run on, or -1 if placement is off */
+LAVA_API int lava_worker_cpu(const LavaWorker *w);
+
+/* places one read (a FASTQ sequence line) and adds it to the worker's sample */
+LAVA_API void lava_worker_add_read(LavaWorker *w, const char *seq);
+
+LAVA_API void lava_worker_free(LavaWorker *w);
+
+#endif /* LIBLAVA_H */
@@ -0,0 +1,66 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "api.h"
+
+/*
+ * Per-stage performance counters (`--perf`)
+ *
+ * Hardware counters are opened with `perf_event_open` for the whole
+ * process, inherited by every thread created afterwards, so `perf_init`
+ * must be called before any threads are started. A thread's counts are
+ * only added to the totals when it exits, so a stage must join the threads
+ * it starts before it ends; stages must not overlap.
+ *
+ * Where the counters can't be opened (no PMU, e.g. in many VMs, or a
+ * restrictive `perf_event_paranoid`), stages are timed by the wall clock
+ * alone, and events that the CPU lacks are reported as unavailable.
+ */
+
+enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,  /* last-level cache */
+	PERF_DTLB_MISSES,   /* loads */
+	PERF_BRANCH_MISSES,
+	PERF_N_EVENTS
+};
+
+#define PERF_MAX_STAGES 16
+
+typedef struct {
+	const char *name;  /* a string literal */
+	unsigned runs;
+	double seconds;
+	uint64_t counts[PERF_N_EVENTS];
+} PerfStage;
+
+typedef struct {
+	int fds[PERF_N_EVENTS];  /* -1 for events that couldn't be opened */
+	unsigned n_open;
+	int error;               /* errno of the first failed open, if all failed */
+
+	PerfStage stages[PERF_MAX_STAGES];
+	unsigned n_stages;
+
+	/* the running stage */
+	PerfStage *current;
+	double start;
+	uint64_t start_counts[PERF_N_EVENTS];
+} PerfStats;
+
+/* with `counters` false, only the wall clock is used */
+LAVA_API void perf_init(PerfStats *p, const bool counters);
+LAVA_API void perf_dealloc(PerfStats *p);
+
+/* stages with the same name are added up */
+LAVA_API void perf_begin(PerfStats *p, const char *stage);
+LAVA_API void perf_end(PerfStats *p);
+
+/* as a table, or as a JSON object */
+LAVA_API void perf_report(const PerfStats *p, FILE *out, const bool json);
+
+#endif /* PERF_H */
@@ -3,31 +3,46 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include "lava.h"
 
-struct pileup_entry {
-	unsigned ref : 2;
-	unsigned alt : 2;
-	unsigned ref_cnt : 6;
-	unsigned alt_cnt : 6;
-	uint8_t ref_freq;
-	uint8_t alt_freq;
-	uint32_t key;
-	struct pileup_entry *next;
+/*
+ * Compact pileup table: a chained hash table of the SNP positions alone,
+ * for when a dense table over every position of the genome doesn't fit
+ * (see `--max-mem`). Entries hold a `struct pileup_entry` like those of
+ * the dense table, so that both are counted the same way.
+ */
+
+struct ptable_entry {
+	struct pileup_entry entry;
+	uint64_t key;
+	struct ptable_entry *next;
 };
 
 typedef struct {
-	struct pileup_entry **table;
+	struct ptable_entry **table;
 	size_t count;
 	size_t size;
 	size_t threshold;
 } PileupTable;
 
+/* roughly what `malloc` adds to each entry */
+#define PTABLE_ALLOC_OVERHEAD 16
+
 void ptable_init(PileupTable *p, const size_t size);
 void ptable_dealloc(PileupTable *p);
-void ptable_add(PileupTable *p, const uint32_t key,
+void ptable_add(PileupTable *p, const uint64_t key,
                 unsigned ref, unsigned alt,
                 uint8_t ref_freq, uint8_t alt_freq);
 
+/* the memory taken by `p` */
+size_t ptable_bytes(const PileupTable *p);
+
+/* the smallest initial size that holds `count` entries without growing */
+size_t ptable_size_for(const size_t count);
+
+/* the memory a table of initial size `size` would take with `count` entries */
+size_t ptable_bytes_for(const size_t size, const size_t count);
+
 /*
  * Adapted from java.util.HashMap
  */
@@ -37,9 +52,15 @@ static inline uint32_t hash(uint32_t h)
 	return h ^ (h >> 7) ^ (h >> 4);
 }
 
-static inline struct pileup_entry *ptable_get(PileupTable *p, const uint32_t key)
+/* folds the upper bits of wide positions in before hashing */
+static inline uint32_t ptable_hash(const uint64_t key)
+{
+	return hash((uint32_t)(key ^ (key >> 32)));
+}
+
+static inline struct ptable_entry *ptable_get(const PileupTable *p, const uint64_t key)
 {
-	for (struct pileup_entry *e = p->table[hash(key) & (p->size - 1)];
+	for (struct ptable_entry *e = p->table[ptable_hash(key) & (p->size - 1)];
 	     e != NULL;
 	     e = e->next) {
 		if (e->key == key) {
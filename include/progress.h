@@ -0,0 +1,58 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "liblava.h"
+
+/*
+ * Progress reports for long runs of `lava lava`
+ *
+ * A monitor thread samples a `LavaProgress` (which the readers update once
+ * per batch of reads, with relaxed atomic adds) once a second. Every
+ * `interval` seconds it reports the reads and bytes taken so far, the read
+ * rate over the last `PROGRESS_WINDOW` seconds, the fraction of reads
+ * placed, the time left (if the size of the input is known) and the
+ * resident set size: as a line on standard error (if `print`) and, if a
+ * status file is given, as a JSON object that replaces the file's
+ * contents by a rename, so that readers never see it half written.
+ */
+
+#define PROGRESS_WINDOW 30  /* seconds */
+#define PROGRESS_DEFAULT_INTERVAL 30  /* seconds */
+
+typedef struct {
+	LavaProgress *progress;
+	uint64_t total_bytes;   /* 0 if unknown */
+	unsigned interval;      /* seconds between reports */
+	bool print;             /* to stderr */
+	const char *status_filename;  /* NULL for none */
+	bool status_failed;     /* warned about it already */
+
+	struct timespec start;
+	double window_t[PROGRESS_WINDOW + 1];  /* a ring of per-second samples */
+	uint64_t window_reads[PROGRESS_WINDOW + 1];
+	uint64_t window_bytes[PROGRESS_WINDOW + 1];
+	unsigned window_len;
+	unsigned window_next;
+
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+} ProgressMonitor;
+
+void progress_monitor_start(ProgressMonitor *m,
+                            LavaProgress *progress,
+                            const uint64_t total_bytes,
+                            const unsigned interval,
+                            const bool print,
+                            const char *status_filename);
+
+/* stops the monitor, and writes the final status */
+void progress_monitor_stop(ProgressMonitor *m);
+
+#endif /* PROGRESS_H */
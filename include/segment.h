@@ -0,0 +1,70 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Named shared-memory segments
+ *
+ * A segment holds a metadata block and a list of arrays, which one process
+ * publishes and any number of others then map read-only. Names without a
+ * '/' are POSIX shared memory objects (see `shm_open`); anything else is
+ * taken as a file path, e.g. on a hugetlbfs mount.
+ *
+ * The header records a format version and a caller-supplied layout value,
+ * and is completed only once everything else has been written, so readers
+ * reject segments from incompatible builds as well as unfinished ones.
+ */
+
+#define SEGMENT_MAGIC       0x544e454d4745534cUL  /* "LSEGMENT" */
+#define SEGMENT_VERSION     2
+#define SEGMENT_MAX_ARRAYS  48
+#define SEGMENT_ALIGN       4096
+
+struct segment_array {
+	uint64_t offset;  /* from the start of the segment */
+	uint64_t size;
+};
+
+struct segment_header {
+	uint64_t magic;    /* written last */
+	uint64_t version;
+	uint64_t layout;
+	uint64_t size;     /* of the whole segment */
+	uint64_t meta_offset;
+	uint64_t meta_size;
+	uint64_t n_arrays;
+	struct segment_array arrays[SEGMENT_MAX_ARRAYS];
+};
+
+typedef struct {
+	uint8_t *base;
+	size_t size;
+} Segment;
+
+/*
+ * Creates segment `name` (which must not exist) holding `meta` and the
+ * `n` arrays `arrays[i]` of `sizes[i]` bytes. NULL arrays must be empty.
+ */
+void segment_publish(const char *name, const uint64_t layout,
+                     const void *meta, const size_t meta_size,
+                     void *const *arrays, const size_t *sizes, const size_t n);
+
+/*
+ * Maps segment `name` read-only. Exits with an error if it doesn't exist
+ * or wasn't published by a compatible build (i.e. with the same `layout`).
+ */
+void segment_attach(Segment *s, const char *name, const uint64_t layout);
+void segment_detach(Segment *s);
+
+/* removes segment `name`; processes that have it mapped are unaffected */
+void segment_remove(const char *name);
+
+const void *segment_meta(const Segment *s, const size_t meta_size);
+
+/* array `i`, or NULL if it is empty; `*size` is set to its size */
+const void *segment_array(const Segment *s, const size_t i, size_t *size);
+
+#endif /* SEGMENT_H */
@@ -0,0 +1,44 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Synthetic data for testing and benchmarking (`lava sim`, `lava concord`)
+ *
+ * `sim_generate` writes, from a seed alone:
+ *
+ *  - <prefix>.fa         a random reference, with some of it copied
+ *                        elsewhere so that there are ambiguous k-mers,
+ *  - <prefix>.snps.txt   SNPs on it, in the UCSC format read by `lava dict`,
+ *  - <prefix>.snp_locs   their positions, in the format read by `lava filt`,
+ *  - <prefix>.fq         reads of a diploid sample with genotypes drawn
+ *                        from the SNPs' allele frequencies, and
+ *  - <prefix>.truth      those genotypes, one "<chrom> <pos> <genotype>"
+ *                        line per SNP (1-based positions; genotype 0 is
+ *                        hom. ref., 1 het. and 2 hom. alt.).
+ *
+ * `sim_concordance` then compares the calls of `lava lava --binary` on the
+ * reads with the truth.
+ */
+
+typedef struct {
+	uint64_t seed;
+	uint64_t genome_len;  /* in bases */
+	unsigned n_chroms;
+	double snp_rate;      /* SNPs per base */
+	double repeat_frac;   /* fraction of the genome overwritten by copies of other parts */
+	unsigned read_len;
+	double coverage;
+	double error_rate;    /* per base */
+} SimOptions;
+
+void sim_options_default(SimOptions *opts);
+
+void sim_generate(const SimOptions *opts, const char *prefix);
+
+/* reads `truth` and binary `calls`, and writes "<metric> <value>" lines to `out` */
+void sim_concordance(FILE *truth, FILE *calls, FILE *out);
+
+#endif /* SIM_H */
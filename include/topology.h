@@ -0,0 +1,60 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * NUMA topology and placement
+ *
+ * The nodes and their CPUs are read from sysfs, keeping only the CPUs we
+ * may run on (see `sched_getaffinity`) and the nodes that have any, and
+ * memory is placed with the raw `mbind` system call, so that we don't
+ * depend on libnuma. On machines with a single node (or without sysfs)
+ * everything here is a no-op.
+ */
+
+#define TOPO_MAX_NODES 64
+
+typedef enum {
+	NUMA_OFF,
+	NUMA_INTERLEAVE,  /* spread pages over all nodes */
+	NUMA_REPLICATE,   /* give each node its own copy of read-only data */
+} NumaPolicy;
+
+typedef struct {
+	unsigned n_nodes;
+	int node_ids[TOPO_MAX_NODES];  /* kernel node numbers, ascending */
+	unsigned n_cpus;
+	int *cpus;       /* online CPUs we may run on, grouped by node */
+	unsigned *cpu_node;  /* index (into `node_ids`) of each CPU's node */
+	bool bind;       /* whether to bind threads to nodes: false if we may only run on some of their CPUs */
+} Topology;
+
+void topology_init(Topology *t);
+void topology_dealloc(Topology *t);
+
+/* free memory on node `node` (an index into `node_ids`) in bytes, or 0 if unknown */
+uint64_t topology_node_free(const Topology *t, const unsigned node);
+
+/* interleave the pages of [`p`, `p + len`) over all nodes, before they are touched */
+bool numa_interleave(const Topology *t, void *p, const size_t len);
+
+/* place the pages of [`p`, `p + len`) on node `node`, before they are touched */
+bool numa_bind(const Topology *t, void *p, const size_t len, const unsigned node);
+
+/*
+ * CPU for worker `i` of a pool: workers are dealt out to the nodes in turn,
+ * and to the CPUs of each node in turn. Sets `*node` to the index of the
+ * CPU's node. Returns -1 (and node 0) if the topology is unknown.
+ */
+int topology_worker_cpu(const Topology *t, const unsigned i, unsigned *node);
+
+/* pins the calling thread to `cpu` */
+bool pin_thread(const int cpu);
+
+/* restricts the calling thread to the CPUs of node `node` (an index into `node_ids`) */
+bool topology_bind_node(const Topology *t, const unsigned node);
+
+#endif /* TOPOLOGY_H */
@@ -0,0 +1,38 @@
+#ifndef UNIXSOCK_H
+#define UNIXSOCK_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/*
+ * Line-oriented Unix domain stream sockets
+ *
+ * Requests and replies are single lines of text. Replies are sent without
+ * blocking, so a client that stops reading loses lines rather than stalling
+ * the sender, and a client that has gone away is ignored (no `SIGPIPE`).
+ */
+
+#define UNIXSOCK_LINE_MAX 4096
+
+/*
+ * Listens on `path`, replacing a stale socket left there by a process that
+ * has exited. Exits with an error if `path` is in use or can't be bound.
+ */
+int unixsock_listen(const char *path);
+
+/* accepts a connection on `listener`, or returns -1 */
+int unixsock_accept(const int listener);
+
+/* connects to `path`, or returns -1 (with `errno` set) */
+int unixsock_connect(const char *path);
+
+/*
+ * Reads one line (without its newline) into `buf`, waiting at most
+ * `timeout_ms` for it. Returns false on timeout, EOF or error.
+ */
+bool unixsock_read_line(const int fd, char *buf, const size_t len, const int timeout_ms);
+
+/* sends one line, formatted as by `printf`, with a newline appended */
+bool unixsock_printf(const int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif /* UNIXSOCK_H */
@@ -36,6 +36,58 @@ uint32_t read_uint32(FILE *in);
 
 uint8_t read_uint8(FILE *in);
 
+bool read_section_header(FILE *in, uint64_t *tag, uint64_t *len);
+
+/* skips `len` bytes of `in`, which may be a pipe */
+void skip_bytes(FILE *in, uint64_t len);
+
+void serialize_section_header(FILE *out, const uint64_t tag, const uint64_t len);
+
+void serialize_dict_header(FILE *out, const struct dict_header *h);
+
+void read_dict_header(FILE *in, struct dict_header *h);
+
+/* exits unless the dictionary is a SNP one if `snp`, and a reference one otherwise, as far as it says */
+void dict_check_kind(const struct dict_header *h, const bool snp);
+
+/* jumpgate width for a dictionary of `size` entries */
+unsigned jumpgate_bits_for(const uint64_t size);
+
+/* jumpgate width for a half index of `size` entries */
+unsigned half_jumpgate_bits_for(const uint64_t size);
+
+uint64_t read_half_index_header(FILE *in, const uint64_t len, uint64_t *size, unsigned *jumpgate_bits);
+
+void serialize_pos(FILE *out, const pos_t pos, const bool wide);
+
+pos_t read_pos(FILE *in, const bool wide);
+
+/* the bytes each entry, and the whole aux table, of a dictionary take in its file */
+uint64_t dict_entry_bytes(const struct dict_header *h, const bool snp);
+
+uint64_t dict_aux_bytes(const struct dict_header *h, const bool snp);
+
+/* reads the rows of a dictionary's aux table, whichever its version */
+typedef struct {
+	FILE *in;
+	bool snp;
+	bool wide;
+	bool fixed;  /* rows of `AUX_TABLE_COLS` columns (before version 3) */
+	uint64_t max_positions;
+} AuxReader;
+
+void aux_reader_init(AuxReader *r, FILE *in, const struct dict_header *h, const bool snp);
+
+/*
+ * Reads the next row into `pos` and, in SNP dictionaries, `snps` (each
+ * with room for the header's `max_positions`), returning its length. Rows
+ * of fixed width end at their first 0, as they always have.
+ */
+size_t aux_read_row(AuxReader *r, pos_t *pos, snp_info *snps);
+
+/* writes a row of the aux table in the current format; `snps` is NULL in reference dictionaries */
+void serialize_aux_row(FILE *out, const pos_t *pos, const snp_info *snps, const size_t n, const bool wide);
+
 int kmer_cmp(const void *p1, const void *p2);
 
 int snp_kmer_cmp(const void *p1, const void *p2);
@@ -0,0 +1,75 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Buffered output with hand-rolled number formatting, for writing
+ * millions of calls without going through `fprintf` for each one.
+ */
+
+#define WRITER_BUF_SIZE (1 << 16)
+
+typedef struct {
+	FILE *out;
+	size_t len;
+	char buf[WRITER_BUF_SIZE];
+} Writer;
+
+void writer_init(Writer *w, FILE *out);
+void writer_flush(Writer *w);
+
+/* formats `x` exactly as `printf("%.15g", x)` does */
+void writer_put_double(Writer *w, const double x);
+
+static inline char *writer_reserve(Writer *w, const size_t n)
+{
+	if (w->len + n > WRITER_BUF_SIZE)
+		writer_flush(w);
+	return &w->buf[w->len];
+}
+
+static inline void writer_put_bytes(Writer *w, const void *p, const size_t n)
+{
+	if (n > WRITER_BUF_SIZE) {
+		writer_flush(w);
+		assert(fwrite(p, 1, n, w->out) == n);
+		return;
+	}
+
+	memcpy(writer_reserve(w, n), p, n);
+	w->len += n;
+}
+
+static inline void writer_putc(Writer *w, const char c)
+{
+	*writer_reserve(w, 1) = c;
+	++w->len;
+}
+
+static inline void writer_puts(Writer *w, const char *s)
+{
+	writer_put_bytes(w, s, strlen(s));
+}
+
+static inline void writer_put_uint(Writer *w, uint64_t x)
+{
+	char digits[20];
+	size_t n = 0;
+
+	do {
+		digits[n++] = '0' + (x % 10);
+		x /= 10;
+	} while (x);
+
+	char *p = writer_reserve(w, n);
+	for (size_t i = 0; i < n; i++) {
+		p[i] = digits[n - 1 - i];
+	}
+	w->len += n;
+}
+
+#endif /* WRITER_H */
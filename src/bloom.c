@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "bloom.h"
+#include "util.h"
+
+static unsigned log2_blocks_for(const size_t expected_keys)
+{
+	const uint64_t bits = (uint64_t)expected_keys * BLOOM_BITS_PER_KEY;
+	const uint64_t block_bits = BLOOM_BLOCK_WORDS * 64;
+	unsigned log2_blocks = 0;
+
+	while (((1UL << log2_blocks) * block_bits) < bits)
+		++log2_blocks;
+
+	return log2_blocks;
+}
+
+static void bloom_alloc(BloomFilter *b, const unsigned log2_blocks)
+{
+	const size_t bytes = (1UL << log2_blocks) * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+	void *blocks;
+
+	/* blocks must be cache-line aligned */
+	assert(posix_memalign(&blocks, 64, bytes) == 0);
+	memset(blocks, 0, bytes);
+
+	b->blocks = blocks;
+	b->n_blocks = 1UL << log2_blocks;
+	b->log2_blocks = log2_blocks;
+}
+
+void bloom_init(BloomFilter *b, const size_t expected_keys)
+{
+	bloom_alloc(b, log2_blocks_for(expected_keys));
+}
+
+void bloom_dealloc(BloomFilter *b)
+{
+	free(b->blocks);
+	b->blocks = NULL;
+	b->n_blocks = 0;
+	b->log2_blocks = 0;
+}
+
+/*
+ * Shrinks `b` to the size it would have had if it had been initialized
+ * for `expected_keys` keys. Since a key's block is given by the high bits
+ * of its hash, block `i` of the halved filter is simply the union of
+ * blocks `2i` and `2i + 1`.
+ */
+void bloom_fold(BloomFilter *b, const size_t expected_keys)
+{
+	const unsigned target = log2_blocks_for(expected_keys);
+
+	while (b->log2_blocks > target) {
+		const uint64_t half = b->n_blocks/2;
+
+		for (uint64_t i = 0; i < half; i++) {
+			const uint64_t *src1 = &b->blocks[(2*i) * BLOOM_BLOCK_WORDS];
+			const uint64_t *src2 = &b->blocks[(2*i + 1) * BLOOM_BLOCK_WORDS];
+			uint64_t *dest = &b->blocks[i * BLOOM_BLOCK_WORDS];
+
+			for (unsigned j = 0; j < BLOOM_BLOCK_WORDS; j++) {
+				dest[j] = src1[j] | src2[j];
+			}
+		}
+
+		b->n_blocks = half;
+		--b->log2_blocks;
+	}
+}
+
+uint64_t bloom_serialized_size(const BloomFilter *b)
+{
+	return sizeof(uint64_t) + b->n_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+void bloom_serialize(const BloomFilter *b, FILE *out)
+{
+	serialize_uint64(out, b->log2_blocks);
+	assert(fwrite(b->blocks, BLOOM_BLOCK_WORDS * sizeof(uint64_t), b->n_blocks, out) == b->n_blocks);
+}
+
+void bloom_deserialize(BloomFilter *b, FILE *in, const uint64_t len, HugeMem *mem, const char *name)
+{
+	b->log2_blocks = read_uint64(in);
+	b->n_blocks = 1UL << b->log2_blocks;
+	assert(len == bloom_serialized_size(b));
+
+	b->blocks = hugemem_alloc(mem, b->n_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t), name);
+	assert(fread(b->blocks, BLOOM_BLOCK_WORDS * sizeof(uint64_t), b->n_blocks, in) == b->n_blocks);
+}
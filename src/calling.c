@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <assert.h>
+#include "lava.h"
+#include "calling.h"
+
+#define CALL_MIN_RANGE (1 << 22)  /* don't bother splitting below this many slots per thread */
+#define CALL_LIST_INIT_SIZE 1024
+
+void call_tables_init(CallTables *t)
+{
+	for (int ref_cnt = 0; ref_cnt <= MAX_COV; ref_cnt++) {
+		for (int alt_cnt = 0; alt_cnt <= MAX_COV; alt_cnt++) {
+			const size_t c = ref_cnt*CALL_COUNTS + alt_cnt;
+			t->g0[c] = pow(1.0 - ERR_RATE, ref_cnt) * pow(ERR_RATE, alt_cnt);
+			t->g1[c] = pow(0.5, ref_cnt + alt_cnt);
+			t->g2[c] = pow(ERR_RATE, ref_cnt) * pow(1.0 - ERR_RATE, alt_cnt);
+		}
+	}
+
+	const double M = exp(-AVG_COV);
+	for (int i = 0; i <= (2*MAX_COV); i++) {
+		t->poisson[i] = (M*pow(AVG_COV, i))/exp(lgamma(i+1.0));
+	}
+
+	for (int i = 0; i < 256; i++) {
+		const double p = i/255.0;
+		t->freq_sq[i] = p*p;
+	}
+}
+
+/*
+ * Chooses the most likely of the 3 genotypes at each site, weighted by the
+ * Hardy-Weinberg priors from the allele frequencies. Sites with no coverage
+ * or with saturated counts for both alleles get `GTYPE_NONE`.
+ */
+void call_batch(const CallTables *t, CallBatch *b)
+{
+	const size_t n = b->n;
+
+	for (size_t i = 0; i < n; i++) {
+		const unsigned ref_cnt = b->ref_cnt[i];
+		const unsigned alt_cnt = b->alt_cnt[i];
+		const size_t c = ref_cnt*CALL_COUNTS + alt_cnt;
+
+		const double p2 = t->freq_sq[b->ref_freq[i]];
+		const double q2 = t->freq_sq[b->alt_freq[i]];
+
+		const double p_g0 = p2*t->g0[c];
+		const double p_g1 = (1.0 - p2 - q2)*t->g1[c];
+		const double p_g2 = q2*t->g2[c];
+		const double total = p_g0 + p_g1 + p_g2;
+
+		const int is_ref = (p_g0 > p_g1) & (p_g0 > p_g2);
+		const int is_het = !is_ref & (p_g1 > p_g0) & (p_g1 > p_g2);
+		const int none = ((ref_cnt | alt_cnt) == 0) | ((ref_cnt & alt_cnt) == MAX_COV);
+
+		const double best = is_ref ? p_g0 : (is_het ? p_g1 : p_g2);
+		const uint8_t genotype = is_ref ? GTYPE_REF : (is_het ? GTYPE_HET : GTYPE_ALT);
+
+		b->genotype[i] = none ? GTYPE_NONE : genotype;
+		b->confidence[i] = none ? 0.0 : (best/total)*t->poisson[ref_cnt + alt_cnt];
+	}
+}
+
+static void call_list_init(CallList *list)
+{
+	list->calls = malloc(CALL_LIST_INIT_SIZE * sizeof(*list->calls));
+	assert(list->calls);
+	list->count = 0;
+	list->cap = CALL_LIST_INIT_SIZE;
+	list->ref_calls = 0;
+	list->alt_calls = 0;
+	list->het_calls = 0;
+}
+
+void call_list_dealloc(CallList *list)
+{
+	free(list->calls);
+	list->calls = NULL;
+	list->count = 0;
+	list->cap = 0;
+}
+
+static void call_list_append(CallList *list, const size_t index, const int genotype, const double confidence)
+{
+	if (list->count == list->cap) {
+		const size_t new_cap = (list->cap * 3)/2 + 1;
+		list->calls = realloc(list->calls, new_cap * sizeof(*list->calls));
+		assert(list->calls);
+		list->cap = new_cap;
+	}
+
+	list->calls[list->count++] = (struct site_call){.index = index, .confidence = confidence, .genotype = genotype};
+}
+
+/*
+ * Calls the sites in `b` and moves the results to `list`.
+ */
+static void call_batch_flush(const CallTables *t, CallBatch *b, CallList *list)
+{
+	call_batch(t, b);
+
+	for (size_t i = 0; i < b->n; i++) {
+		switch (b->genotype[i]) {
+		case GTYPE_NONE:
+			break;
+		case GTYPE_REF:
+			++list->ref_calls;
+			break;
+		case GTYPE_ALT:
+			++list->alt_calls;
+			call_list_append(list, b->index[i], GTYPE_ALT, b->confidence[i]);
+			break;
+		case GTYPE_HET:
+			++list->het_calls;
+			call_list_append(list, b->index[i], GTYPE_HET, b->confidence[i]);
+			break;
+		}
+	}
+
+	b->n = 0;
+}
+
+static inline void call_batch_push(const CallTables *t,
+                                   CallBatch *b,
+                                   CallList *list,
+                                   const size_t index,
+                                   const struct pileup_entry *p)
+{
+	const size_t i = b->n++;
+	b->index[i] = index;
+	b->ref_cnt[i] = p->ref_cnt;
+	b->alt_cnt[i] = p->alt_cnt;
+	b->ref_freq[i] = p->ref_freq;
+	b->alt_freq[i] = p->alt_freq;
+
+	if (b->n == CALL_BATCH)
+		call_batch_flush(t, b, list);
+}
+
+struct call_range {
+	const CallTables *t;
+	const PileupTable *ptable;  /* NULL for a dense table */
+	const struct pileup_entry *pileup_table;
+	size_t lo;  /* slots (dense) or buckets (compact) */
+	size_t hi;
+	CallList list;
+};
+
+static void *call_range(void *arg)
+{
+	struct call_range *r = arg;
+	CallBatch *b = malloc(sizeof(*b));
+	assert(b);
+	b->n = 0;
+	call_list_init(&r->list);
+
+	if (r->ptable != NULL) {
+		for (size_t i = r->lo; i < r->hi; i++) {
+			for (const struct ptable_entry *e = r->ptable->table[i]; e != NULL; e = e->next) {
+				if (e->entry.ref != e->entry.alt)
+					call_batch_push(r->t, b, &r->list, e->key, &e->entry);
+			}
+		}
+	} else {
+		for (size_t i = r->lo; i < r->hi; i++) {
+			const struct pileup_entry *p = &r->pileup_table[i];
+			if (p->ref != p->alt)
+				call_batch_push(r->t, b, &r->list, i, p);
+		}
+	}
+
+	call_batch_flush(r->t, b, &r->list);
+	free(b);
+	return NULL;
+}
+
+static void call_ranges(struct call_range *ranges, const size_t size, unsigned threads, CallList *out)
+{
+	if (threads > size/CALL_MIN_RANGE + 1)
+		threads = size/CALL_MIN_RANGE + 1;
+	if (threads == 0)
+		threads = 1;
+
+	pthread_t tids[threads];
+
+	for (unsigned i = 0; i < threads; i++) {
+		ranges[i] = ranges[0];
+		ranges[i].lo = (size * i)/threads;
+		ranges[i].hi = (size * (i + 1))/threads;
+	}
+
+	/* the calling thread takes the first range */
+	for (unsigned i = 1; i < threads; i++) {
+		assert(pthread_create(&tids[i], NULL, call_range, &ranges[i]) == 0);
+	}
+	call_range(&ranges[0]);
+
+	size_t total = 0;
+	for (unsigned i = 1; i < threads; i++) {
+		assert(pthread_join(tids[i], NULL) == 0);
+	}
+	for (unsigned i = 0; i < threads; i++) {
+		total += ranges[i].list.count;
+	}
+
+	/* ranges are in pileup order, so concatenating them keeps it */
+	*out = ranges[0].list;
+	out->calls = realloc(out->calls, (total + 1) * sizeof(*out->calls));
+	assert(out->calls);
+	out->cap = total + 1;
+
+	for (unsigned i = 1; i < threads; i++) {
+		CallList *list = &ranges[i].list;
+		memcpy(&out->calls[out->count], list->calls, list->count * sizeof(*list->calls));
+		out->count += list->count;
+		out->ref_calls += list->ref_calls;
+		out->alt_calls += list->alt_calls;
+		out->het_calls += list->het_calls;
+		call_list_dealloc(list);
+	}
+}
+
+void call_pileup(const CallTables *t,
+                 const struct pileup_entry *pileup_table,
+                 const size_t pileup_size,
+                 unsigned threads,
+                 CallList *out)
+{
+	struct call_range ranges[threads ? threads : 1];
+	ranges[0] = (struct call_range){.t = t, .ptable = NULL, .pileup_table = pileup_table};
+	call_ranges(ranges, pileup_size, threads, out);
+}
+
+void call_ptable(const CallTables *t, const PileupTable *ptable, unsigned threads, CallList *out)
+{
+	struct call_range ranges[threads ? threads : 1];
+	ranges[0] = (struct call_range){.t = t, .ptable = ptable, .pileup_table = NULL};
+	call_ranges(ranges, ptable->size, threads, out);
+}
@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include "contigs.h"
+
+#define CONTIG_TABLE_INIT_SIZE 64
+
+static uint64_t name_hash(const char *name)
+{
+	/* FNV-1a */
+	uint64_t h = 0xcbf29ce484222325UL;
+	for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+		h ^= *p;
+		h *= 0x100000001b3UL;
+	}
+	return h;
+}
+
+static void slots_insert(size_t *slots, const size_t n_slots, const uint64_t h, const size_t index)
+{
+	size_t s = h & (n_slots - 1);
+	while (slots[s] != CONTIG_NONE)
+		s = (s + 1) & (n_slots - 1);
+	slots[s] = index;
+}
+
+static void slots_alloc(ContigTable *t, const size_t n_slots)
+{
+	free(t->slots);
+	t->slots = malloc(n_slots * sizeof(*t->slots));
+	assert(t->slots);
+	t->n_slots = n_slots;
+
+	for (size_t s = 0; s < n_slots; s++) {
+		t->slots[s] = CONTIG_NONE;
+	}
+
+	for (size_t i = 0; i < t->count; i++) {
+		slots_insert(t->slots, n_slots, name_hash(t->names[i]), i);
+	}
+}
+
+void contig_table_init(ContigTable *t)
+{
+	t->count = 0;
+	t->cap = CONTIG_TABLE_INIT_SIZE;
+	t->names = malloc(t->cap * sizeof(*t->names));
+	assert(t->names);
+	t->lens = malloc(t->cap * sizeof(*t->lens));
+	assert(t->lens);
+	t->ends = malloc(t->cap * sizeof(*t->ends));
+	assert(t->ends);
+
+	t->slots = NULL;
+	slots_alloc(t, 2*CONTIG_TABLE_INIT_SIZE);
+}
+
+void contig_table_dealloc(ContigTable *t)
+{
+	for (size_t i = 0; i < t->count; i++) {
+		free(t->names[i]);
+	}
+	free(t->names);
+	free(t->lens);
+	free(t->ends);
+	free(t->slots);
+	t->count = 0;
+	t->cap = 0;
+}
+
+size_t contig_table_add(ContigTable *t, const char *name, const uint64_t len)
+{
+	if (contig_table_find(t, name) != CONTIG_NONE) {
+		fprintf(stderr, "Duplicate contig name: %s\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	if (t->count == t->cap) {
+		const size_t new_cap = 2*t->cap;
+		t->names = realloc(t->names, new_cap * sizeof(*t->names));
+		assert(t->names);
+		t->lens = realloc(t->lens, new_cap * sizeof(*t->lens));
+		assert(t->lens);
+		t->ends = realloc(t->ends, new_cap * sizeof(*t->ends));
+		assert(t->ends);
+		t->cap = new_cap;
+	}
+
+	const size_t i = t->count++;
+	t->names[i] = strdup(name);
+	assert(t->names[i]);
+	t->lens[i] = len;
+	t->ends[i] = (i ? t->ends[i - 1] : 0) + len;
+
+	/* keep the load factor at or below 1/2 */
+	if (2*t->count > t->n_slots)
+		slots_alloc(t, 2*t->n_slots);
+	else
+		slots_insert(t->slots, t->n_slots, name_hash(name), i);
+
+	return i;
+}
+
+size_t contig_table_find(const ContigTable *t, const char *name)
+{
+	size_t s = name_hash(name) & (t->n_slots - 1);
+
+	while (t->slots[s] != CONTIG_NONE) {
+		if (strcmp(t->names[t->slots[s]], name) == 0)
+			return t->slots[s];
+		s = (s + 1) & (t->n_slots - 1);
+	}
+
+	return CONTIG_NONE;
+}
+
+void contig_table_load(ContigTable *t, FILE *chrlens_file)
+{
+	char *line = NULL;
+	size_t line_cap = 0;
+	ssize_t line_len;
+
+	while ((line_len = getline(&line, &line_cap, chrlens_file)) != -1) {
+		size_t i = 0;
+		while (i < (size_t)line_len && !isspace(line[i]))
+			++i;
+
+		if (i == 0)
+			continue;  /* blank line */
+
+		if (i == (size_t)line_len) {
+			fprintf(stderr, "Malformed chrlens line (no length): %s\n", line);
+			exit(EXIT_FAILURE);
+		}
+
+		line[i] = '\0';
+		contig_table_add(t, line, strtoull(&line[i + 1], NULL, 10));
+	}
+
+	assert(!ferror(chrlens_file));
+	free(line);
+}
@@ -4,16 +4,18 @@
 #include <stdbool.h>
 #include <assert.h>
 #include "lava.h"
+#include "bloom.h"
 #include "util.h"
+#include "dictgen.h"
 
-static bool ref_kmer_snp_proximity_check(const uint32_t pos, bool *snp_locations, size_t snp_locs_size)
+static bool ref_kmer_snp_proximity_check(const pos_t pos, bool *snp_locations, size_t snp_locs_size)
 {
 	if (pos >= snp_locs_size)
 		return false;
 
-	const uint32_t lo = pos > (READ_LEN - 32) ? pos - (READ_LEN - 32) : 0;
-	const uint32_t hi = (pos < snp_locs_size - (READ_LEN - 1)) ? pos + (READ_LEN - 1) : snp_locs_size - 1;
-	for (uint32_t i = lo; i <= hi; i++) {
+	const pos_t lo = pos > (READ_LEN - 32) ? pos - (READ_LEN - 32) : 0;
+	const pos_t hi = (pos < snp_locs_size - (READ_LEN - 1)) ? pos + (READ_LEN - 1) : snp_locs_size - 1;
+	for (pos_t i = lo; i <= hi; i++) {
 		if (snp_locations[i])
 			return true;
 	}
@@ -30,17 +32,33 @@ void dict_filt(FILE *ref_dict, FILE *snp_pos, FILE *out)
 	}
 	fclose(snp_pos);
 
-	const uint64_t ref_dict_size = read_uint64(ref_dict);
-	const uint64_t ref_aux_table_size = read_uint64(ref_dict);
+	struct dict_header header;
+	read_dict_header(ref_dict, &header);
+	dict_check_kind(&header, false);
+	const uint64_t ref_dict_size = header.size;
+	const uint64_t ref_aux_table_size = header.aux_size;
+	const bool wide = header.flags & DICT_FLAG_WIDE_POS;
 
-	serialize_uint64(out, 0UL);
-	serialize_uint64(out, ref_aux_table_size);
+	/*
+	 * the retained k-mers, in case we have to rebuild the half index, which
+	 * we only know once we get to the input's sections
+	 */
+	kmer_t *kmers = NULL;
+	size_t kmers_cap = 0;
+
+	header.size = 0;  /* placeholder until we know how many are retained */
+	serialize_dict_header(out, &header);
+
+	/* built for the full dictionary, then folded down to the retained k-mers */
+	BloomFilter filter;
+	bloom_init(&filter, ref_dict_size);
 
 	size_t removed = 0;
 	size_t ref_dict_size_new = ref_dict_size;
+	pos_t max_pos = 0;
 	for (uint64_t i = 0; i < ref_dict_size; i++) {
 		const kmer_t kmer = read_uint64(ref_dict);
-		const uint32_t pos = read_uint32(ref_dict);
+		const pos_t pos = read_pos(ref_dict, wide);
 		const uint8_t ambig_flag = read_uint8(ref_dict);
 
 		if (pos == POS_AMBIGUOUS ||
@@ -48,8 +66,20 @@ void dict_filt(FILE *ref_dict, FILE *snp_pos, FILE *out)
 		    ref_kmer_snp_proximity_check(pos, snp_locations, snp_locs_size)) {
 
 			serialize_uint64(out, kmer);
-			serialize_uint32(out, pos);
+			serialize_pos(out, pos, wide);
 			serialize_uint8(out, ambig_flag);
+			bloom_add(&filter, kmer);
+
+			const size_t n = i - removed;  /* its new ordinal */
+			if (n == kmers_cap) {
+				kmers_cap = (kmers_cap * 3)/2 + 16;
+				kmers = realloc(kmers, kmers_cap * sizeof(*kmers));
+				assert(kmers);
+			}
+			kmers[n] = kmer;
+
+			if (pos != POS_AMBIGUOUS && ambig_flag != FLAG_AMBIGUOUS)
+				max_pos = MAX(max_pos, pos);
 		} else {
 			--ref_dict_size_new;
 			++removed;
@@ -58,22 +88,44 @@ void dict_filt(FILE *ref_dict, FILE *snp_pos, FILE *out)
 	printf("New size: %lu\n", ref_dict_size_new);
 	printf("Removed:  %lu/%lu\n", removed, (size_t)ref_dict_size);
 
-	for (uint64_t i = 0; i < ref_aux_table_size; i++) {
-		uint32_t aux_row[AUX_TABLE_COLS] = { 0 };
-		size_t next = 0;
+	/* rewritten in the current format, whichever the input's */
+	AuxReader aux;
+	aux_reader_init(&aux, ref_dict, &header, false);
+	pos_t *aux_row = malloc(header.max_positions * sizeof(*aux_row));
+	assert(aux_row);
+	uint64_t aux_positions = 0;
 
-		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
-			const uint32_t pos = read_uint32(ref_dict);
-			aux_row[next++] = pos;
-		}
+	for (uint64_t i = 0; i < ref_aux_table_size; i++) {
+		const size_t n = aux_read_row(&aux, aux_row, NULL);
+		serialize_aux_row(out, aux_row, NULL, n, wide);
+		aux_positions += n;
+	}
+	free(aux_row);
 
-		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
-			serialize_uint32(out, aux_row[j]);
-		}
+	/* the input's sections describe the unfiltered dictionary, so we rebuild them */
+	bool half_index = false;
+	uint64_t tag;
+	uint64_t len;
+	while (read_section_header(ref_dict, &tag, &len)) {
+		half_index |= (tag == SECTION_HALF_INDEX);
+		skip_bytes(ref_dict, len);
 	}
 
+	bloom_fold(&filter, ref_dict_size_new);
+	serialize_section_header(out, SECTION_BLOOM, bloom_serialized_size(&filter));
+	bloom_serialize(&filter, out);
+	bloom_dealloc(&filter);
+
+	if (half_index)
+		write_half_index_section(kmers, sizeof(*kmers), ref_dict_size_new, out);
+	free(kmers);
+
+	header.size = ref_dict_size_new;
+	header.aux_positions = aux_positions;
+	header.max_pos = max_pos;
+	header.jumpgate_bits = jumpgate_bits_for(ref_dict_size_new);
 	rewind(out);
-	serialize_uint64(out, ref_dict_size_new);
+	serialize_dict_header(out, &header);
 	fclose(out);
 	free(snp_locations);
 }
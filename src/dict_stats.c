@@ -0,0 +1,406 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include "lava.h"
+#include "util.h"
+#include "dict_stats.h"
+
+#define N_WIDTHS (JUMPGATE_MAX_BITS - JUMPGATE_MIN_BITS + 1)
+
+/* bucket sizes below this are counted in a histogram, larger ones listed */
+#define BUCKET_HIST_SIZE 4096
+
+/* aux table rows at least this long are counted together */
+#define ROW_FILL_SIZE 64
+
+/* the buckets of a jumpgate `bits` wide, tallied as the sorted entries stream by */
+struct width_stats {
+	unsigned bits;
+	uint64_t bucket;    /* the current bucket... */
+	uint64_t run;       /* ...and its entries so far */
+	uint64_t nonempty;
+	uint64_t max;
+	double sum_squares;
+	uint64_t hist[BUCKET_HIST_SIZE];
+	uint64_t *large;
+	size_t n_large;
+	size_t cap_large;
+};
+
+struct dict_summary {
+	struct dict_header header;
+	bool snp;
+	uint64_t unambig;
+	uint64_t in_aux;
+	uint64_t dropped;  /* `POS_AMBIGUOUS`: more than `max_positions` positions */
+	pos_t max_pos;
+	uint64_t row_fill[ROW_FILL_SIZE + 1];
+	unsigned max_row;
+	uint64_t aux_positions;
+	bool has_filter;  /* i.e. its section was found */
+	bool has_seeds;
+	uint64_t filter_bytes;
+	uint64_t seeds_bytes;
+	uint64_t halves_size;
+	unsigned halves_jumpgate_bits;
+};
+
+/*
+ * Whether the dictionary, whose entries start at `start`, is laid out as
+ * a reference (or SNP) dictionary: its entries and aux table must then be
+ * followed by known sections that end exactly at the end of the file.
+ * Only needed for dictionaries from before version 6, which don't say.
+ */
+static bool layout_fits(FILE *dict, const uint64_t start, const uint64_t file_size,
+                        const struct dict_header *h, const bool snp)
+{
+	if (h->size > file_size || h->aux_size > file_size || h->aux_positions > file_size)
+		return false;
+
+	uint64_t offset = start + h->size*dict_entry_bytes(h, snp) + dict_aux_bytes(h, snp);
+
+	while (offset + 2*sizeof(uint64_t) <= file_size) {
+		uint64_t tag;
+		uint64_t len;
+		assert(fseek(dict, (long)offset, SEEK_SET) == 0);
+		assert(read_section_header(dict, &tag, &len));
+
+		if (tag != SECTION_BLOOM && tag != SECTION_HALF_INDEX && !(snp && tag == SECTION_READ_SEEDS))
+			return false;
+		if (len > file_size)
+			return false;
+		offset += 2*sizeof(uint64_t) + len;
+	}
+
+	return offset == file_size;
+}
+
+/* whether the dictionary, whose entries come next in `dict`, is a SNP one */
+static bool guess_snp(FILE *dict, const struct dict_header *h)
+{
+	struct stat st;
+	assert(fstat(fileno(dict), &st) == 0);
+	const uint64_t file_size = st.st_size;
+	const long start = ftell(dict);
+	if (start < 0) {
+		fprintf(stderr, "Dictionaries from before format version 6 can't be read from a pipe\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const bool fits_ref = layout_fits(dict, start, file_size, h, false);
+	const bool fits_snp = layout_fits(dict, start, file_size, h, true);
+	if (!fits_ref && !fits_snp) {
+		fprintf(stderr, "Not a reference or SNP dictionary, or truncated\n");
+		exit(EXIT_FAILURE);
+	}
+
+	assert(fseek(dict, start, SEEK_SET) == 0);
+	return fits_snp && !fits_ref;
+}
+
+static void bucket_end(struct width_stats *w)
+{
+	const uint64_t run = w->run;
+	if (run == 0)
+		return;
+
+	++w->nonempty;
+	w->max = MAX(w->max, run);
+	w->sum_squares += (double)run * run;
+
+	if (run < BUCKET_HIST_SIZE) {
+		++w->hist[run];
+	} else {
+		if (w->n_large == w->cap_large) {
+			w->cap_large = (w->cap_large * 3)/2 + 16;
+			w->large = realloc(w->large, w->cap_large * sizeof(*w->large));
+			assert(w->large);
+		}
+		w->large[w->n_large++] = run;
+	}
+	w->run = 0;
+}
+
+static inline void bucket_add(struct width_stats *w, const kmer_t kmer)
+{
+	const uint64_t bucket = kmer >> (64 - w->bits);
+	if (bucket != w->bucket) {
+		bucket_end(w);
+		w->bucket = bucket;
+	}
+	++w->run;
+}
+
+static int uint64_cmp(const void *p1, const void *p2)
+{
+	const uint64_t a = *(const uint64_t *)p1;
+	const uint64_t b = *(const uint64_t *)p2;
+	return (a > b) - (a < b);
+}
+
+/* the size of the bucket at quantile `q`, counting empty buckets; `large` must be sorted */
+static uint64_t bucket_quantile(const struct width_stats *w, const double q)
+{
+	const uint64_t buckets = 1UL << w->bits;
+	const uint64_t rank = (uint64_t)ceil(q * buckets);
+	uint64_t seen = buckets - w->nonempty;  /* the empty ones */
+
+	if (seen >= rank)
+		return 0;
+
+	for (uint64_t size = 1; size < BUCKET_HIST_SIZE; size++) {
+		seen += w->hist[size];
+		if (seen >= rank)
+			return size;
+	}
+
+	return w->large[rank - seen - 1];
+}
+
+/* as `load_dicts` lays keys out, see `key_hi_bytes_for` */
+static unsigned key_bytes(const unsigned bits)
+{
+	return sizeof(uint32_t) + ((bits == 32) ? 0 : ((bits >= 24) ? 1 : 2));
+}
+
+static double mib(const double bytes)
+{
+	return bytes/(1UL << 20);
+}
+
+static void print_buckets(const struct dict_summary *d, struct width_stats *widths, const unsigned bits_used, FILE *out)
+{
+	const uint64_t n = d->header.size;
+
+	fprintf(out, "\nJumpgate buckets (k-mers per bucket; \"by hit\" weighs each bucket by its k-mers, as lookups do):\n");
+	fprintf(out, "  %5s %12s %7s %8s %8s %7s %7s %7s %7s %9s %11s\n",
+	        "bits", "buckets", "empty", "mean", "by hit", "p50", "p90", "p99", "p99.9", "max", "index MiB");
+
+	for (unsigned i = 0; i < N_WIDTHS; i++) {
+		struct width_stats *w = &widths[i];
+		const uint64_t buckets = 1UL << w->bits;
+		const double index_bytes = (buckets + 1) * sizeof(uint32_t) + (double)n * key_bytes(w->bits);
+
+		qsort(w->large, w->n_large, sizeof(*w->large), uint64_cmp);
+
+		fprintf(out, "%c %5u %12lu %6.1f%% %8.2f %8.2f %7lu %7lu %7lu %7lu %9lu %11.1f\n",
+		        (w->bits == bits_used) ? '*' : ' ', w->bits, buckets,
+		        100.0 * (buckets - w->nonempty) / buckets,
+		        (double)n / buckets, n ? w->sum_squares / n : 0.0,
+		        bucket_quantile(w, 0.5), bucket_quantile(w, 0.9), bucket_quantile(w, 0.99), bucket_quantile(w, 0.999),
+		        w->max, mib(index_bytes));
+	}
+
+	fprintf(out, "  (* the width %s; index: the jumpgate and the keys)\n",
+	        d->header.jumpgate_bits ? "recorded in the dictionary" : "that would be chosen when loading");
+}
+
+static void print_aux(const struct dict_summary *d, FILE *out)
+{
+	const uint64_t rows = d->header.aux_size;
+	fprintf(out, "\nAux table:             %lu rows of up to %lu positions\n", rows, d->header.max_positions);
+	if (rows == 0)
+		return;
+
+	fprintf(out, "  positions per row:   %.2f on average, %u at most\n", (double)d->aux_positions / rows, d->max_row);
+	for (unsigned k = 0; k <= ROW_FILL_SIZE; k++) {
+		if (d->row_fill[k] > 0)
+			fprintf(out, "  %2u%s %12lu rows (%.1f%%)\n", k, (k == ROW_FILL_SIZE) ? "+:" : ": ",
+			        d->row_fill[k], 100.0 * d->row_fill[k] / rows);
+	}
+}
+
+/*
+ * The memory the dictionary takes once loaded with a jumpgate `bits` wide
+ * (see `lookup_arrays` in lava.c), and what other layouts would save.
+ */
+static void print_layouts(const struct dict_summary *d, const unsigned bits, FILE *out)
+{
+	const struct dict_header *h = &d->header;
+	const bool wide = h->flags & DICT_FLAG_WIDE_POS;
+	const double n = h->size;
+	const double rows = h->aux_size;
+	const double info_bytes = d->snp ? sizeof(snp_info) : 0;
+
+	const double jumpgate = ((1UL << bits) + 1) * sizeof(uint32_t);
+	const double keys = n * key_bytes(bits);
+	const double positions = n * (sizeof(uint32_t) + (wide ? 1 : 0));
+	const double flags = n * sizeof(uint8_t);
+	const double infos = n * info_bytes;
+	const double aux = (rows + 1) * (sizeof(uint32_t) + ((d->aux_positions >= POS_NARROW_LIMIT) ? 1 : 0)) +
+	                   d->aux_positions * (sizeof(uint32_t) + (wide ? 1 : 0) + info_bytes);
+	const double halves = d->halves_size ?
+	                      d->halves_size * 3*sizeof(uint32_t) + ((1UL << d->halves_jumpgate_bits) + 1) * sizeof(uint32_t) :
+	                      0;
+	const double total = jumpgate + keys + positions + flags + infos + aux + d->filter_bytes + d->seeds_bytes + halves;
+
+	/* positions (and aux row indices) must fit in 32 bits, or 31 to spare a bit for the flag */
+	const bool can_narrow = wide && d->max_pos < UINT32_MAX && h->aux_size < UINT32_MAX;
+	const bool can_fold = wide || (d->max_pos < (1UL << 31) && h->aux_size < (1UL << 31));
+
+	const double narrow_saving = can_narrow ? n + d->aux_positions : 0;  /* aux positions narrowed too */
+	const double fold_saving = can_fold ? flags : 0;
+
+	/*
+	 * Packed (reference dictionaries only, see `struct ref_dict`): keys in
+	 * their exact width, and positions, aux rows and the flag in one value
+	 * as wide as the largest of them, which without a recorded largest
+	 * position is the largest the position width allows.
+	 */
+	const pos_t ambig_base = h->max_pos ? h->max_pos : wide ? POS_WIDE_LIMIT - 1 : POS_NARROW_LIMIT - 1;
+	const unsigned value_bits = 64 - __builtin_clzl(ambig_base + h->aux_size + 1);
+	const double packed_saving = d->snp ? 0 : keys + positions + flags - n * (64 - bits + value_bits) / 8;
+
+	const double all_saving = MAX(narrow_saving + fold_saving, packed_saving) + halves;
+
+	fprintf(out, "\nMemory once loaded:    %.1f MiB with a jumpgate of %u bits\n", mib(total), bits);
+	fprintf(out, "  jumpgate %.1f, keys %.1f, positions %.1f, flags %.1f", mib(jumpgate), mib(keys), mib(positions), mib(flags));
+	if (d->snp)
+		fprintf(out, ", SNP info %.1f", mib(infos));
+	fprintf(out, ", aux table %.1f", mib(aux));
+	if (d->has_filter)
+		fprintf(out, ", Bloom filter %.1f", mib(d->filter_bytes));
+	if (d->has_seeds)
+		fprintf(out, ", read seeds %.1f", mib(d->seeds_bytes));
+	if (d->halves_size)
+		fprintf(out, ", half index %.1f", mib(halves));
+	fprintf(out, " MiB\n");
+
+	fprintf(out, "\nProjected memory in other layouts:\n");
+	if (can_narrow)
+		fprintf(out, "  %-44s %9.1f MiB (%+.1f)\n", "32-bit positions", mib(total - narrow_saving), -mib(narrow_saving));
+	if (can_fold)
+		fprintf(out, "  %-44s %9.1f MiB (%+.1f)\n", "ambiguity flag in a position bit", mib(total - fold_saving), -mib(fold_saving));
+	if (!d->snp) {
+		char label[64];
+		snprintf(label, sizeof(label), "packed (%u-bit keys, %u-bit positions)", 64 - bits, value_bits);
+		fprintf(out, "  %-44s %9.1f MiB (%+.1f)\n", label, mib(total - packed_saving), -mib(packed_saving));
+	}
+	if (d->halves_size)
+		fprintf(out, "  %-44s %9.1f MiB (%+.1f)\n", "without the half index", mib(total - halves), -mib(halves));
+	fprintf(out, "  %-44s %9.1f MiB (%+.1f)\n", "all of the above", mib(total - all_saving), -mib(all_saving));
+}
+
+void dict_stats(FILE *dict, FILE *out)
+{
+	struct dict_summary d = {0};
+	struct dict_header *h = &d.header;
+	read_dict_header(dict, h);
+	const bool wide = h->flags & DICT_FLAG_WIDE_POS;
+	d.snp = (h->version >= 6) ? (h->flags & DICT_FLAG_SNP) != 0 : guess_snp(dict, h);
+
+	struct width_stats *widths = calloc(N_WIDTHS, sizeof(*widths));
+	assert(widths);
+	for (unsigned i = 0; i < N_WIDTHS; i++) {
+		widths[i].bits = JUMPGATE_MIN_BITS + i;
+	}
+
+	for (uint64_t i = 0; i < h->size; i++) {
+		const kmer_t kmer = read_uint64(dict);
+		const pos_t pos = read_pos(dict, wide);
+		if (d.snp) {
+			read_uint8(dict);  /* SNP info */
+		}
+		const uint8_t ambig_flag = read_uint8(dict);
+		if (d.snp) {
+			read_uint8(dict);  /* frequencies */
+			read_uint8(dict);
+		}
+
+		if (pos == POS_AMBIGUOUS) {
+			++d.dropped;
+		} else if (ambig_flag == FLAG_AMBIGUOUS) {
+			++d.in_aux;
+		} else {
+			++d.unambig;
+			d.max_pos = MAX(d.max_pos, pos);
+		}
+
+		for (unsigned w = 0; w < N_WIDTHS; w++) {
+			bucket_add(&widths[w], kmer);
+		}
+	}
+
+	for (unsigned w = 0; w < N_WIDTHS; w++) {
+		bucket_end(&widths[w]);
+	}
+
+	AuxReader aux;
+	aux_reader_init(&aux, dict, h, d.snp);
+	pos_t *row_pos = malloc(h->max_positions * sizeof(*row_pos));
+	snp_info *row_snps = malloc(h->max_positions * sizeof(*row_snps));
+	assert(row_pos && row_snps);
+
+	for (uint64_t i = 0; i < h->aux_size; i++) {
+		const size_t fill = aux_read_row(&aux, row_pos, row_snps);
+		for (size_t j = 0; j < fill; j++) {
+			d.max_pos = MAX(d.max_pos, row_pos[j]);
+		}
+
+		++d.row_fill[MIN(fill, ROW_FILL_SIZE)];
+		d.max_row = MAX(d.max_row, fill);
+		d.aux_positions += fill;
+	}
+	free(row_pos);
+	free(row_snps);
+
+	uint64_t tag;
+	uint64_t len;
+	while (read_section_header(dict, &tag, &len)) {
+		switch (tag) {
+		case SECTION_BLOOM:
+			d.has_filter = true;
+			d.filter_bytes = len - sizeof(uint64_t);
+			break;
+		case SECTION_HALF_INDEX:
+			len -= read_half_index_header(dict, len, &d.halves_size, &d.halves_jumpgate_bits);
+			break;
+		case SECTION_READ_SEEDS:
+			d.has_seeds = true;
+			d.seeds_bytes = len - sizeof(uint64_t);
+			break;
+		}
+		skip_bytes(dict, len);
+	}
+
+	const uint64_t n = h->size;
+	const unsigned bits = h->jumpgate_bits ? h->jumpgate_bits : jumpgate_bits_for(n);
+
+	fprintf(out, "Dictionary:            %s (format version %lu, %s positions)\n",
+	        d.snp ? "SNP" : "reference", h->version, wide ? "40-bit" : "32-bit");
+	fprintf(out, "K-mers:                %lu\n", n);
+	fprintf(out, "  unambiguous:         %lu (%.1f%%)\n", d.unambig, n ? 100.0 * d.unambig / n : 0.0);
+	fprintf(out, "  in the aux table:    %lu (%.1f%%)\n", d.in_aux, n ? 100.0 * d.in_aux / n : 0.0);
+	fprintf(out, "  POS_AMBIGUOUS:       %lu (%.1f%%; more than %lu positions)\n",
+	        d.dropped, n ? 100.0 * d.dropped / n : 0.0, h->max_positions);
+	fprintf(out, "Largest position:      %lu\n", d.max_pos);
+	fprintf(out, "Sections:             ");
+	const char *sep = " ";
+	if (d.has_filter) {
+		fprintf(out, "%sBloom filter %.1f MiB", sep, mib(d.filter_bytes));
+		sep = ", ";
+	}
+	if (d.has_seeds) {
+		fprintf(out, "%sread seeds %.1f MiB", sep, mib(d.seeds_bytes));
+		sep = ", ";
+	}
+	if (d.halves_size) {
+		fprintf(out, "%shalf index of %lu k-mers (jumpgate of %u bits)", sep, d.halves_size, d.halves_jumpgate_bits);
+		sep = ", ";
+	}
+	fprintf(out, "%s\n", STREQ(sep, " ") ? " none" : "");
+
+	print_aux(&d, out);
+	print_buckets(&d, widths, bits, out);
+	print_layouts(&d, bits, out);
+
+	for (unsigned w = 0; w < N_WIDTHS; w++) {
+		free(widths[w].large);
+	}
+	free(widths);
+}
@@ -6,20 +6,22 @@
 #include <ctype.h>
 #include <assert.h>
 #include "fasta_parser.h"
+#include "bloom.h"
 #include "util.h"
+#include "contigs.h"
 #include "dictgen.h"
 
 static size_t ref_to_constituent_kmers(struct kmer_info *kmers,
                                        const char *ref,
                                        const size_t ref_len,
-                                       uint32_t *index)
+                                       pos_t *index)
 {
 	assert(ref_len >= 32);
 	const size_t kmers_len_max = ref_len - 32 + 1;
 	size_t kmers_len_true = 0;
 
-	kmer_t kmer;
-	uint32_t index_true = *index;
+	kmer_t kmer = 0;
+	pos_t index_true = *index;
 	bool need_full_encode = true;
 	bool kmer_had_n;
 
@@ -39,7 +41,7 @@ static size_t ref_to_constituent_kmers(struct kmer_info *kmers,
 
 		if (!kmer_had_n) {
 			kmers[kmers_len_true].kmer = kmer;
-			kmers[kmers_len_true].pos = index_true;
+			KMER_INFO_SET_POS(kmers[kmers_len_true], index_true);
 			++kmers_len_true;
 		}
 
@@ -60,16 +62,148 @@ static void sort_snp_kmers(struct snp_kmer_info *kmers, const size_t kmers_len)
 	qsort(kmers, kmers_len, sizeof(*kmers), snp_kmer_cmp);
 }
 
-static void write_kmers(struct kmer_info *kmers, const size_t kmers_len, FILE *out)
+static void write_bloom_section(const BloomFilter *filter, FILE *out)
 {
-	struct aux_table *aux_table = malloc(AUX_TABLE_INIT_SIZE * sizeof(*aux_table));
-	assert(aux_table);
-	uint64_t aux_table_count = 0;
-	uint64_t aux_table_cap = AUX_TABLE_INIT_SIZE;
+	serialize_section_header(out, SECTION_BLOOM, bloom_serialized_size(filter));
+	bloom_serialize(filter, out);
+}
+
+/*
+ * Read prefilter: a read can only update the pileup table through a k-mer
+ * within one mismatch of a dictionary k-mer that spans a SNP, i.e. of a SNP
+ * k-mer or of the reference k-mer at the same position. Such a read k-mer
+ * agrees with the dictionary k-mer on at least one 16-base half, so the set
+ * of those halves (and of their reverse complements, for reads that align
+ * to the opposite strand) rules out every other read.
+ */
+static size_t add_kmer_seeds(uint32_t *seeds, const kmer_t kmer)
+{
+	const kmer_t rc = rev_compl(kmer);
+	seeds[0] = LO(kmer);
+	seeds[1] = HI(kmer);
+	seeds[2] = LO(rc);
+	seeds[3] = HI(rc);
+	return 4;
+}
+
+static int uint32_cmp(const void *p1, const void *p2)
+{
+	const uint32_t a = *(const uint32_t *)p1;
+	const uint32_t b = *(const uint32_t *)p2;
+	return (a > b) - (a < b);
+}
+
+static uint64_t write_seed_section(uint32_t *seeds, const size_t seeds_len, FILE *out)
+{
+	qsort(seeds, seeds_len, sizeof(*seeds), uint32_cmp);
+
+	size_t unique = 0;
+	for (size_t i = 0; i < seeds_len; i++) {
+		if (i == 0 || seeds[i] != seeds[i - 1])
+			seeds[unique++] = seeds[i];
+	}
+
+	BloomFilter filter;
+	bloom_init(&filter, unique);
+	for (size_t i = 0; i < unique; i++) {
+		bloom_add(&filter, seeds[i]);
+	}
+
+	const uint64_t filter_bytes = bloom_serialized_size(&filter);
+	serialize_section_header(out, SECTION_READ_SEEDS, filter_bytes);
+	bloom_serialize(&filter, out);
+	bloom_dealloc(&filter);
+	return filter_bytes;
+}
+
+struct half_entry {
+	uint32_t lo;
+	uint32_t hi;
+	uint32_t idx;
+};
+
+static int half_entry_cmp(const void *p1, const void *p2)
+{
+	const struct half_entry *e1 = p1;
+	const struct half_entry *e2 = p2;
+	const uint64_t k1 = ((uint64_t)e1->lo << 32) | e1->hi;
+	const uint64_t k2 = ((uint64_t)e2->lo << 32) | e2->hi;
+	return (k1 > k2) - (k1 < k2);
+}
+
+/*
+ * Writes the pigeonhole index (see `struct half_index`) for the sorted
+ * k-mers in `kmers`, which is an array of `kmers_len` structures of size
+ * `stride` that each begin with a `kmer_t`. Duplicate k-mers share a
+ * single dictionary entry, just as in `write_kmers`.
+ */
+void write_half_index_section(const void *kmers, const size_t stride, const size_t kmers_len, FILE *out)
+{
+	/* entries are indexed by 32-bit dictionary indices */
+	if (kmers_len > UINT32_MAX) {
+		printf("Half index skipped: more than 2^32 k-mers\n");
+		return;
+	}
+
+	struct half_entry *entries = malloc(kmers_len * sizeof(*entries));
+	assert(entries);
+	size_t n = 0;
+	kmer_t last = 0;
+
+	for (size_t i = 0; i < kmers_len; i++) {
+		kmer_t kmer;
+		memcpy(&kmer, (const char *)kmers + i*stride, sizeof(kmer));
+
+		if (i > 0 && kmer == last)
+			continue;
+
+		entries[n] = (struct half_entry){.lo = LO(kmer), .hi = HI(kmer), .idx = n};
+		++n;
+		last = kmer;
+	}
+
+	qsort(entries, n, sizeof(*entries), half_entry_cmp);
 
-	const uint64_t placeholder = 0UL;
-	serialize_uint64(out, placeholder);  /* dict size (rows) placeholder */
-	serialize_uint64(out, placeholder);  /* aux table size (rows) placeholder */
+	serialize_section_header(out, SECTION_HALF_INDEX, 2*sizeof(uint64_t) + n*3*sizeof(uint32_t));
+	serialize_uint64(out, n);
+	serialize_uint64(out, half_jumpgate_bits_for(n));
+	for (size_t i = 0; i < n; i++)
+		serialize_uint32(out, entries[i].lo);
+	for (size_t i = 0; i < n; i++)
+		serialize_uint32(out, entries[i].hi);
+	for (size_t i = 0; i < n; i++)
+		serialize_uint32(out, entries[i].idx);
+
+	free(entries);
+}
+
+/* makes room in a growable array of `count` elements for one more */
+static void *reserve(void *array, size_t *cap, const size_t count, const size_t elem_size)
+{
+	if (count < *cap)
+		return array;
+
+	*cap = (*cap * 3)/2 + 1;
+	array = realloc(array, *cap * elem_size);
+	assert(array);
+	return array;
+}
+
+static void write_kmers(struct kmer_info *kmers, const size_t kmers_len, FILE *out, const DictOptions *opts)
+{
+	/* the aux table, as compressed sparse rows: the length of each row, and all positions back to back */
+	size_t aux_rows_cap = AUX_TABLE_INIT_SIZE;
+	size_t aux_pos_cap = 2*AUX_TABLE_INIT_SIZE;
+	uint32_t *aux_lens = malloc(aux_rows_cap * sizeof(*aux_lens));
+	pos_t *aux_pos = malloc(aux_pos_cap * sizeof(*aux_pos));
+	assert(aux_lens && aux_pos);
+	uint64_t aux_rows = 0;
+	uint64_t aux_positions = 0;
+
+	const bool wide = opts->wide_pos;
+	const size_t max_positions = opts->max_positions;
+	struct dict_header header = {.flags = wide ? DICT_FLAG_WIDE_POS : 0, .max_positions = max_positions};
+	serialize_dict_header(out, &header);  /* counts are placeholders for now */
 
 	uint64_t kmers_written = 0UL;
 	size_t i = 0;
@@ -82,7 +216,7 @@ static void write_kmers(struct kmer_info *kmers, const size_t kmers_len, FILE *o
 
 	while (i < kmers_len) {
 		const kmer_t kmer = kmers[i].kmer;
-		const uint32_t pos = kmers[i].pos;
+		const pos_t pos = KMER_INFO_POS(kmers[i]);
 		serialize_uint64(out, kmer);
 
 		++i;
@@ -91,78 +225,102 @@ static void write_kmers(struct kmer_info *kmers, const size_t kmers_len, FILE *o
 			++ambig_unique_kmers;
 			++ambig_total_kmers;
 
-			if (aux_table_count == aux_table_cap) {
-				const size_t new_cap = (aux_table_cap * 3)/2 + 1;
-				aux_table = realloc(aux_table, new_cap * sizeof(*aux_table));
-				assert(aux_table);
-				aux_table_cap = new_cap;
-			}
-
-			aux_table[aux_table_count].pos_list[0] = pos;
+			const uint64_t row_start = aux_positions;
+			aux_pos = reserve(aux_pos, &aux_pos_cap, aux_positions, sizeof(*aux_pos));
+			aux_pos[aux_positions++] = pos;
 
 			size_t k = 1;
-			bool too_many_positions = false;
 			do {
-				if (k < AUX_TABLE_COLS) {
-					aux_table[aux_table_count].pos_list[k++] = kmers[i].pos;
-				} else {
-					too_many_positions = true;
+				if (k < max_positions) {
+					aux_pos = reserve(aux_pos, &aux_pos_cap, aux_positions, sizeof(*aux_pos));
+					aux_pos[aux_positions++] = KMER_INFO_POS(kmers[i]);
 				}
 
+				++k;
 				++ambig_total_kmers;
 				++i;
 			} while (i < kmers_len && kmer == kmers[i].kmer);
 
-			if (too_many_positions) {  // these need not be included, but I'm including it anyway...
-				serialize_uint32(out, POS_AMBIGUOUS);
+			if (k > max_positions) {  // these need not be included, but I'm including it anyway...
+				aux_positions = row_start;
+				serialize_pos(out, POS_AMBIGUOUS, wide);
 				serialize_uint8(out, FLAG_AMBIGUOUS);
 			} else {
-				/* fill in remainder with 0s */
-				while (k < AUX_TABLE_COLS) {
-					aux_table[aux_table_count].pos_list[k++] = 0;
-				}
+				aux_lens = reserve(aux_lens, &aux_rows_cap, aux_rows, sizeof(*aux_lens));
+				aux_lens[aux_rows] = k;
 
-				serialize_uint32(out, aux_table_count);
+				serialize_pos(out, aux_rows, wide);
 				serialize_uint8(out, FLAG_AMBIGUOUS);
-				++aux_table_count;
+				++aux_rows;
 			}
 		} else {
 			++unambig_kmers;
-			serialize_uint32(out, pos);
+			serialize_pos(out, pos, wide);
 			serialize_uint8(out, FLAG_UNAMBIGUOUS);
 		}
 
 		++kmers_written;
 	}
 
-	for (i = 0; i < aux_table_count; i++) {
-		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
-			serialize_uint32(out, aux_table[i].pos_list[j]);
-		}
+	for (size_t row = 0, offset = 0; row < aux_rows; offset += aux_lens[row], row++) {
+		serialize_aux_row(out, &aux_pos[offset], NULL, aux_lens[row], wide);
+	}
+	free(aux_lens);
+	free(aux_pos);
+
+	BloomFilter filter;
+	bloom_init(&filter, kmers_written);
+	for (i = 0; i < kmers_len; i++) {
+		bloom_add(&filter, kmers[i].kmer);
+		header.max_pos = MAX(header.max_pos, KMER_INFO_POS(kmers[i]));
+	}
+	const uint64_t filter_bytes = bloom_serialized_size(&filter);
+	write_bloom_section(&filter, out);
+	bloom_dealloc(&filter);
+
+	if (opts->half_index) {
+		write_half_index_section(kmers, sizeof(*kmers), kmers_len, out);
 	}
-	free(aux_table);
 
+	header.size = kmers_written;
+	header.aux_size = aux_rows;
+	header.aux_positions = aux_positions;
+	header.jumpgate_bits = jumpgate_bits_for(kmers_written);
 	rewind(out);
-	serialize_uint64(out, kmers_written);
-	serialize_uint64(out, aux_table_count);
+	serialize_dict_header(out, &header);
 
 	printf("Ref Dictionary\n");
 	printf("Total k-mers:        %lu\n", total_kmers);
 	printf("Unambig k-mers:      %lu\n", unambig_kmers);
 	printf("Ambig unique k-mers: %lu\n", ambig_unique_kmers);
 	printf("Ambig total k-mers:  %lu\n", ambig_total_kmers);
+	printf("Aux positions:       %lu\n", aux_positions);
+	printf("Filter size (bytes): %lu\n", filter_bytes);
+	printf("Jumpgate bits:       %lu\n", header.jumpgate_bits);
 }
 
-static void write_snp_kmers(struct snp_kmer_info *kmers, const size_t kmers_len, FILE *out)
+static void write_snp_kmers(struct snp_kmer_info *kmers,
+                            const size_t kmers_len,
+                            uint32_t *seeds,
+                            const size_t seeds_len,
+                            FILE *out,
+                            const DictOptions *opts)
 {
-	struct snp_aux_table_dictgen *aux_table = malloc(SNP_AUX_TABLE_INIT_SIZE * sizeof(*aux_table));
-	assert(aux_table);
-	uint64_t aux_table_count = 0;
-	uint64_t aux_table_cap = SNP_AUX_TABLE_INIT_SIZE;
-
-	const uint64_t placeholder = 0UL;
-	serialize_uint64(out, placeholder);  /* dict size (rows) placeholder */
-	serialize_uint64(out, placeholder);  /* aux table size (rows) placeholder */
+	/* as in `write_kmers`, with the SNP info of each position */
+	size_t aux_rows_cap = SNP_AUX_TABLE_INIT_SIZE;
+	size_t aux_pos_cap = 2*SNP_AUX_TABLE_INIT_SIZE;
+	size_t aux_snps_cap = aux_pos_cap;
+	uint32_t *aux_lens = malloc(aux_rows_cap * sizeof(*aux_lens));
+	pos_t *aux_pos = malloc(aux_pos_cap * sizeof(*aux_pos));
+	snp_info *aux_snps = malloc(aux_snps_cap * sizeof(*aux_snps));
+	assert(aux_lens && aux_pos && aux_snps);
+	uint64_t aux_rows = 0;
+	uint64_t aux_positions = 0;
+
+	const bool wide = opts->wide_pos;
+	const size_t max_positions = opts->max_positions;
+	struct dict_header header = {.flags = (wide ? DICT_FLAG_WIDE_POS : 0) | DICT_FLAG_SNP, .max_positions = max_positions};
+	serialize_dict_header(out, &header);  /* counts are placeholders for now */
 
 	uint64_t kmers_written = 0UL;
 	size_t i = 0;
@@ -175,7 +333,7 @@ static void write_snp_kmers(struct snp_kmer_info *kmers, const size_t kmers_len,
 
 	while (i < kmers_len) {
 		const kmer_t kmer = kmers[i].kmer;
-		const uint32_t pos = kmers[i].pos;
+		const pos_t pos = KMER_INFO_POS(kmers[i]);
 		const snp_info snp = kmers[i].snp;
 		const uint8_t ref_freq = kmers[i].ref_freq;
 		const uint8_t alt_freq = kmers[i].alt_freq;
@@ -187,62 +345,47 @@ static void write_snp_kmers(struct snp_kmer_info *kmers, const size_t kmers_len,
 			++ambig_unique_kmers;
 			++ambig_total_kmers;
 
-			if (aux_table_count == aux_table_cap) {
-				const size_t new_cap = (aux_table_cap * 3)/2 + 1;
-				aux_table = realloc(aux_table, new_cap * sizeof(*aux_table));
-				assert(aux_table);
-				aux_table_cap = new_cap;
-			}
-
-			aux_table[aux_table_count].kmer = kmer;
-			aux_table[aux_table_count].pos_list[0] = pos;
-			aux_table[aux_table_count].snp_list[0] = snp;
-			aux_table[aux_table_count].ref_freqs[0] = ref_freq;
-			aux_table[aux_table_count].alt_freqs[0] = alt_freq;
+			const uint64_t row_start = aux_positions;
+			aux_pos = reserve(aux_pos, &aux_pos_cap, aux_positions, sizeof(*aux_pos));
+			aux_snps = reserve(aux_snps, &aux_snps_cap, aux_positions, sizeof(*aux_snps));
+			aux_pos[aux_positions] = pos;
+			aux_snps[aux_positions++] = snp;
 
 			size_t k = 1;
-			bool too_many_positions = false;
 			do {
-				if (k < AUX_TABLE_COLS) {
-					aux_table[aux_table_count].pos_list[k] = kmers[i].pos;
-					aux_table[aux_table_count].snp_list[k] = kmers[i].snp;
-					aux_table[aux_table_count].ref_freqs[k] = kmers[i].ref_freq;
-					aux_table[aux_table_count].alt_freqs[k] = kmers[i].alt_freq;
-					++k;
-				} else {
-					too_many_positions = true;
+				if (k < max_positions) {
+					aux_pos = reserve(aux_pos, &aux_pos_cap, aux_positions, sizeof(*aux_pos));
+					aux_snps = reserve(aux_snps, &aux_snps_cap, aux_positions, sizeof(*aux_snps));
+					aux_pos[aux_positions] = KMER_INFO_POS(kmers[i]);
+					aux_snps[aux_positions++] = kmers[i].snp;
 				}
 
+				++k;
 				++ambig_total_kmers;
 				++i;
 			} while (i < kmers_len && kmer == kmers[i].kmer);
 
-			if (too_many_positions) {  // these need not be included, but I'm including it anyway...
-				serialize_uint32(out, POS_AMBIGUOUS);
+			if (k > max_positions) {  // these need not be included, but I'm including it anyway...
+				aux_positions = row_start;
+				serialize_pos(out, POS_AMBIGUOUS, wide);
 				serialize_uint8(out, 0);  // SNP info
 				serialize_uint8(out, FLAG_AMBIGUOUS);
 				serialize_uint8(out, 0);  // ref freq
 				serialize_uint8(out, 0);  // alt freq
 			} else {
-				/* fill in remainder with 0s */
-				while (k < AUX_TABLE_COLS) {
-					aux_table[aux_table_count].pos_list[k] = 0;
-					aux_table[aux_table_count].snp_list[k] = 0;
-					aux_table[aux_table_count].ref_freqs[k] = 0;
-					aux_table[aux_table_count].alt_freqs[k] = 0;
-					++k;
-				}
+				aux_lens = reserve(aux_lens, &aux_rows_cap, aux_rows, sizeof(*aux_lens));
+				aux_lens[aux_rows] = k;
 
-				serialize_uint32(out, aux_table_count);
+				serialize_pos(out, aux_rows, wide);
 				serialize_uint8(out, 0);  // SNP info
 				serialize_uint8(out, FLAG_AMBIGUOUS);
 				serialize_uint8(out, 0);  // ref freq
 				serialize_uint8(out, 0);  // alt freq
-				++aux_table_count;
+				++aux_rows;
 			}
 		} else {
 			++unambig_kmers;
-			serialize_uint32(out, pos);
+			serialize_pos(out, pos, wide);
 			serialize_uint8(out, snp);
 			serialize_uint8(out, FLAG_UNAMBIGUOUS);
 			serialize_uint8(out, ref_freq);  // ref freq
@@ -252,29 +395,48 @@ static void write_snp_kmers(struct snp_kmer_info *kmers, const size_t kmers_len,
 		++kmers_written;
 	}
 
-	for (i = 0; i < aux_table_count; i++) {
-		serialize_uint64(out, aux_table[i].kmer);
-		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
-			serialize_uint32(out, aux_table[i].pos_list[j]);
-			serialize_uint8(out, aux_table[i].snp_list[j]);
-			serialize_uint8(out, aux_table[i].ref_freqs[j]);
-			serialize_uint8(out, aux_table[i].alt_freqs[j]);
-		}
+	for (size_t row = 0, offset = 0; row < aux_rows; offset += aux_lens[row], row++) {
+		serialize_aux_row(out, &aux_pos[offset], &aux_snps[offset], aux_lens[row], wide);
 	}
-	free(aux_table);
+	free(aux_lens);
+	free(aux_pos);
+	free(aux_snps);
+
+	BloomFilter filter;
+	bloom_init(&filter, kmers_written);
+	for (i = 0; i < kmers_len; i++) {
+		bloom_add(&filter, kmers[i].kmer);
+		header.max_pos = MAX(header.max_pos, KMER_INFO_POS(kmers[i]));
+	}
+	const uint64_t filter_bytes = bloom_serialized_size(&filter);
+	write_bloom_section(&filter, out);
+	bloom_dealloc(&filter);
+
+	if (opts->half_index) {
+		write_half_index_section(kmers, sizeof(*kmers), kmers_len, out);
+	}
+
+	const uint64_t seed_filter_bytes = write_seed_section(seeds, seeds_len, out);
 
+	header.size = kmers_written;
+	header.aux_size = aux_rows;
+	header.aux_positions = aux_positions;
+	header.jumpgate_bits = jumpgate_bits_for(kmers_written);
 	rewind(out);
-	serialize_uint64(out, kmers_written);
-	serialize_uint64(out, aux_table_count);
+	serialize_dict_header(out, &header);
 
 	printf("SNP Dictionary\n");
 	printf("Total k-mers:        %lu\n", total_kmers);
 	printf("Unambig k-mers:      %lu\n", unambig_kmers);
 	printf("Ambig unique k-mers: %lu\n", ambig_unique_kmers);
 	printf("Ambig total k-mers:  %lu\n", ambig_total_kmers);
+	printf("Aux positions:       %lu\n", aux_positions);
+	printf("Filter size (bytes): %lu\n", filter_bytes);
+	printf("Seed filter (bytes): %lu\n", seed_filter_bytes);
+	printf("Jumpgate bits:       %lu\n", header.jumpgate_bits);
 }
 
-void make_ref_dict(SeqVec ref, FILE *out)
+void make_ref_dict(SeqVec ref, FILE *out, const DictOptions *opts)
 {
 	const size_t ref_len = ref.size;
 
@@ -286,7 +448,7 @@ void make_ref_dict(SeqVec ref, FILE *out)
 	struct kmer_info *kmers = malloc(total_kmers * sizeof(*kmers));
 	assert(kmers);
 	size_t kmers_len = 0;
-	uint32_t index = 1;
+	pos_t index = 1;
 
 	for (size_t i = 0; i < ref_len; i++) {
 		const char *seq = ref.seqs[i].seq;
@@ -296,27 +458,21 @@ void make_ref_dict(SeqVec ref, FILE *out)
 
 	kmers = realloc(kmers, kmers_len * sizeof(*kmers));
 	sort_kmers(kmers, kmers_len);
-	write_kmers(kmers, kmers_len, out);
+	write_kmers(kmers, kmers_len, out, opts);
 	free(kmers);
 }
 
-static Seq *find_seq_by_name(SeqVec ref, const char *name, unsigned int *start_index)
+static Seq *find_seq_by_name(SeqVec ref, const ContigTable *contigs, const char *name, pos_t *start_index)
 {
-	unsigned int start_index_true = 1;
+	const size_t i = contig_table_find(contigs, name);
 
-	for (size_t i = 0; i < ref.size; i++) {
-		const char *seq_name = ref.seqs[i].name;
-
-		if (strcmp(name, seq_name) == 0) {
-			*start_index = start_index_true;
-			return &ref.seqs[i];
-		} else {
-			start_index_true += ref.seqs[i].size;
-		}
+	if (i == CONTIG_NONE) {
+		*start_index = 0;
+		return NULL;
 	}
 
-	*start_index = 0;
-	return NULL;
+	*start_index = contig_start(contigs, i);
+	return &ref.seqs[i];
 }
 
 static char rev(const char c) {
@@ -347,7 +503,7 @@ static char rev(const char c) {
  *
  * Be sure to filter any SNPs with abnormal conditions (e.g. inconsistent alleles).
  */
-void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations, size_t *snp_locs_size)
+void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations, size_t *snp_locs_size, const DictOptions *opts)
 {
 #define CHROM_FIELD   1
 #define INDEX_FIELD   2
@@ -382,7 +538,18 @@ void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations,
 	assert(kmers);
 	size_t kmers_len = 0;
 
-	unsigned int start_index = 1;  // 1-based
+	/* 4 halves of each SNP k-mer and of the reference k-mer it replaces */
+	uint32_t *seeds = malloc(max_kmers_len * 8 * sizeof(*seeds));
+	assert(seeds);
+	size_t seeds_len = 0;
+
+	pos_t start_index = 1;  // 1-based
+
+	ContigTable contigs;
+	contig_table_init(&contigs);
+	for (size_t i = 0; i < ref.size; i++) {
+		contig_table_add(&contigs, ref.seqs[i].name, ref.seqs[i].size);
+	}
 
 	while (fgets(line, sizeof(line), snp_file)) {
 		assert(!ferror(snp_file));
@@ -419,7 +586,7 @@ void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations,
 		}
 
 		if (chrom == NULL || strcmp(chrom->name, chrom_name) != 0) {
-			chrom = find_seq_by_name(ref, chrom_name, &start_index);
+			chrom = find_seq_by_name(ref, &contigs, chrom_name, &start_index);
 
 			if (chrom == NULL) {
 				continue;
@@ -496,6 +663,9 @@ void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations,
 			const char *seq = chrom->seq;
 			bool kmer_had_n;
 			kmer_t kmer = encode_kmer(&seq[index - 32], &kmer_had_n);
+			kmer_t ref_kmer = kmer;
+			uint32_t snp_seeds[32 * 8];
+			size_t snp_seeds_len = 0;
 
 			if (kmer_had_n)
 				goto end;
@@ -507,8 +677,11 @@ void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations,
 					goto end;
 
 				kmer = shift_kmer(kmer, next_base);
+				ref_kmer = shift_kmer(ref_kmer, i ? next_base : ref_base);
+				snp_seeds_len += add_kmer_seeds(&snp_seeds[snp_seeds_len], kmer);
+				snp_seeds_len += add_kmer_seeds(&snp_seeds[snp_seeds_len], ref_kmer);
 				snp_kmers[i].kmer = kmer;
-				snp_kmers[i].pos = start_index + index - 32 + 1 + i;
+				KMER_INFO_SET_POS(snp_kmers[i], start_index + index - 32 + 1 + i);
 				snp_kmers[i].snp = SNP_INFO_MAKE(32 - 1 - i, ref_base_u);
 				snp_kmers[i].ref_freq = freq1_enc;
 				snp_kmers[i].alt_freq = freq2_enc;
@@ -516,6 +689,8 @@ void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations,
 
 			memcpy(&kmers[kmers_len], snp_kmers, 32 * sizeof(*kmers));
 			kmers_len += 32;
+			memcpy(&seeds[seeds_len], snp_seeds, snp_seeds_len * sizeof(*seeds));
+			seeds_len += snp_seeds_len;
 
 			end:
 			break;
@@ -524,8 +699,10 @@ void make_snp_dict(SeqVec ref, FILE *snp_file, FILE *out, bool **snp_locations,
 
 	kmers = realloc(kmers, kmers_len * sizeof(*kmers));
 	sort_snp_kmers(kmers, kmers_len);
-	write_snp_kmers(kmers, kmers_len, out);
+	write_snp_kmers(kmers, kmers_len, seeds, seeds_len, out, opts);
 	free(kmers);
+	free(seeds);
+	contig_table_dealloc(&contigs);
 
 #undef CHROM_FIELD
 #undef INDEX_FIELD
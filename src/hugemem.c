@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include "hugemem.h"
+
+#define HUGEMEM_INIT_REGIONS 32
+#define HUGEMEM_HEAP_ALIGN   64  /* a cache line */
+
+#define SIZE_2M (1UL << 21)
+#define SIZE_1G (1UL << 30)
+
+#ifndef MAP_HUGE_SHIFT
+  #define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+  #define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+  #define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static const char *backing_names[BACKING_COUNT] = {
+	[BACKING_MALLOC]     = "malloc",
+	[BACKING_PAGES]      = "4K pages",
+	[BACKING_THP]        = "transparent huge pages (advised)",
+	[BACKING_HUGETLB_2M] = "2M huge pages",
+	[BACKING_HUGETLB_1G] = "1G huge pages",
+};
+
+static size_t round_up(const size_t x, const size_t align)
+{
+	return (x + align - 1) & ~(align - 1);
+}
+
+void hugemem_init(HugeMem *m, const MemOptions *opts)
+{
+	m->opts = *opts;
+	m->count = 0;
+	m->cap = HUGEMEM_INIT_REGIONS;
+	m->regions = malloc(m->cap * sizeof(*m->regions));
+	assert(m->regions);
+	m->lock_failed = false;
+}
+
+#ifdef MAP_HUGETLB
+static void *map_hugetlb(const size_t size, const size_t page, const int page_flag, size_t *map_size)
+{
+	*map_size = round_up(size, page);
+	void *p = mmap(NULL, *map_size, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_flag, -1, 0);
+	return (p == MAP_FAILED) ? NULL : p;
+}
+#endif
+
+/*
+ * Maps `size` bytes (rounded up to 2 MiB) at a 2 MiB boundary, so that
+ * the whole range can be backed by transparent huge pages.
+ */
+static void *map_aligned(const size_t size, size_t *map_size)
+{
+	*map_size = round_up(size, SIZE_2M);
+	const size_t over = *map_size + SIZE_2M;
+
+	uint8_t *p = mmap(NULL, over, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	uint8_t *aligned = (uint8_t *)round_up((uintptr_t)p, SIZE_2M);
+	const size_t head = aligned - p;
+	const size_t tail = over - head - *map_size;
+
+	if (head)
+		munmap(p, head);
+	if (tail)
+		munmap(aligned + *map_size, tail);
+
+	return aligned;
+}
+
+struct prefault_range {
+	volatile uint8_t *p;
+	size_t len;
+	size_t stride;
+};
+
+static void *prefault_range(void *arg)
+{
+	const struct prefault_range *r = arg;
+	for (size_t off = 0; off < r->len; off += r->stride) {
+		r->p[off] = 0;
+	}
+	return NULL;
+}
+
+/*
+ * Touches every page of `r` (splitting the work over `threads` threads),
+ * so that the page faults are taken now rather than during read processing.
+ */
+static void prefault(const struct mem_region *r, unsigned threads)
+{
+	const size_t stride = (r->backing == BACKING_HUGETLB_1G) ? SIZE_1G :
+	                      (r->backing == BACKING_HUGETLB_2M || r->backing == BACKING_THP) ? SIZE_2M :
+	                      (size_t)sysconf(_SC_PAGESIZE);
+	const size_t pages = r->map_size/stride;
+
+	if (threads > pages)
+		threads = pages;
+	if (threads == 0)
+		threads = 1;
+
+	pthread_t tids[threads];
+	struct prefault_range ranges[threads];
+
+	for (unsigned i = 0; i < threads; i++) {
+		const size_t first = (pages * i)/threads;
+		const size_t last = (pages * (i + 1))/threads;
+		ranges[i] = (struct prefault_range){.p = (uint8_t *)r->p + first*stride,
+		                                    .len = (last - first)*stride,
+		                                    .stride = stride};
+	}
+
+	for (unsigned i = 1; i < threads; i++) {
+		assert(pthread_create(&tids[i], NULL, prefault_range, &ranges[i]) == 0);
+	}
+	prefault_range(&ranges[0]);
+	for (unsigned i = 1; i < threads; i++) {
+		assert(pthread_join(tids[i], NULL) == 0);
+	}
+}
+
+static void add_region(HugeMem *m, const struct mem_region *r)
+{
+	if (m->count == m->cap) {
+		m->cap *= 2;
+		m->regions = realloc(m->regions, m->cap * sizeof(*m->regions));
+		assert(m->regions);
+	}
+
+	m->regions[m->count++] = *r;
+}
+
+static size_t find_region(const HugeMem *m, const void *p)
+{
+	for (size_t i = 0; i < m->count; i++) {
+		if (m->regions[i].p == p)
+			return i;
+	}
+
+	assert(0);
+	return 0;
+}
+
+static void release_region(const struct mem_region *r)
+{
+	if (r->backing == BACKING_MALLOC)
+		free(r->p);
+	else
+		assert(munmap(r->p, r->map_size) == 0);
+}
+
+static void *alloc_region(HugeMem *m, const size_t size, const char *name,
+                          const Topology *topo, const int node)
+{
+	struct mem_region r = {.p = NULL, .size = size, .map_size = 0, .name = name};
+
+	if (size < HUGEMEM_MIN_SIZE) {
+		assert(posix_memalign(&r.p, HUGEMEM_HEAP_ALIGN, size ? size : 1) == 0);
+		memset(r.p, 0, size);
+		r.backing = BACKING_MALLOC;
+		add_region(m, &r);
+		return r.p;
+	}
+
+#ifdef MAP_HUGETLB
+	if (m->opts.hugetlb) {
+		if (size >= SIZE_1G && (r.p = map_hugetlb(size, SIZE_1G, MAP_HUGE_1GB, &r.map_size)) != NULL)
+			r.backing = BACKING_HUGETLB_1G;
+		else if ((r.p = map_hugetlb(size, SIZE_2M, MAP_HUGE_2MB, &r.map_size)) != NULL)
+			r.backing = BACKING_HUGETLB_2M;
+	}
+#endif
+
+	if (r.p == NULL) {
+		r.p = map_aligned(size, &r.map_size);
+		assert(r.p);
+		r.backing = BACKING_PAGES;
+#ifdef MADV_HUGEPAGE
+		if (madvise(r.p, r.map_size, MADV_HUGEPAGE) == 0)
+			r.backing = BACKING_THP;
+#endif
+	}
+
+	/* the policy must be set before any page is touched */
+	if (node >= 0)
+		numa_bind(topo, r.p, r.map_size, node);
+	else if (m->opts.interleave != NULL)
+		numa_interleave(m->opts.interleave, r.p, r.map_size);
+
+	if (m->opts.prefault)
+		prefault(&r, m->opts.threads);
+
+	if (m->opts.lock && mlock(r.p, r.map_size) != 0 && !m->lock_failed) {
+		fprintf(stderr, "Warning: could not lock memory (%s); continuing unlocked\n", strerror(errno));
+		m->lock_failed = true;
+	}
+
+	add_region(m, &r);
+	return r.p;
+}
+
+void *hugemem_alloc(HugeMem *m, const size_t size, const char *name)
+{
+	return alloc_region(m, size, name, NULL, -1);
+}
+
+void *hugemem_alloc_node(HugeMem *m, const size_t size, const char *name,
+                         const Topology *topo, const unsigned node)
+{
+	return alloc_region(m, size, name, topo, (int)node);
+}
+
+void *hugemem_realloc(HugeMem *m, void *p, const size_t size)
+{
+	const size_t i = find_region(m, p);
+	const struct mem_region old = m->regions[i];
+
+	if (size <= old.size)
+		return p;
+
+	void *q = hugemem_alloc(m, size, old.name);
+	memcpy(q, p, old.size);
+	hugemem_free(m, p);
+	return q;
+}
+
+void hugemem_free(HugeMem *m, void *p)
+{
+	if (p == NULL)
+		return;
+
+	const size_t i = find_region(m, p);
+	release_region(&m->regions[i]);
+	m->regions[i] = m->regions[--m->count];
+}
+
+void hugemem_dealloc(HugeMem *m)
+{
+	for (size_t i = 0; i < m->count; i++) {
+		release_region(&m->regions[i]);
+	}
+
+	free(m->regions);
+	m->regions = NULL;
+	m->count = 0;
+	m->cap = 0;
+}
+
+size_t hugemem_total(const HugeMem *m)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < m->count; i++) {
+		total += m->regions[i].size;
+	}
+	return total;
+}
+
+void hugemem_report(const HugeMem *m, FILE *out)
+{
+	size_t totals[BACKING_COUNT] = {0};
+
+	for (size_t i = 0; i < m->count; i++) {
+		const struct mem_region *r = &m->regions[i];
+		totals[r->backing] += r->map_size ? r->map_size : r->size;
+	}
+
+	fprintf(out, "Memory backing:");
+	bool first = true;
+	for (int b = BACKING_COUNT - 1; b >= 0; b--) {
+		if (totals[b] == 0)
+			continue;
+		fprintf(out, "%s %.2f GiB on %s", first ? "" : ",", totals[b]/(double)SIZE_1G, backing_names[b]);
+		first = false;
+	}
+	fprintf(out, "%s%s%s\n",
+	        first ? " none" : "",
+	        m->opts.prefault ? " (prefaulted)" : "",
+	        (m->opts.lock && !m->lock_failed) ? " (locked)" : "");
+}
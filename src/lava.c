@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -5,17 +6,21 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
-#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <assert.h>
-#include "fasta_parser.h"
-#include "dictgen.h"
-#include "dict_filt.h"
 #include "util.h"
 #include "lava.h"
+#include "calling.h"
+#include "writer.h"
+#include "contigs.h"
+#include "hugemem.h"
+#include "topology.h"
+#include "segment.h"
+#include "perf.h"
+#include "liblava.h"
 
-#if PCOMPACT
-  #include "pileup.h"
-#endif
+#include "pileup.h"
 
 /*
  * We use the following structures for quickly finding the index that
@@ -24,10 +29,10 @@
  */
 
 #define INDEX_TABLE_SLOT_COUNT  1009
-#define INDEX_TABLE_ENTRY_DEPTH  500  /* enough for 5 k-mers */
+#define INDEX_TABLE_ENTRY_DEPTH  500  /* positions per slot, see `index_table_add` */
 
 typedef struct {
-	uint32_t index;
+	pos_t index;
 	uint8_t freq;
 } IndexTableEntry;
 
@@ -42,11 +47,11 @@ typedef struct {
 	IndexTableSlot table[INDEX_TABLE_SLOT_COUNT];
 } IndexTable;
 
-void index_table_clear_index(IndexTable *index_table, uint32_t index);
+void index_table_clear_index(IndexTable *index_table, pos_t index);
 void index_table_clear(IndexTable *index_table);
-void index_table_add(IndexTable *index_table, uint32_t index);
+void index_table_add(IndexTable *index_table, pos_t index);
 
-void index_table_clear_index(IndexTable *index_table, uint32_t index)
+void index_table_clear_index(IndexTable *index_table, pos_t index)
 {
 	index_table->table[index % INDEX_TABLE_SLOT_COUNT].count = 0;
 }
@@ -61,7 +66,7 @@ void index_table_clear(IndexTable *index_table)
 	}
 }
 
-void index_table_add(IndexTable *index_table, uint32_t index)
+void index_table_add(IndexTable *index_table, pos_t index)
 {
 	size_t slot_index = index % INDEX_TABLE_SLOT_COUNT;
 	IndexTableSlot *slot = &index_table->table[slot_index];
@@ -77,9 +82,10 @@ void index_table_add(IndexTable *index_table, uint32_t index)
 	}
 
 	if (target == NULL) {
-#if DEBUG
-		assert(slot->count < INDEX_TABLE_ENTRY_DEPTH);
-#endif
+		/* so that k-mers with huge aux rows can't overrun a slot; later positions aren't counted */
+		if (slot->count == INDEX_TABLE_ENTRY_DEPTH)
+			return;
+
 		slot->entries[slot->count] = (IndexTableEntry){.index = index, .freq = 1};
 		target = &slot->entries[slot->count];
 		++slot->count;
@@ -100,1224 +106,3029 @@ void index_table_add(IndexTable *index_table, uint32_t index)
 
 /* --- */
 
-#define PILEUP_TABLE_INIT_SIZE (1 << 25)
 
-static struct kmer_entry *query_ref_dict(kmer_t key,
-                                         uint32_t *ref_jumpgate,
-                                         struct kmer_entry *ref_dict,
-                                         const size_t ref_dict_size);
+/*
+ * Dictionary search
+ *
+ * Dictionaries are kept as a structure of arrays (see `struct ref_dict`
+ * and `struct snp_dict`), so a search only ever touches the aligned key
+ * arrays. Keys are sorted within each jumpgate bucket; we narrow large
+ * buckets with an interpolation step (the keys within a bucket are close
+ * to uniformly distributed) and finish with a branchless binary search
+ * that prefetches both possible next probes. Since most probes miss, the
+ * payload arrays are only read by the caller once a key has been found.
+ */
+
+#define INTERP_MIN_BUCKET 64  /* smallest bucket worth an interpolation step */
+#define INTERP_WINDOW     32  /* half-width of the interpolated window */
+
+/*
+ * How keys are laid out depends on each dictionary's jumpgate width (see
+ * `struct ref_dict`). The search functions below take the width of the
+ * `keys_hi` elements (`hi_bytes`) as an argument and are forced inline,
+ * and `DICT_DISPATCH` calls them with a constant `hi_bytes`, so each key
+ * layout gets its own specialized search loop.
+ */
+#define ALWAYS_INLINE inline __attribute__((always_inline))
 
-static struct snp_kmer_entry *query_snp_dict(kmer_t key,
-                                             uint32_t *snp_jumpgate,
-                                             struct snp_kmer_entry *snp_dict,
-                                             const size_t snp_dict_size);
+#define DICT_DISPATCH(f, k, hi_bytes, ...) \
+	((hi_bytes) == 0 ? f(k, 0, __VA_ARGS__) : \
+	 (hi_bytes) == 1 ? f(k, 1, __VA_ARGS__) : \
+	 (hi_bytes) == 2 ? f(k, 2, __VA_ARGS__) : \
+	                   f(k, KEYS_PACKED, __VA_ARGS__))
 
-static int ref_dict_entry_cmp(const void *key, const void *entry)
+/*
+ * Packed arrays hold `bits`-bit elements back to back, element `i` being
+ * bits [`i*bits`, `(i + 1)*bits`) of the array. Elements are read with a
+ * single unaligned 64-bit load, so they are at most 57 bits wide and the
+ * arrays end with a spare word.
+ */
+static inline size_t packed_bytes(const size_t n, const unsigned bits)
 {
-#if REF_LITE
-	const uint64_t kmer_lo = *(uint64_t *)key;
-	const uint64_t entry_lo = ((struct kmer_entry *)entry)->kmer_lo40;
-#else
-	const uint32_t kmer_lo = *(uint32_t *)key;
-	const uint32_t entry_lo = ((struct kmer_entry *)entry)->kmer_lo;
-#endif
-	return (kmer_lo > entry_lo) - (kmer_lo < entry_lo);
+	return (n*bits + 7)/8 + sizeof(uint64_t);
 }
 
-static struct kmer_entry *query_ref_dict(kmer_t key,
-                                         uint32_t *ref_jumpgate,
-                                         struct kmer_entry *ref_dict,
-                                         const size_t ref_dict_size)
+static ALWAYS_INLINE uint64_t packed_get(const uint8_t *packed, const unsigned bits, const size_t i)
 {
-#if REF_LITE
-	const uint32_t kmer_hi = HI24(key);
-	const uint64_t kmer_lo = LO40(key);
-#else
-	const uint32_t kmer_hi = HI(key);
-	const uint32_t kmer_lo = LO(key);
-#endif
+	const size_t bit = i*bits;
+	uint64_t word;
+	memcpy(&word, packed + bit/8, sizeof(word));
+	return (word >> (bit % 8)) & ((1UL << bits) - 1);
+}
+
+static inline void packed_set(uint8_t *packed, const unsigned bits, const size_t i, const uint64_t value)
+{
+	const size_t bit = i*bits;
+	const uint64_t mask = ((1UL << bits) - 1) << (bit % 8);
+	uint64_t word;
+	memcpy(&word, packed + bit/8, sizeof(word));
+	word = (word & ~mask) | ((value << (bit % 8)) & mask);
+	memcpy(packed + bit/8, &word, sizeof(word));
+}
 
-	const uint32_t lo = ref_jumpgate[kmer_hi];
+/* the sorted keys of a dictionary (or of a `struct half_index`) */
+struct dict_keys {
+	const uint32_t *lo;
+	const void *hi;
+	const uint8_t *packed;  /* instead of `lo` and `hi` with `KEYS_PACKED` */
+	unsigned bits;  /* key width: 64 minus the jumpgate width */
+};
 
-	if (lo == ref_dict_size) {
-		return NULL;
-	}
+static inline unsigned key_hi_bytes_for(const unsigned jumpgate_bits)
+{
+	return (jumpgate_bits == 32) ? 0 : ((jumpgate_bits >= 24) ? 1 : 2);
+}
 
-#if REF_LITE
-	const uint32_t hi = (kmer_hi == 0xFFFFFF ? ref_dict_size : ref_jumpgate[kmer_hi + 1]);
-#else
-	const uint32_t hi = (kmer_hi == 0xFFFFFFFF ? ref_dict_size : ref_jumpgate[kmer_hi + 1]);
-#endif
+/* the low `bits` bits of `kmer`, i.e. its key in a dictionary with keys that wide */
+static inline uint64_t dict_lo_key(const kmer_t kmer, const unsigned bits)
+{
+	return kmer & ((1UL << bits) - 1);
+}
 
-	if (lo == hi) {
-		return NULL;
-	}
+static inline void dict_set_key_hi(void *keys_hi, const unsigned hi_bytes, const size_t i, const uint64_t key)
+{
+	if (hi_bytes == 1)
+		((uint8_t *)keys_hi)[i] = key >> 32;
+	else if (hi_bytes == 2)
+		((uint16_t *)keys_hi)[i] = key >> 32;
+}
 
-#if DEBUG
-	assert(hi > lo);
-#endif
-	struct kmer_entry *target = bsearch(&kmer_lo, &ref_dict[lo], (hi - lo), sizeof(*ref_dict), ref_dict_entry_cmp);
-	return target;
+static ALWAYS_INLINE uint64_t dict_key(const struct dict_keys *k, const unsigned hi_bytes, const size_t i)
+{
+	switch (hi_bytes) {
+	case 0:
+		return k->lo[i];
+	case 1:
+		return ((uint64_t)((const uint8_t *)k->hi)[i] << 32) | k->lo[i];
+	case KEYS_PACKED:
+		return packed_get(k->packed, k->bits, i);
+	default:
+		return ((uint64_t)((const uint16_t *)k->hi)[i] << 32) | k->lo[i];
+	}
 }
 
-static int snp_dict_entry_cmp(const void *key, const void *entry)
+/* the low 32 bits of key `i`, for any layout */
+static inline uint32_t dict_key_lo(const struct dict_keys *k, const size_t i)
 {
-	const uint64_t kmer_lo = *(uint64_t *)key;
-	const uint64_t entry_lo = ((struct snp_kmer_entry *)entry)->kmer_lo40;
-	return (kmer_lo > entry_lo) - (kmer_lo < entry_lo);
+	return k->packed ? (uint32_t)packed_get(k->packed, k->bits, i) : k->lo[i];
 }
 
-static struct snp_kmer_entry *query_snp_dict(kmer_t key,
-                                             uint32_t *snp_jumpgate,
-                                             struct snp_kmer_entry *snp_dict,
-                                             const size_t snp_dict_size)
+static ALWAYS_INLINE void dict_key_prefetch(const struct dict_keys *k, const unsigned hi_bytes, const size_t i)
 {
-	const uint32_t kmer_hi = HI24(key);
-	const uint64_t kmer_lo = LO40(key);
+	if (hi_bytes == KEYS_PACKED) {
+		__builtin_prefetch(k->packed + i*k->bits/8);
+		return;
+	}
 
-	const uint32_t lo = snp_jumpgate[kmer_hi];
+	__builtin_prefetch(&k->lo[i]);
+	if (hi_bytes)
+		__builtin_prefetch((const uint8_t *)k->hi + hi_bytes*i);
+}
+
+/*
+ * Returns the first index in [`lo`, `hi`) whose key is >= `key`, or `hi`
+ * if there is none.
+ */
+static ALWAYS_INLINE size_t dict_lower_bound(const struct dict_keys *k,
+                                             const unsigned hi_bytes,
+                                             size_t lo,
+                                             size_t hi,
+                                             const uint64_t key)
+{
+	size_t n = hi - lo;
+
+	if (n >= INTERP_MIN_BUCKET) {
+		const size_t guess = lo + (size_t)(((double)key / (double)(1UL << k->bits)) * n);
+		const size_t w_lo = (guess > lo + INTERP_WINDOW) ? guess - INTERP_WINDOW : lo;
+		const size_t w_hi = (guess + INTERP_WINDOW < hi) ? guess + INTERP_WINDOW : hi;
+
+		/* the answer lies in [`w_lo`, `w_hi`] iff the window brackets `key` */
+		if ((w_lo == lo || dict_key(k, hi_bytes, w_lo - 1) < key) &&
+		    (w_hi == hi || dict_key(k, hi_bytes, w_hi) >= key)) {
+			lo = w_lo;
+			n = w_hi - w_lo;
+		}
+	}
 
-	if (lo == snp_dict_size) {
-		return NULL;
+	if (n == 0)
+		return lo;
+
+	size_t base = lo;
+	while (n > 1) {
+		const size_t half = n/2;
+		const size_t next_half = (n - half)/2;
+		dict_key_prefetch(k, hi_bytes, base + next_half);
+		dict_key_prefetch(k, hi_bytes, base + half + next_half);
+		base = (dict_key(k, hi_bytes, base + half) < key) ? base + half : base;
+		n -= half;
 	}
 
-	const uint32_t hi = (kmer_hi == 0xFFFFFF ? snp_dict_size : snp_jumpgate[kmer_hi + 1]);
+	return base + (dict_key(k, hi_bytes, base) < key);
+}
 
-	if (lo == hi) {
-		return NULL;
+/*
+ * Same as `dict_lower_bound`, but gallops forward from `cur` first. This
+ * is cheap when successive keys are close together, as in a merge.
+ */
+static ALWAYS_INLINE size_t dict_gallop_lower_bound(const struct dict_keys *k,
+                                                    const unsigned hi_bytes,
+                                                    const size_t cur,
+                                                    const size_t end,
+                                                    const uint64_t key)
+{
+	size_t lo = cur;
+	size_t hi = cur;
+	size_t step = 1;
+
+	while (hi < end && dict_key(k, hi_bytes, hi) < key) {
+		lo = hi + 1;
+		hi += step;
+		step <<= 1;
 	}
 
-#if DEBUG
-	assert(hi > lo);
-#endif
-	struct snp_kmer_entry *target = bsearch(&kmer_lo, &snp_dict[lo], (hi - lo), sizeof(*snp_dict), snp_dict_entry_cmp);
-	return target;
+	if (hi > end)
+		hi = end;
+
+	return dict_lower_bound(k, hi_bytes, lo, hi, key);
 }
 
-/* --- */
+/*
+ * Returns the index of the entry of [`lo`, `hi`) with the key of `kmer`,
+ * or `DICT_MISS`.
+ */
+static ALWAYS_INLINE size_t dict_find(const struct dict_keys *k,
+                                      const unsigned hi_bytes,
+                                      const size_t lo,
+                                      const size_t hi,
+                                      const kmer_t kmer)
+{
+	const uint64_t key = dict_lo_key(kmer, k->bits);
+	const size_t i = dict_lower_bound(k, hi_bytes, lo, hi, key);
+	return (i < hi && dict_key(k, hi_bytes, i) == key) ? i : DICT_MISS;
+}
 
-struct call { int genotype; double confidence; };
-#define CALL(g, c) ((struct call){.genotype = (g), .confidence = (c)})
-static inline struct call choose_best_genotype(const int ref_cnt,
-                                               const int alt_cnt,
-                                               const uint8_t ref_freq_enc,
-                                               const uint8_t alt_freq_enc);
+/*
+ * Start index of jumpgate bucket `b`, see `struct ref_dict`. Dictionaries
+ * with fewer than 2^32 entries have no wraps.
+ */
+static inline size_t jumpgate_get(const uint32_t *jumpgate, const size_t *wraps, const unsigned n_wraps, const size_t b)
+{
+	size_t high = 0;
+	while (high < n_wraps && wraps[high] <= b)
+		++high;
+	return (high << 32) | jumpgate[b];
+}
 
-static void genotype(FILE *refdict_file, FILE *snpdict_file, FILE *fastq_file, FILE *chrlens_file, FILE *out)
+static inline void jumpgate_set(uint32_t *jumpgate, size_t *wraps, unsigned *n_wraps, const size_t b, const size_t start)
 {
-	clock_t begin, end;
-	double time_spent;
-	begin = clock();
+	jumpgate[b] = (uint32_t)start;
 
-	/* Load chrlens file */
-	struct { char name[32]; size_t len; } chrlens[128];
-	size_t num_chrs = 0;
-
-	char chrlen_buf[256];
-	while (fgets(chrlen_buf, sizeof(chrlen_buf), chrlens_file)) {
-		size_t i = 0;
-		while (!isspace(chrlen_buf[i]) && i < sizeof(chrlens[0].name)) {
-			chrlens[num_chrs].name[i] = chrlen_buf[i];
-			++i;
+	while ((start >> 32) > *n_wraps) {
+		if (*n_wraps == JUMPGATE_MAX_WRAPS) {
+			fprintf(stderr, "Dictionary is too large (limit: %lu 32-mers)\n", (size_t)JUMPGATE_MAX_WRAPS << 32);
+			exit(EXIT_FAILURE);
 		}
-		chrlens[num_chrs].name[i] = '\0';
+		wraps[(*n_wraps)++] = b;
+	}
+}
 
-		while (isspace(chrlen_buf[i])) ++i;
+/*
+ * Stores in `lo` and `hi` the bounds of the ref_dict bucket that `key`
+ * falls in, and returns whether that bucket is non-empty.
+ */
+static inline bool ref_dict_bucket(const struct ref_dict *ref_dict, const kmer_t key, size_t *lo, size_t *hi)
+{
+	const size_t b = key >> (64 - ref_dict->jumpgate_bits);
 
-		chrlens[num_chrs].len = atol(&chrlen_buf[i]);
+	*lo = jumpgate_get(ref_dict->jumpgate, ref_dict->jumpgate_wraps, ref_dict->n_jumpgate_wraps, b);
 
-		++num_chrs;
+	if (*lo == ref_dict->size) {
+		return false;
 	}
 
-	uint32_t *ref_jumpgate;
-	struct kmer_entry *ref_dict;
-	struct aux_table *ref_aux_table;
-	uint32_t *snp_jumpgate;
-	struct snp_kmer_entry *snp_dict;
-	struct snp_aux_table *snp_aux_table;
+	*hi = jumpgate_get(ref_dict->jumpgate, ref_dict->jumpgate_wraps, ref_dict->n_jumpgate_wraps, b + 1);
 
-#if PCOMPACT
-	PileupTable ptable;
-#else
-	struct pileup_entry *pileup_table;
+#if DEBUG
+	assert(*hi >= *lo);
 #endif
+	return *lo != *hi;
+}
 
-	uint32_t last_hi;
-	uint32_t max_pos = 0;
+static inline struct dict_keys ref_dict_keys(const struct ref_dict *ref_dict)
+{
+	return (struct dict_keys){.lo = ref_dict->keys,
+	                          .hi = ref_dict->keys_hi,
+	                          .packed = ref_dict->packed_keys,
+	                          .bits = 64 - ref_dict->jumpgate_bits};
+}
 
-	fprintf(stderr, "Initializing...\n");
+/*
+ * Position (or aux table index) of dictionary entry `i`.
+ */
+static inline pos_t dict_pos(const uint32_t *pos, const uint8_t *pos_hi, const size_t i)
+{
+	if (pos_hi == NULL)
+		return (pos[i] == (uint32_t)POS_AMBIGUOUS) ? POS_AMBIGUOUS : pos[i];
 
-	/* === Reference Dictionary Construction === */
-	const size_t ref_dict_size = read_uint64(refdict_file);
-	const size_t ref_aux_table_size = read_uint64(refdict_file);
+	return ((pos_t)pos_hi[i] << 32) | pos[i];
+}
 
-	if (ref_dict_size > POW_2_32) {
-		fprintf(stderr, "Reference dictionary is too large (limit: %lu 32-mers)\n", POW_2_32);
-		exit(EXIT_FAILURE);
+/*
+ * Position of `ref_dict` entry `i`, or `POS_AMBIGUOUS`, or, if `*in_aux`
+ * is set, its aux table row. Packed dictionaries hold all three in a
+ * single value, see `struct ref_dict`.
+ */
+static inline pos_t ref_dict_entry(const struct ref_dict *ref_dict, const size_t i, bool *in_aux)
+{
+	if (ref_dict->key_hi_bytes != KEYS_PACKED) {
+		*in_aux = (ref_dict->ambig_flags[i] == FLAG_AMBIGUOUS);
+		return dict_pos(ref_dict->pos, ref_dict->pos_hi, i);
 	}
 
-#if REF_LITE
-	ref_jumpgate = malloc(POW_2_24 * sizeof(*ref_jumpgate));
-#else
-	ref_jumpgate = malloc(POW_2_32 * sizeof(*ref_jumpgate));
-#endif
-	assert(ref_jumpgate);
-	ref_dict = malloc(ref_dict_size * sizeof(*ref_dict));
-	assert(ref_dict);
-	ref_aux_table = malloc(ref_aux_table_size * sizeof(*ref_aux_table));
-	assert(ref_aux_table);
+	const pos_t value = packed_get(ref_dict->packed_values, ref_dict->value_bits, i);
+	*in_aux = (value > ref_dict->ambig_base);
+	if (value == (1UL << ref_dict->value_bits) - 1)
+		return POS_AMBIGUOUS;
 
-	ref_jumpgate[0] = 0;
-	last_hi = 0;
-	for (size_t i = 0; i < ref_dict_size; i++) {
-		const kmer_t kmer = read_uint64(refdict_file);
-		const uint32_t pos = read_uint32(refdict_file);
-		const uint8_t ambig_flag = read_uint8(refdict_file);
+	return *in_aux ? value - ref_dict->ambig_base - 1 : value;
+}
 
-#if REF_LITE
-		ref_dict[i].kmer_lo40 = LO40(kmer);
-#else
-		ref_dict[i].kmer_lo = LO(kmer);
-#endif
-		ref_dict[i].pos = pos;
-		ref_dict[i].ambig_flag = ambig_flag;
+static inline pos_t snp_dict_pos(const struct snp_dict *snp_dict, const size_t i)
+{
+	return dict_pos(snp_dict->pos, snp_dict->pos_hi, i);
+}
 
-		if (pos > max_pos)
-			max_pos = pos;
+/* row `row` of `aux` is positions `aux_offset(aux, row)` to `aux_offset(aux, row + 1) - 1` */
+static inline size_t aux_offset(const struct aux_table *aux, const size_t row)
+{
+	if (aux->offsets_hi == NULL)
+		return aux->offsets[row];
 
-#if REF_LITE
-		const uint32_t hi = HI24(kmer);
-#else
-		const uint32_t hi = HI(kmer);
-#endif
+	return ((size_t)aux->offsets_hi[row] << 32) | aux->offsets[row];
+}
 
-		if (hi != last_hi) {
-#if DEBUG
-			assert(hi > last_hi);
-#endif
-			for (size_t j = (last_hi + 1); j <= hi; j++)
-				ref_jumpgate[j] = i;
+static inline pos_t aux_pos(const struct aux_table *aux, const size_t k)
+{
+	return dict_pos(aux->pos, aux->pos_hi, k);
+}
 
-			last_hi = hi;
-		}
-	}
+/*
+ * Returns the index of `key` in `ref_dict`, or `DICT_MISS`.
+ */
+static inline size_t query_ref_dict(const kmer_t key, const struct ref_dict *ref_dict)
+{
+	size_t lo, hi;
 
-#if REF_LITE
-	if (last_hi != 0xFFFFFF) {
-		for (size_t j = (last_hi + 1); j < POW_2_24; j++)
-			ref_jumpgate[j] = ref_dict_size;
-	}
-#else
-	if (last_hi != 0xFFFFFFFF) {
-		for (size_t j = (last_hi + 1); j < POW_2_32; j++)
-			ref_jumpgate[j] = ref_dict_size;
+	if (!ref_dict_bucket(ref_dict, key, &lo, &hi)) {
+		return DICT_MISS;
 	}
-#endif
 
-	for (size_t i = 0; i < ref_aux_table_size; i++) {
-		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
-			ref_aux_table[i].pos_list[j] = read_uint32(refdict_file);
-		}
-	}
+	const struct dict_keys k = ref_dict_keys(ref_dict);
+	return DICT_DISPATCH(dict_find, &k, ref_dict->key_hi_bytes, lo, hi, key);
+}
 
-	/* === Pileup Table Initialization === */
-#if PCOMPACT
-	ptable_init(&ptable, PILEUP_TABLE_INIT_SIZE);
-#else
-	/*
-	 * We assume that the maximum position encountered in the
-	 * reference dictionary will not be smaller than the
-	 * maximum position that will be encountered in the SNP
-	 * dictionary. If not, we will reallocate our pileup table.
-	 */
-	size_t pileup_size = (size_t)max_pos + 32 + 1;
-	pileup_table = calloc(pileup_size, sizeof(*pileup_table));
-#endif
+/*
+ * Same as `ref_dict_bucket` but for `snp_dict`.
+ */
+static inline bool snp_dict_bucket(const struct snp_dict *snp_dict, const kmer_t key, size_t *lo, size_t *hi)
+{
+	const size_t b = key >> (64 - snp_dict->jumpgate_bits);
 
-	/* === SNP Dictionary Construction === */
-	const size_t snp_dict_size = read_uint64(snpdict_file);
-	const size_t snp_aux_table_size = read_uint64(snpdict_file);
+	*lo = jumpgate_get(snp_dict->jumpgate, snp_dict->jumpgate_wraps, snp_dict->n_jumpgate_wraps, b);
 
-	if (snp_dict_size > POW_2_32) {
-		fprintf(stderr, "SNP dictionary is too large (limit: %lu 32-mers)\n", POW_2_32);
-		exit(EXIT_FAILURE);
+	if (*lo == snp_dict->size) {
+		return false;
 	}
 
-	snp_jumpgate = malloc(POW_2_24 * sizeof(*snp_jumpgate));
-	assert(snp_jumpgate);
-	snp_dict = malloc(snp_dict_size * sizeof(*snp_dict));
-	assert(snp_dict);
-	snp_aux_table = malloc(snp_aux_table_size * sizeof(*snp_aux_table));
-	assert(snp_aux_table);
+	*hi = jumpgate_get(snp_dict->jumpgate, snp_dict->jumpgate_wraps, snp_dict->n_jumpgate_wraps, b + 1);
 
-	snp_jumpgate[0] = 0;
-	last_hi = 0;
-	for (size_t i = 0; i < snp_dict_size; i++) {
-		const kmer_t kmer = read_uint64(snpdict_file);
-		const uint32_t pos = read_uint32(snpdict_file);
-		const snp_info snp = read_uint8(snpdict_file);
-		const uint8_t ambig_flag = read_uint8(snpdict_file);
-		const uint8_t ref_freq = read_uint8(snpdict_file);
-		const uint8_t alt_freq = read_uint8(snpdict_file);
+#if DEBUG
+	assert(*hi >= *lo);
+#endif
+	return *lo != *hi;
+}
 
-		snp_dict[i].kmer_lo40 = LO40(kmer);
-		snp_dict[i].pos = pos;
-		snp_dict[i].snp = snp;
-		snp_dict[i].ambig_flag = ambig_flag;
+static inline struct dict_keys snp_dict_keys(const struct snp_dict *snp_dict)
+{
+	return (struct dict_keys){.lo = snp_dict->keys, .hi = snp_dict->keys_hi, .bits = 64 - snp_dict->jumpgate_bits};
+}
 
-		const unsigned snp_info_ref = SNP_INFO_REF(snp);
+/*
+ * Returns the index of `key` in `snp_dict`, or `DICT_MISS`.
+ */
+static inline size_t query_snp_dict(const kmer_t key, const struct snp_dict *snp_dict)
+{
+	size_t lo, hi;
 
-		if ((snp_info_ref & BASE_N) == 0 &&  // i.e. if the reference base is A, C, G or T
-		     pos != POS_AMBIGUOUS &&
-		     ambig_flag == FLAG_UNAMBIGUOUS) {
+	if (!snp_dict_bucket(snp_dict, key, &lo, &hi)) {
+		return DICT_MISS;
+	}
 
-			const unsigned snp_info_pos = SNP_INFO_POS(snp);  // relative to k-mer
-			const uint32_t snp_pos = pos + snp_info_pos;      // relative to reference
+	const struct dict_keys k = snp_dict_keys(snp_dict);
+	return DICT_DISPATCH(dict_find, &k, snp_dict->key_hi_bytes, lo, hi, key);
+}
 
-#if PCOMPACT
-			ptable_add(&ptable, snp_pos, snp_info_ref, kmer_get_base(kmer, snp_info_pos), ref_freq, alt_freq);
-#else
-			if (snp_pos >= pileup_size) {
-				pileup_size = (snp_pos + 1) * sizeof(*pileup_table);
-				printf("Re-allocing pileup table to %lu entries...\n", pileup_size);
-				pileup_table = realloc(pileup_table, pileup_size);
-				assert(pileup_table);
-			}
-			pileup_table[snp_pos].ref = snp_info_ref;
-			pileup_table[snp_pos].alt = kmer_get_base(kmer, snp_info_pos);
-			pileup_table[snp_pos].ref_freq = ref_freq;
-			pileup_table[snp_pos].alt_freq = alt_freq;
-#endif
-		}
+/*
+ * Grouped neighbor search
+ *
+ * A k-mer and all of its hamming neighbors that differ only in the low
+ * bases (i.e. the bases that make up its dictionary key) fall in the same
+ * jumpgate bucket. Rather than re-reading the jumpgate and re-running a
+ * full binary search for each of them, we load the bucket bounds once,
+ * walk the group's low keys in ascending order and resolve them all with
+ * a single galloping merge over the bucket.
+ */
 
-		const uint32_t hi = HI24(kmer);
+#define NEIGHBOR_COUNT 96  /* 32 positions, 3 substitutions each */
+#define MAX_LO_BASES   ((64 - JUMPGATE_MIN_BITS)/2)
 
-		if (hi != last_hi) {
-#if DEBUG
-			assert(hi > last_hi);
-#endif
-			for (size_t j = (last_hi + 1); j <= hi; j++)
-				snp_jumpgate[j] = i;
+/* number of bases wholly within keys of `bits` bits */
+static inline unsigned dict_lo_bases(const unsigned bits)
+{
+	return bits/2;
+}
 
-			last_hi = hi;
-		}
+/*
+ * Writes to `order` the indices of `keys[0..1 + 3*lo_bases)` (as produced
+ * by `kmer_neighbors`) in ascending key order. No sort is needed: a
+ * neighbor that substitutes base `b` at position `p` for `j` differs from
+ * the k-mer by `(j - b)*4^p`, and since `3*4^p < 4^(p+1)` the neighbors
+ * below the k-mer are ordered by descending `p` and those above it by
+ * ascending `p`.
+ */
+static inline void group_order(const kmer_t kmer, const unsigned lo_bases, unsigned *order)
+{
+	size_t n = 0;
+
+	for (unsigned p = lo_bases; p-- > 0;) {
+		const unsigned base = kmer_get_base(kmer, p);
+		for (unsigned j = 0; j < base; j++)
+			order[n++] = 1 + 3*p + j;
 	}
 
-	if (last_hi != 0xFFFFFF) {
-		for (size_t j = (last_hi + 1); j < POW_2_24; j++)
-			snp_jumpgate[j] = snp_dict_size;
+	order[n++] = 0;
+
+	for (unsigned p = 0; p < lo_bases; p++) {
+		const unsigned base = kmer_get_base(kmer, p);
+		for (unsigned j = base + 1; j < 4; j++)
+			order[n++] = 1 + 3*p + (j - 1);
 	}
+}
 
-	for (size_t i = 0; i < snp_aux_table_size; i++) {
-		const kmer_t kmer = read_uint64(snpdict_file);
-		UNUSED(kmer);
-
-		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
-			const uint32_t pos = read_uint32(snpdict_file);
-			const snp_info snp = read_uint8(snpdict_file);
-			const uint8_t ref_freq = read_uint8(snpdict_file);
-			const uint8_t alt_freq = read_uint8(snpdict_file);
-			UNUSED(ref_freq);
-			UNUSED(alt_freq);
-
-			snp_aux_table[i].pos_list[j] = pos;
-			snp_aux_table[i].snp_list[j] = snp;
-
-			/*
-			if (pos != 0) {
-				const unsigned snp_info_ref = SNP_INFO_REF(snp);
-				const unsigned snp_info_pos = SNP_INFO_POS(snp);  // relative to k-mer
-				const size_t snp_pos = pos + snp_info_pos;        // relative to reference
-
-				if (snp_pos >= pileup_size) {
-					pileup_size = (snp_pos + 1) * sizeof(*pileup_table);
-					printf("Re-allocing pileup table to %lu entries...\n", pileup_size);
-					pileup_table = realloc(pileup_table, pileup_size);
-					assert(pileup_table);
-				}
+/*
+ * Merges the keys `keys[order[0..n)]` (ascending) into the bucket [`lo`,
+ * `hi`) of a dictionary, storing the index of `keys[i]` (or `DICT_MISS`)
+ * in `hits[i]`.
+ */
+static ALWAYS_INLINE void dict_group_merge(const struct dict_keys *k,
+                                           const unsigned hi_bytes,
+                                           const size_t lo,
+                                           const size_t hi,
+                                           const kmer_t *keys,
+                                           const unsigned *order,
+                                           const size_t n,
+                                           size_t *hits)
+{
+	size_t cur = lo;
+	for (size_t i = 0; i < n && cur < hi; i++) {
+		const uint64_t key = dict_lo_key(keys[order[i]], k->bits);
+		cur = dict_gallop_lower_bound(k, hi_bytes, cur, hi, key);
 
-				pileup_table[snp_pos].ref = snp_info_ref;
-				pileup_table[snp_pos].alt = kmer_get_base(kmer, snp_info_pos);
-				pileup_table[snp_pos].ref_freq = ref_freq;
-				pileup_table[snp_pos].alt_freq = alt_freq;
-			}
-			*/
+		if (cur < hi && dict_key(k, hi_bytes, cur) == key) {
+			hits[order[i]] = cur;
 		}
 	}
+}
 
+/*
+ * Looks up the first `1 + 3*dict_lo_bases(...)` keys produced by
+ * `kmer_neighbors` in `ref_dict`, storing the result for `keys[i]` in
+ * `hits[i]`. All these keys share the jumpgate bucket of `keys[0]`.
+ */
+static void query_ref_dict_group(const kmer_t *keys,
+                                 const struct ref_dict *ref_dict,
+                                 size_t *hits)
+{
+	const struct dict_keys k = ref_dict_keys(ref_dict);
+	const unsigned lo_bases = dict_lo_bases(k.bits);
+	const size_t n = 1 + 3*lo_bases;
 
-	/* === Walk FASTQ File === */
-#define BUF_SIZE 1024
-	char id[BUF_SIZE];
-	char read[BUF_SIZE];
-	char read_revcompl[BUF_SIZE];
-	char sep[BUF_SIZE];
-	char qual[BUF_SIZE];
+	for (size_t i = 0; i < n; i++) {
+		hits[i] = DICT_MISS;
+	}
 
-	kmer_t kmers[BUF_SIZE];
+	size_t lo, hi;
+	if (!ref_dict_bucket(ref_dict, keys[0], &lo, &hi)) {
+		return;
+	}
 
-#define MAX_HITS 2000
-	//struct kmer_entry *ref_hits[MAX_HITS];
-	//struct snp_kmer_entry *snp_hits[MAX_HITS];
+	unsigned order[1 + 3*MAX_LO_BASES];
+	group_order(keys[0], lo_bases, order);
+	DICT_DISPATCH(dict_group_merge, &k, ref_dict->key_hi_bytes, lo, hi, keys, order, n, hits);
+}
 
-	size_t n_ref_hits;
-	size_t n_snp_hits;
+/*
+ * Same as `query_ref_dict_group` but for `snp_dict`.
+ */
+static void query_snp_dict_group(const kmer_t *keys,
+                                 const struct snp_dict *snp_dict,
+                                 size_t *hits)
+{
+	const struct dict_keys k = snp_dict_keys(snp_dict);
+	const unsigned lo_bases = dict_lo_bases(k.bits);
+	const size_t n = 1 + 3*lo_bases;
 
-	/* convenient way to store k-mer information */
-	typedef struct {
-		kmer_t kmer;
-		uint32_t position;  // 1-based position of read based on kmer hit
-		uint32_t kmer_pos;  // 1-based position of k-mer
-#if DEBUG
-		bool is_neighbor;
-#endif
-	} kmer_context;
+	for (size_t i = 0; i < n; i++) {
+		hits[i] = DICT_MISS;
+	}
 
-	kmer_context ref_hit_contexts[MAX_HITS];  // same count as `ref_hits` (i.e. `n_ref_hits`)
-	kmer_context snp_hit_contexts[MAX_HITS];  // same count as `snp_hits` (i.e. `n_snp_hits`)
-#undef MAX_HITS
-#undef BUF_SIZE
+	size_t lo, hi;
+	if (!snp_dict_bucket(snp_dict, keys[0], &lo, &hi)) {
+		return;
+	}
 
-	IndexTable index_table;
-	index_table_clear(&index_table);
+	unsigned order[1 + 3*MAX_LO_BASES];
+	group_order(keys[0], lo_bases, order);
+	DICT_DISPATCH(dict_group_merge, &k, snp_dict->key_hi_bytes, lo, hi, keys, order, n, hits);
+}
 
-#if DEBUG
-	size_t total_count = 0;
-	size_t match_count = 0;
-	size_t multi_count = 0;
-	size_t nohit_count = 0;
+/*
+ * Fills `keys` with `kmer` followed by its 96 hamming neighbors, ordered
+ * by the position of the substituted base: `keys[n]` (`n > 0`) differs
+ * from `kmer` at base `(n - 1)/3`. Hence the first `1 + 3*lo_bases` keys
+ * (see `dict_lo_bases`) all share the jumpgate bucket of `kmer`.
+ */
+static inline void kmer_neighbors(const kmer_t kmer, kmer_t *keys)
+{
+	size_t n = 0;
+	keys[n++] = kmer;
 
-	size_t good_reads = 0;  // give us SNP information
-	size_t bad_reads = 0;   // don't give us anything
+	for (unsigned i = 0; i < 64; i += 2) {
+		const uint64_t mask = 0x3UL << i;
+		const uint64_t base = (kmer & mask) >> i;
 
-	size_t ambig_hits = 0;
-	size_t unambig_hits = 0;
+		for (uint64_t j = 0; j < 0x4; j++) {
+			if (j == base) continue;
+			keys[n++] = (kmer & ~mask) | (j << i);
+		}
+	}
+}
 
-	size_t ref_covs = 0;
-	size_t alt_covs = 0;
-	size_t non_ref_or_alt_covs = 0;
-#endif
+/*
+ * Pigeonhole 1-mismatch search
+ *
+ * Instead of probing all 96 neighbors, we find every entry within hamming
+ * distance 1 of a k-mer by looking up the entries that share its high half
+ * (a contiguous range of the dictionary) and those that share its low half
+ * (a range of the dictionary's `struct half_index`), and verifying each
+ * candidate with a popcount. The results are reported exactly as by the
+ * neighbor enumeration, i.e. indexed like the keys of `kmer_neighbors`.
+ *
+ * Halves that occur very often (e.g. in repeats) would make for long
+ * candidate lists, so past `HALF_MAX_CANDIDATES` we give up and let the
+ * caller fall back to enumeration.
+ */
 
-	fprintf(stderr, "Processing...\n");
+#define HALF_MAX_CANDIDATES 64
 
-#if DEBUG
-	FILE *read_data = fopen("read_data.txt", "w");
-	assert(read_data);
-#endif
+static inline unsigned kmer_mismatches(const kmer_t a, const kmer_t b)
+{
+	const uint64_t d = a ^ b;
+	return __builtin_popcountl((d | (d >> 1)) & 0x5555555555555555UL);
+}
 
-	while (fgets(id, sizeof(id), fastq_file)) {
-		char *unused = fgets(read, sizeof(read), fastq_file);
-		unused =       fgets(sep,  sizeof(sep),  fastq_file);
-		unused =       fgets(qual, sizeof(qual), fastq_file);
-		UNUSED(unused);
-#if DEBUG
-		assert(!ferror(fastq_file));
-#endif
+/*
+ * Index in `kmer_neighbors` order of `neighbor`, which must differ from
+ * `kmer` at exactly one base.
+ */
+static inline size_t neighbor_index(const kmer_t kmer, const kmer_t neighbor)
+{
+	const unsigned p = __builtin_ctzl(kmer ^ neighbor)/2;
+	const unsigned base = kmer_get_base(kmer, p);
+	const unsigned j = kmer_get_base(neighbor, p);
+	return 1 + 3*p + (j < base ? j : j - 1);
+}
 
-		bool revcompl = false;
-
-		/*
-		 * We process reads in 32-base chunks, so we trim off
-		 * any remainder if the read length is not a multiple
-		 * of 32. Also, we assume this is a valid FASTQ file,
-		 * so the read length is equal to the quality string
-		 * length.
-		 */
-		const size_t read_len_true = strlen(read) - 1;  // -1 because of newline char
-		const size_t len = (read_len_true/32)*32;
-		//const bool need_terminal_kmer = (read_len_true != len);
-
-		head:
-		if (revcompl) {
-			for (size_t i = 0; i < len /*read_len_true*/; i++) {
-				char rev = '\0';
-				switch (read[i]) {
-				case 'a': case 'A': rev = 'T'; break;
-				case 'c': case 'C': rev = 'G'; break;
-				case 'g': case 'G': rev = 'C'; break;
-				case 't': case 'T': rev = 'A'; break;
-				default: goto nohit;
-				}
-				read_revcompl[len /*read_len_true*/ - i - 1] = rev;
-			}
-			memcpy(read, read_revcompl, len /*read_len_true*/);  // newline and '\0' already in `read`
-		}
+static inline void half_candidate(const kmer_t kmer, const kmer_t cand, const size_t idx, size_t *hits)
+{
+	switch (kmer_mismatches(kmer, cand)) {
+	case 0:
+		hits[0] = idx;
+		break;
+	case 1:
+		hits[neighbor_index(kmer, cand)] = idx;
+		break;
+	default:
+		break;
+	}
+}
 
-		size_t kmer_count = 0;
-		for (size_t i = 0; i < len; i += 32) {
-			bool kmer_had_n;
-			kmer_t kmer = encode_kmer(&read[i], &kmer_had_n);
+/*
+ * Stores in `hits` the dictionary entries within hamming distance 1 of
+ * `kmer`, given the range [`lo`, `hi`) of entries that share its high half.
+ * Returns false if there were too many candidates.
+ */
+static bool query_halves(const kmer_t kmer,
+                         const struct dict_keys *keys,
+                         const struct half_index *halves,
+                         const size_t lo,
+                         const size_t hi,
+                         size_t *hits)
+{
+	const uint32_t kmer_hi = HI(kmer);
+	const uint32_t kmer_lo = LO(kmer);
 
-			if (kmer_had_n)
-				goto nohit;
+	for (size_t i = 0; i < NEIGHBOR_COUNT + 1; i++) {
+		hits[i] = DICT_MISS;
+	}
 
-			kmers[kmer_count++] = kmer;
-		}
+	if (hi - lo > HALF_MAX_CANDIDATES) {
+		return false;
+	}
 
-		// (possibly) one last k-mer to cover entire read
-		/*
-		if (need_terminal_kmer) {
-			bool kmer_had_n;
-			kmer_t kmer = encode_kmer(&read[read_len_true - 32], &kmer_had_n);
+	for (size_t i = lo; i < hi; i++) {
+		half_candidate(kmer, ((kmer_t)kmer_hi << 32) | dict_key_lo(keys, i), i, hits);
+	}
 
-			if (kmer_had_n)
-				goto nohit;
+	const uint32_t bucket = kmer_lo >> (32 - halves->jumpgate_bits);
+	const size_t b_lo = halves->jumpgate[bucket];
+	const size_t b_hi = halves->jumpgate[bucket + 1];
+	const struct dict_keys half_keys = {.lo = halves->lo, .hi = NULL, .bits = 32};
+	size_t j = dict_lower_bound(&half_keys, 0, b_lo, b_hi, kmer_lo);
 
-			kmers[kmer_count++] = kmer;
+	for (size_t n = 0; j < b_hi && halves->lo[j] == kmer_lo; j++, n++) {
+		if (n == HALF_MAX_CANDIDATES) {
+			return false;
 		}
-		*/
 
-		n_ref_hits = 0;
-		n_snp_hits = 0;
+		/* entries sharing both halves were found above */
+		if (halves->hi[j] != kmer_hi) {
+			half_candidate(kmer, ((kmer_t)halves->hi[j] << 32) | kmer_lo, halves->idx[j], hits);
+		}
+	}
 
-		/* loop over k-mers, perform ref/SNP dict queries */
-		for (size_t i = 0; i < kmer_count; i++) {
-			const kmer_t kmer = kmers[i];
-			//const uint32_t offset = (need_terminal_kmer && i == (kmer_count - 1)) ? (read_len_true - 32) : 32*i;
-			const uint32_t offset = 32*i;
+	return true;
+}
 
-			struct kmer_entry *ref_hit = query_ref_dict(kmer, ref_jumpgate, ref_dict, ref_dict_size);
-			struct snp_kmer_entry *snp_hit = query_snp_dict(kmer, snp_jumpgate, snp_dict, snp_dict_size);
+/*
+ * Narrows the bucket [`lo`, `hi`) of `kmer` to the entries sharing its
+ * high half. The bucket only fixes the top bits of the high half; unless
+ * the jumpgate is 32 bits wide, the rest are in `keys_hi`.
+ */
+static ALWAYS_INLINE void dict_hi_half(const struct dict_keys *k, const unsigned hi_bytes, const kmer_t kmer, size_t *lo, size_t *hi)
+{
+	if (hi_bytes == 0 || k->bits == 32)
+		return;
 
-			const bool orig_ref_hit_not_null = (ref_hit != NULL);
-			const bool orig_snp_hit_not_null = (snp_hit != NULL);
+	const uint64_t top = dict_lo_key(kmer, k->bits) & ~0xFFFFFFFFUL;
+	const size_t end = *hi;
+	*lo = dict_lower_bound(k, hi_bytes, *lo, end, top);
+	*hi = dict_lower_bound(k, hi_bytes, *lo, end, top + (1UL << 32));
+}
 
-			if (orig_ref_hit_not_null && ref_hit->pos != POS_AMBIGUOUS) {
-				if (ref_hit->ambig_flag == FLAG_UNAMBIGUOUS) {
-					const uint32_t read_pos = ref_hit->pos - offset;
-					ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = kmer,
-					                                                .position = read_pos,
-					                                                .kmer_pos = ref_hit->pos,
-#if DEBUG
-					                                                .is_neighbor = false
-#endif
-					                                            };
-					index_table_add(&index_table, read_pos);
-#if DEBUG
-					++unambig_hits;
-#endif
-				} else if (ref_hit->ambig_flag == FLAG_AMBIGUOUS) {
-					const struct aux_table *p = &ref_aux_table[ref_hit->pos];
-					const uint32_t *pos_list = p->pos_list;
+/*
+ * Range of `ref_dict` entries sharing the high half of `kmer`.
+ */
+static inline void ref_dict_hi_half(const struct ref_dict *ref_dict, const kmer_t kmer, size_t *lo, size_t *hi)
+{
+	if (!ref_dict_bucket(ref_dict, kmer, lo, hi)) {
+		*lo = *hi = 0;
+		return;
+	}
 
-					for (int i = 0; i < AUX_TABLE_COLS; i++) {
-						const uint32_t pos = pos_list[i];
+	const struct dict_keys k = ref_dict_keys(ref_dict);
+	DICT_DISPATCH(dict_hi_half, &k, ref_dict->key_hi_bytes, kmer, lo, hi);
+}
 
-						if (pos == 0) break;
+/*
+ * Range of `snp_dict` entries sharing the high half of `kmer`.
+ */
+static inline void snp_dict_hi_half(const struct snp_dict *snp_dict, const kmer_t kmer, size_t *lo, size_t *hi)
+{
+	if (!snp_dict_bucket(snp_dict, kmer, lo, hi)) {
+		*lo = *hi = 0;
+		return;
+	}
 
-						const uint32_t read_pos = pos - offset;
-						ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = kmer,
-						                                                .position = read_pos,
-						                                                .kmer_pos = pos,
-#if DEBUG
-						                                                .is_neighbor = false
-#endif
-						                                            };
-						index_table_add(&index_table, read_pos);
-					}
-				} else {
-					assert(0);
-				}
+	const struct dict_keys k = snp_dict_keys(snp_dict);
+	DICT_DISPATCH(dict_hi_half, &k, snp_dict->key_hi_bytes, kmer, lo, hi);
+}
+
+/*
+ * Looks up `keys` as produced by `kmer_neighbors` in both dictionaries.
+ * Dictionaries with a pigeonhole index are searched through it; otherwise
+ * we query each shared bucket only once.
+ *
+ * Each of the remaining keys would cost a jumpgate load and a bucket
+ * search of its own, and nearly all of them miss, so we test those
+ * against the dictionaries' filters first (prefetching all the filter
+ * blocks up front). The grouped keys are not filtered, since their
+ * bucket is loaded anyway.
+ */
+static void query_neighbors(const kmer_t *keys,
+                            const struct ref_dict *ref_dict,
+                            const struct snp_dict *snp_dict,
+                            size_t *ref_hits,
+                            size_t *snp_hits)
+{
+	const kmer_t kmer = keys[0];
+	size_t lo, hi;
+
+	bool ref_done = false;
+	if (ref_dict->halves.size > 0) {
+		const struct dict_keys k = ref_dict_keys(ref_dict);
+		ref_dict_hi_half(ref_dict, kmer, &lo, &hi);
+		ref_done = query_halves(kmer, &k, &ref_dict->halves, lo, hi, ref_hits);
+	}
+
+	bool snp_done = false;
+	if (snp_dict->halves.size > 0) {
+		const struct dict_keys k = snp_dict_keys(snp_dict);
+		snp_dict_hi_half(snp_dict, kmer, &lo, &hi);
+		snp_done = query_halves(kmer, &k, &snp_dict->halves, lo, hi, snp_hits);
+	}
+
+	const size_t ref_group = 1 + 3*dict_lo_bases(64 - ref_dict->jumpgate_bits);
+	const size_t snp_group = 1 + 3*dict_lo_bases(64 - snp_dict->jumpgate_bits);
+
+	if (!ref_done) {
+		for (size_t n = ref_group; n < NEIGHBOR_COUNT + 1; n++) {
+			bloom_prefetch(&ref_dict->filter, keys[n]);
+		}
+	}
+	if (!snp_done) {
+		for (size_t n = snp_group; n < NEIGHBOR_COUNT + 1; n++) {
+			bloom_prefetch(&snp_dict->filter, keys[n]);
+		}
+	}
+
+	if (!ref_done) {
+		query_ref_dict_group(keys, ref_dict, ref_hits);
+		for (size_t n = ref_group; n < NEIGHBOR_COUNT + 1; n++) {
+			ref_hits[n] = bloom_contains(&ref_dict->filter, keys[n]) ? query_ref_dict(keys[n], ref_dict) : DICT_MISS;
+		}
+	}
+
+	if (!snp_done) {
+		query_snp_dict_group(keys, snp_dict, snp_hits);
+		for (size_t n = snp_group; n < NEIGHBOR_COUNT + 1; n++) {
+			snp_hits[n] = bloom_contains(&snp_dict->filter, keys[n]) ? query_snp_dict(keys[n], snp_dict) : DICT_MISS;
+		}
+	}
+}
+
+/*
+ * Reads the payload of a `SECTION_HALF_INDEX` and builds its jumpgate.
+ */
+static void half_index_deserialize(struct half_index *halves, FILE *in, const uint64_t len, HugeMem *mem)
+{
+	uint64_t size;
+	unsigned bits;
+	read_half_index_header(in, len, &size, &bits);
+
+	halves->size = size;
+	halves->jumpgate_bits = bits;
+	halves->lo = hugemem_alloc(mem, size * sizeof(*halves->lo), "half index");
+	halves->hi = hugemem_alloc(mem, size * sizeof(*halves->hi), "half index");
+	halves->idx = hugemem_alloc(mem, size * sizeof(*halves->idx), "half index");
+	halves->jumpgate = hugemem_alloc(mem, ((1UL << bits) + 1) * sizeof(*halves->jumpgate), "half index");
+
+	assert(fread(halves->lo, sizeof(*halves->lo), size, in) == size);
+	assert(fread(halves->hi, sizeof(*halves->hi), size, in) == size);
+	assert(fread(halves->idx, sizeof(*halves->idx), size, in) == size);
+
+	size_t i = 0;
+	for (size_t b = 0; b <= (1UL << bits); b++) {
+		while (i < size && (halves->lo[i] >> (32 - bits)) < b)
+			++i;
+		halves->jumpgate[b] = i;
+	}
+}
+
+static void half_index_release(struct half_index *halves, HugeMem *mem)
+{
+	if (halves->size == 0)
+		return;
+
+	hugemem_free(mem, halves->jumpgate);
+	hugemem_free(mem, halves->lo);
+	hugemem_free(mem, halves->hi);
+	hugemem_free(mem, halves->idx);
+	halves->size = 0;
+}
+
+/*
+ * Reads the optional sections that follow the aux table of a dictionary
+ * file. A filter or index that is not present is left empty (i.e. disabled).
+ * `read_seeds` may be NULL if the dictionary has no read prefilter. The
+ * filters and the index are allocated from `mem`.
+ */
+static void read_dict_sections(FILE *dict_file, BloomFilter *filter, struct half_index *halves, BloomFilter *read_seeds,
+                               HugeMem *mem)
+{
+	uint64_t tag;
+	uint64_t len;
+
+	filter->blocks = NULL;
+	halves->size = 0;
+	if (read_seeds)
+		read_seeds->blocks = NULL;
+
+	while (read_section_header(dict_file, &tag, &len)) {
+		switch (tag) {
+		case SECTION_BLOOM:
+			bloom_deserialize(filter, dict_file, len, mem, "Bloom filter");
+			break;
+		case SECTION_HALF_INDEX:
+			half_index_deserialize(halves, dict_file, len, mem);
+			break;
+		case SECTION_READ_SEEDS:
+			if (read_seeds) {
+				bloom_deserialize(read_seeds, dict_file, len, mem, "read seeds");
+				break;
 			}
+			skip_bytes(dict_file, len);
+			break;
+		default:
+			skip_bytes(dict_file, len);
+			break;
+		}
+	}
+}
+
+/*
+ * Read prefilter (see `SECTION_READ_SEEDS`): false if no 16-base half of
+ * any of the read's k-mers is a seed, in which case no placement of the
+ * read, in either orientation, can reach a SNP.
+ */
+static bool read_has_seed(const BloomFilter *read_seeds, const kmer_t *kmers, const size_t kmer_count)
+{
+	for (size_t i = 0; i < kmer_count; i++) {
+		bloom_prefetch(read_seeds, LO(kmers[i]));
+		bloom_prefetch(read_seeds, HI(kmers[i]));
+	}
+
+	for (size_t i = 0; i < kmer_count; i++) {
+		if (bloom_contains(read_seeds, LO(kmers[i])) || bloom_contains(read_seeds, HI(kmers[i])))
+			return true;
+	}
+
+	return false;
+}
+
+/* --- */
+
+/* --- */
+
+/*
+ * Binary call output: a header of `CALLS_MAGIC`, the chromosome count and
+ * each chromosome name (u64 length, then the bytes), then the record count
+ * and one record per call: u32 chromosome, u64 1-based position, u8 genotype
+ * (`GTYPE_ALT` or `GTYPE_HET`) and the f64 confidence. All little-endian.
+ */
+#define CALLS_MAGIC 0x534c4c4143564c4cUL  /* "LLVCALLS" */
+
+static void write_calls(const CallList *calls, const ContigTable *contigs, FILE *out, const bool binary)
+{
+	Writer *w = malloc(sizeof(*w));
+	assert(w);
+	writer_init(w, out);
+
+	if (binary) {
+		const uint64_t magic = CALLS_MAGIC;
+		const uint64_t n_chrs = contigs->count;
+		const uint64_t n_calls = calls->count;
+
+		writer_put_bytes(w, &magic, sizeof(magic));
+		writer_put_bytes(w, &n_chrs, sizeof(n_chrs));
+		for (size_t j = 0; j < contigs->count; j++) {
+			const uint64_t name_len = strlen(contigs->names[j]);
+			writer_put_bytes(w, &name_len, sizeof(name_len));
+			writer_put_bytes(w, contigs->names[j], name_len);
+		}
+		writer_put_bytes(w, &n_calls, sizeof(n_calls));
+	}
+
+	size_t j = 0;
+	for (size_t i = 0; i < calls->count; i++) {
+		const struct site_call *call = &calls->calls[i];
+
+		j = contig_for_pos(contigs, call->index, j);
+		assert(j != CONTIG_NONE);
+
+		/* index w.r.t. correct chromosome */
+		const size_t index = call->index - contigs->ends[j] + contigs->lens[j];
+
+		if (binary) {
+			const uint32_t chr = j;
+			const uint64_t pos = index;
+			const uint8_t gtype = call->genotype;
+
+			writer_put_bytes(w, &chr, sizeof(chr));
+			writer_put_bytes(w, &pos, sizeof(pos));
+			writer_put_bytes(w, &gtype, sizeof(gtype));
+			writer_put_bytes(w, &call->confidence, sizeof(call->confidence));
+		} else {
+			writer_puts(w, contigs->names[j]);
+			writer_putc(w, ' ');
+			writer_put_uint(w, index);
+			writer_putc(w, ' ');
+			writer_put_double(w, call->confidence);
+			writer_putc(w, '\n');
+		}
+	}
+
+	writer_flush(w);
+	free(w);
+}
+
+/*
+ * Read processing
+ *
+ * Reads are processed by a pool of workers, which take batches of reads
+ * from the FASTQ file in turn. The dictionaries are read-only at this
+ * point, so the workers share them (with `--numa=replicate`, each uses the
+ * copy on its own node). The pileup table is shared, and its counts are
+ * updated atomically (see `pileup_count`).
+ */
+
+#define READ_BUF_SIZE 1024
+#define READ_BATCH    256  /* reads taken from the FASTQ file at a time */
+
+/* everything that read processing looks up */
+struct lookup {
+	struct ref_dict ref_dict;
+	struct snp_dict snp_dict;
+	struct aux_table ref_aux;
+	struct aux_table snp_aux;
+};
+
+/*
+ * The hits a worker first has room for in either dictionary: one for each
+ * k-mer of a read (at most one per 32 bases) and each of their neighbors.
+ * Aux rows give more, for which the buffers grow (see `hits_reserve`).
+ */
+#define READ_HITS_INIT ((READ_BUF_SIZE/32) * (NEIGHBOR_COUNT + 1))
+
+/*
+ * The pileup table: dense (indexed by position) or compact (a hash table
+ * of the SNP positions alone, see `pileup.h`). `size` is the size of the
+ * dense table either way, i.e. one more than the last SNP position.
+ */
+struct pileup {
+	bool compact;
+	size_t size;
+	struct pileup_entry *table;  /* NULL if compact */
+	PileupTable ptable;          /* only if compact */
+};
+
+/* convenient way to store k-mer information */
+typedef struct {
+	kmer_t kmer;
+	pos_t position;     // 1-based position of read based on kmer hit
+	pos_t kmer_pos;     // 1-based position of k-mer
 #if DEBUG
-			else if (orig_ref_hit_not_null && ref_hit->pos == POS_AMBIGUOUS) {
-				++ambig_hits;
-			}
+	bool is_neighbor;
 #endif
+} kmer_context;
 
-			if (orig_snp_hit_not_null && snp_hit->pos != POS_AMBIGUOUS) {
-				if (snp_hit->ambig_flag == FLAG_UNAMBIGUOUS) {
-					const uint32_t read_pos = snp_hit->pos - offset;
-					snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = kmer,
-					                                                .position = read_pos,
-					                                                .kmer_pos = snp_hit->pos,
+/*
+ * What happened to the reads of a worker, kept by every worker (it costs a
+ * few increments per read) and added to its sample when the worker is
+ * freed. Counts that follow from these are only worked out for
+ * `lava_sample_stats`.
+ */
+struct read_stats {
+	uint64_t total_count;
+	uint64_t match_count;    // placed at one position
+	uint64_t multi_count;    // at several, equally well
+	uint64_t skipped_count;  // rejected by the read prefilter
+	uint64_t good_reads;     // give us SNP information
+
+	uint64_t ambig_hits;
+	uint64_t unambig_hits;
+
+	uint64_t ref_covs;
+	uint64_t alt_covs;
+	uint64_t non_ref_or_alt_covs;
+};
+
+static void read_stats_add(struct read_stats *a, const struct read_stats *b)
+{
+	a->total_count += b->total_count;
+	a->match_count += b->match_count;
+	a->multi_count += b->multi_count;
+	a->skipped_count += b->skipped_count;
+	a->good_reads += b->good_reads;
+	a->ambig_hits += b->ambig_hits;
+	a->unambig_hits += b->unambig_hits;
+	a->ref_covs += b->ref_covs;
+	a->alt_covs += b->alt_covs;
+	a->non_ref_or_alt_covs += b->non_ref_or_alt_covs;
+}
+
+/* the FASTQ files of a sample, read in turn */
+struct read_source {
+	FILE **fastq_files;
+	size_t n_files;
+	size_t current;
+	LavaProgress *progress;  /* NULL if nobody is watching */
+	pthread_mutex_t lock;
+};
+
+struct lava_worker {
+	LavaSample *sample;
+	const struct lookup *lookup;
+	PileupTable *ptable;  /* NULL unless the pileup table is compact */
+	struct pileup_entry *pileup_table;
+	struct read_source *source;
+	int cpu;  /* -1 if not pinned */
+	IndexTable *index_table;
+
+	char reads[READ_BATCH][READ_BUF_SIZE];
+	char read_revcompl[READ_BUF_SIZE];
+	kmer_t kmers[READ_BUF_SIZE];
+
+	/* `kmer` followed by its hamming neighbors, see `kmer_neighbors` */
+	kmer_t neighbor_keys[NEIGHBOR_COUNT + 1];
+	size_t ref_neighbor_hits[NEIGHBOR_COUNT + 1];
+	size_t snp_neighbor_hits[NEIGHBOR_COUNT + 1];
+
+	/* `READ_HITS_INIT` of each at first, grown by `hits_reserve` */
+	kmer_context *ref_hit_contexts;
+	kmer_context *snp_hit_contexts;
+	size_t ref_hits_cap;
+	size_t snp_hits_cap;
+
+	struct read_stats stats;
 #if DEBUG
-					                                                .is_neighbor = false
+	FILE *read_data;
 #endif
-					                                            };
-					index_table_add(&index_table, read_pos);
+};
+
+/*
+ * The counts of a pileup entry are in its first 4 bytes (along with the
+ * bases and frequencies, which don't change after loading), so workers
+ * update them with a compare-and-swap of that word. Counts saturate at
+ * `MAX_COV`, so the final counts don't depend on the order of updates.
+ */
+typedef uint32_t __attribute__((may_alias)) pileup_word;
+
+_Static_assert(sizeof(struct pileup_entry) == sizeof(pileup_word), "pileup entries must be one word");
+
+/* false for positions without a SNP (whose bases are both 0) */
+static inline bool pileup_has_snp(const struct pileup_entry *p)
+{
+	const pileup_word word = __atomic_load_n((const pileup_word *)p, __ATOMIC_RELAXED);
+	struct pileup_entry e;
+	memcpy(&e, &word, sizeof(word));
+	return e.ref != e.alt;
+}
+
+/* the pileup entry of position `pos`, or NULL if it has no SNP */
+static inline struct pileup_entry *pileup_snp(const LavaWorker *w, const pos_t pos)
+{
+	if (w->ptable != NULL) {
+		struct ptable_entry *e = ptable_get(w->ptable, pos);
+		return e ? &e->entry : NULL;
+	}
+
+	struct pileup_entry *p = &w->pileup_table[pos];
 #if DEBUG
-					++unambig_hits;
+	assert(pileup_has_snp(p) || (p->ref == 0 && p->alt == 0));
 #endif
-				} else if (snp_hit->ambig_flag == FLAG_AMBIGUOUS) {
-					const struct snp_aux_table *p = &snp_aux_table[snp_hit->pos];
-					const uint32_t *pos_list = p->pos_list;
+	return pileup_has_snp(p) ? p : NULL;
+}
 
-					for (int i = 0; i < AUX_TABLE_COLS; i++) {
-						const uint32_t pos = pos_list[i];
+enum {
+	COUNTED_NONE, COUNTED_REF, COUNTED_ALT
+};
 
-						if (pos == 0) break;
+static inline int pileup_count(struct pileup_entry *p, const unsigned base)
+{
+	pileup_word *word = (pileup_word *)p;
+	pileup_word old = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+	while (true) {
+		struct pileup_entry e;
+		memcpy(&e, &old, sizeof(old));
+
+		int counted;
+		if (base == e.ref) {
+			counted = COUNTED_REF;
+			if (e.ref_cnt == MAX_COV)
+				return counted;
+			++e.ref_cnt;
+		} else if (base == e.alt) {
+			counted = COUNTED_ALT;
+			if (e.alt_cnt == MAX_COV)
+				return counted;
+			++e.alt_cnt;
+		} else {
+			return COUNTED_NONE;
+		}
 
-						const uint32_t read_pos = pos - offset;
-						snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = kmer,
-						                                                .position = read_pos,
-						                                                .kmer_pos = pos,
+		pileup_word new;
+		memcpy(&new, &e, sizeof(new));
+		if (__atomic_compare_exchange_n(word, &old, new, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return counted;
+	}
+}
+
+/*
+ * NUMA replication
+ *
+ * With `--numa=replicate`, every node gets its own copy of the dictionaries
+ * and aux tables, so that workers (pinned to a node) only ever read local
+ * memory. Replicas are owned by `HugeMem`; the original, interleaved copy
+ * is released once they are made.
+ */
+
+/* dictionaries are only replicated if each node has this much more free memory than they take */
+#define REPLICATE_HEADROOM 1.25
+
+/*
+ * The arrays of a lookup, in a fixed order. `field` is the address of the
+ * pointer to the array (which may be NULL if the array is empty), so that
+ * the array can be moved; we go through `memcpy` since the pointers have
+ * different types.
+ */
+struct lookup_array {
+	void *field;
+	size_t size;
+	const char *name;
+};
+
+#define LOOKUP_MAX_ARRAYS 36
+
+static void *lookup_array_get(const struct lookup_array *a)
+{
+	void *p;
+	memcpy(&p, a->field, sizeof(p));
+	return p;
+}
+
+static void lookup_array_set(const struct lookup_array *a, void *p)
+{
+	memcpy(a->field, &p, sizeof(p));
+}
+
+static size_t bloom_bytes(const BloomFilter *b)
+{
+	return b->blocks ? b->n_blocks * BLOOM_BLOCK_WORDS * sizeof(*b->blocks) : 0;
+}
+
+static size_t lookup_arrays(struct lookup *lk, struct lookup_array *arrays)
+{
+	struct ref_dict *r = &lk->ref_dict;
+	struct snp_dict *s = &lk->snp_dict;
+	size_t n = 0;
+
+#define ARRAY(ptr, bytes, label) (arrays[n++] = (struct lookup_array){.field = &(ptr), .size = (bytes), .name = (label)})
+#define HALF_INDEX_ARRAYS(h) \
+	ARRAY((h)->jumpgate, (h)->size ? ((1UL << (h)->jumpgate_bits) + 1) * sizeof(*(h)->jumpgate) : 0, "half index"); \
+	ARRAY((h)->lo, (h)->size * sizeof(*(h)->lo), "half index"); \
+	ARRAY((h)->hi, (h)->size * sizeof(*(h)->hi), "half index"); \
+	ARRAY((h)->idx, (h)->size * sizeof(*(h)->idx), "half index")
+#define AUX_ARRAYS(a, label) \
+	ARRAY((a)->offsets, ((a)->rows + 1) * sizeof(*(a)->offsets), label); \
+	ARRAY((a)->offsets_hi, (a)->offsets_hi ? ((a)->rows + 1) * sizeof(*(a)->offsets_hi) : 0, label); \
+	ARRAY((a)->pos, (a)->size * sizeof(*(a)->pos), label); \
+	ARRAY((a)->pos_hi, (a)->pos_hi ? (a)->size * sizeof(*(a)->pos_hi) : 0, label); \
+	ARRAY((a)->snps, (a)->snps ? (a)->size * sizeof(*(a)->snps) : 0, label)
+
+	const bool packed = (r->key_hi_bytes == KEYS_PACKED);
+	ARRAY(r->jumpgate, ((1UL << r->jumpgate_bits) + 1) * sizeof(*r->jumpgate), "ref jumpgate");
+	ARRAY(r->keys, packed ? 0 : r->size * sizeof(*r->keys), "ref keys");
+	ARRAY(r->keys_hi, packed ? 0 : r->size * r->key_hi_bytes, "ref keys");
+	ARRAY(r->packed_keys, packed ? packed_bytes(r->size, 64 - r->jumpgate_bits) : 0, "ref keys");
+	ARRAY(r->pos, packed ? 0 : r->size * sizeof(*r->pos), "ref positions");
+	ARRAY(r->pos_hi, r->pos_hi ? r->size * sizeof(*r->pos_hi) : 0, "ref positions");
+	ARRAY(r->packed_values, packed ? packed_bytes(r->size, r->value_bits) : 0, "ref positions");
+	ARRAY(r->ambig_flags, packed ? 0 : r->size * sizeof(*r->ambig_flags), "ref flags");
+	ARRAY(r->filter.blocks, bloom_bytes(&r->filter), "Bloom filter");
+	HALF_INDEX_ARRAYS(&r->halves);
+
+	ARRAY(s->jumpgate, ((1UL << s->jumpgate_bits) + 1) * sizeof(*s->jumpgate), "SNP jumpgate");
+	ARRAY(s->keys, s->size * sizeof(*s->keys), "SNP keys");
+	ARRAY(s->keys_hi, s->size * s->key_hi_bytes, "SNP keys");
+	ARRAY(s->pos, s->size * sizeof(*s->pos), "SNP positions");
+	ARRAY(s->pos_hi, s->pos_hi ? s->size * sizeof(*s->pos_hi) : 0, "SNP positions");
+	ARRAY(s->snps, s->size * sizeof(*s->snps), "SNP info");
+	ARRAY(s->ambig_flags, s->size * sizeof(*s->ambig_flags), "SNP flags");
+	ARRAY(s->filter.blocks, bloom_bytes(&s->filter), "Bloom filter");
+	HALF_INDEX_ARRAYS(&s->halves);
+	ARRAY(s->read_seeds.blocks, bloom_bytes(&s->read_seeds), "read seeds");
+
+	AUX_ARRAYS(&lk->ref_aux, "ref aux table");
+	AUX_ARRAYS(&lk->snp_aux, "SNP aux table");
+#undef AUX_ARRAYS
+#undef HALF_INDEX_ARRAYS
+#undef ARRAY
+
+	assert(n <= LOOKUP_MAX_ARRAYS);
+	return n;
+}
+
+static size_t lookup_bytes(struct lookup *lk)
+{
+	struct lookup_array arrays[LOOKUP_MAX_ARRAYS];
+	const size_t n = lookup_arrays(lk, arrays);
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < n; i++) {
+		bytes += arrays[i].size;
+	}
+	return bytes;
+}
+
+/* makes `lk` (a copy of the original lookup) refer to a replica on node `node` */
+static void lookup_replicate(struct lookup *lk, HugeMem *mem, const Topology *topo, const unsigned node)
+{
+	struct lookup_array arrays[LOOKUP_MAX_ARRAYS];
+	const size_t n = lookup_arrays(lk, arrays);
+
+	for (size_t i = 0; i < n; i++) {
+		const struct lookup_array *a = &arrays[i];
+		void *q = NULL;
+
+		if (a->size) {
+			q = hugemem_alloc_node(mem, a->size, a->name, topo, node);
+			memcpy(q, lookup_array_get(a), a->size);
+		}
+
+		lookup_array_set(a, q);
+	}
+}
+
+static void aux_table_release(struct aux_table *aux, HugeMem *mem)
+{
+	hugemem_free(mem, aux->offsets);
+	hugemem_free(mem, aux->offsets_hi);
+	hugemem_free(mem, aux->pos);
+	hugemem_free(mem, aux->pos_hi);
+	hugemem_free(mem, aux->snps);
+}
+
+/* frees the lookup built while loading (but not replicas) */
+static void lookup_release(struct lookup *lk, HugeMem *mem)
+{
+	struct ref_dict *r = &lk->ref_dict;
+	struct snp_dict *s = &lk->snp_dict;
+
+	hugemem_free(mem, r->jumpgate);
+	hugemem_free(mem, r->keys);
+	hugemem_free(mem, r->keys_hi);
+	hugemem_free(mem, r->pos);
+	hugemem_free(mem, r->pos_hi);
+	hugemem_free(mem, r->ambig_flags);
+	hugemem_free(mem, r->packed_keys);
+	hugemem_free(mem, r->packed_values);
+	hugemem_free(mem, r->filter.blocks);
+	half_index_release(&r->halves, mem);
+
+	hugemem_free(mem, s->jumpgate);
+	hugemem_free(mem, s->keys);
+	hugemem_free(mem, s->keys_hi);
+	hugemem_free(mem, s->pos);
+	hugemem_free(mem, s->pos_hi);
+	hugemem_free(mem, s->snps);
+	hugemem_free(mem, s->ambig_flags);
+	hugemem_free(mem, s->filter.blocks);
+	half_index_release(&s->halves, mem);
+	hugemem_free(mem, s->read_seeds.blocks);
+
+	aux_table_release(&lk->ref_aux, mem);
+	aux_table_release(&lk->snp_aux, mem);
+}
+
+/* true if every node has room for a replica of `lk` */
+static bool replicas_fit(struct lookup *lk, const Topology *topo)
+{
+	const double needed = lookup_bytes(lk) * REPLICATE_HEADROOM;
+
+	for (unsigned node = 0; node < topo->n_nodes; node++) {
+		if (topology_node_free(topo, node) < needed)
+			return false;
+	}
+	return true;
+}
+
+/* makes room for `n` more hits after the `used` ones of a hit buffer, which may move it */
+static inline kmer_context *hits_reserve(kmer_context **hits, size_t *cap, const size_t used, const size_t n)
+{
+	if (used + n > *cap) {
+		*cap = MAX(2 * *cap, used + n);
+		*hits = realloc(*hits, *cap * sizeof(**hits));
+		assert(*hits);
+	}
+	return *hits;
+}
+
+/*
+ * Places one read (trying its reverse complement if the read itself can't
+ * be placed) and adds its bases at SNP positions to the pileup table.
+ * `read` is modified.
+ */
+static void pileup_read(LavaWorker *w, char *read)
+{
+	const struct ref_dict *ref_dict = &w->lookup->ref_dict;
+	const struct snp_dict *snp_dict = &w->lookup->snp_dict;
+	const struct aux_table *ref_aux = &w->lookup->ref_aux;
+	const struct aux_table *snp_aux = &w->lookup->snp_aux;
+	IndexTable *index_table = w->index_table;
+	char *read_revcompl = w->read_revcompl;
+	kmer_t *kmers = w->kmers;
+	kmer_t *neighbor_keys = w->neighbor_keys;
+	size_t *ref_neighbor_hits = w->ref_neighbor_hits;
+	size_t *snp_neighbor_hits = w->snp_neighbor_hits;
+	kmer_context *ref_hit_contexts = w->ref_hit_contexts;  // `n_ref_hits` of them
+	kmer_context *snp_hit_contexts = w->snp_hit_contexts;  // `n_snp_hits` of them
+	struct read_stats *stats = &w->stats;
+
+	size_t n_ref_hits;
+	size_t n_snp_hits;
+
+	bool revcompl = false;
+
+	/*
+	 * We process reads in 32-base chunks, so we trim off
+	 * any remainder if the read length is not a multiple
+	 * of 32. Also, we assume this is a valid FASTQ file,
+	 * so the read length is equal to the quality string
+	 * length.
+	 */
+	const size_t read_len_true = strlen(read) - 1;  // -1 because of newline char
+	const size_t len = (read_len_true/32)*32;
+	//const bool need_terminal_kmer = (read_len_true != len);
+
+	++stats->total_count;
+
+	head:
+	if (revcompl) {
+		for (size_t i = 0; i < len /*read_len_true*/; i++) {
+			char rev = '\0';
+			switch (read[i]) {
+			case 'a': case 'A': rev = 'T'; break;
+			case 'c': case 'C': rev = 'G'; break;
+			case 'g': case 'G': rev = 'C'; break;
+			case 't': case 'T': rev = 'A'; break;
+			default: goto nohit;
+			}
+			read_revcompl[len /*read_len_true*/ - i - 1] = rev;
+		}
+		memcpy(read, read_revcompl, len /*read_len_true*/);  // newline and '\0' already in `read`
+	}
+
+	size_t kmer_count = 0;
+	for (size_t i = 0; i < len; i += 32) {
+		bool kmer_had_n;
+		kmer_t kmer = encode_kmer(&read[i], &kmer_had_n);
+
+		if (kmer_had_n)
+			goto nohit;
+
+		kmers[kmer_count++] = kmer;
+	}
+
+	// (possibly) one last k-mer to cover entire read
+	/*
+	if (need_terminal_kmer) {
+		bool kmer_had_n;
+		kmer_t kmer = encode_kmer(&read[read_len_true - 32], &kmer_had_n);
+
+		if (kmer_had_n)
+			goto nohit;
+
+		kmers[kmer_count++] = kmer;
+	}
+	*/
+
+	/* the seeds cover both orientations, so one test suffices */
+	if (!revcompl && !read_has_seed(&snp_dict->read_seeds, kmers, kmer_count)) {
+		++stats->skipped_count;
+		goto nohit;
+	}
+
+	n_ref_hits = 0;
+	n_snp_hits = 0;
+
+	/* loop over k-mers, perform ref/SNP dict queries */
+	for (size_t i = 0; i < kmer_count; i++) {
+		const kmer_t kmer = kmers[i];
+		//const uint32_t offset = (need_terminal_kmer && i == (kmer_count - 1)) ? (read_len_true - 32) : 32*i;
+		const uint32_t offset = 32*i;
+
+		kmer_neighbors(kmer, neighbor_keys);
+		query_neighbors(neighbor_keys, ref_dict, snp_dict, ref_neighbor_hits, snp_neighbor_hits);
+
+		const size_t ref_hit = ref_neighbor_hits[0];
+		const size_t snp_hit = snp_neighbor_hits[0];
+
+		const bool orig_ref_hit_not_null = (ref_hit != DICT_MISS);
+		const bool orig_snp_hit_not_null = (snp_hit != DICT_MISS);
+
+		bool ref_in_aux = false;
+		const pos_t ref_pos = orig_ref_hit_not_null ? ref_dict_entry(ref_dict, ref_hit, &ref_in_aux) : POS_AMBIGUOUS;
+
+		if (orig_ref_hit_not_null && ref_pos != POS_AMBIGUOUS) {
+			if (!ref_in_aux) {
+				const pos_t read_pos = ref_pos - offset;
+				ref_hit_contexts = hits_reserve(&w->ref_hit_contexts, &w->ref_hits_cap, n_ref_hits, 1);
+				ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = kmer,
+				                                                .position = read_pos,
+				                                                .kmer_pos = ref_pos,
+#if DEBUG
+				                                                .is_neighbor = false
+#endif
+				                                            };
+				index_table_add(index_table, read_pos);
+				++stats->unambig_hits;
+			} else {
+				const size_t row = ref_pos;
+				const size_t end = aux_offset(ref_aux, row + 1);
+
+				ref_hit_contexts = hits_reserve(&w->ref_hit_contexts, &w->ref_hits_cap, n_ref_hits, end - aux_offset(ref_aux, row));
+				for (size_t k = aux_offset(ref_aux, row); k < end; k++) {
+					const pos_t pos = aux_pos(ref_aux, k);
+					const pos_t read_pos = pos - offset;
+					ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = kmer,
+					                                                .position = read_pos,
+					                                                .kmer_pos = pos,
 #if DEBUG
-						                                                .is_neighbor = false
+					                                                .is_neighbor = false
 #endif
-						                                            };
-						index_table_add(&index_table, read_pos);
-					}
-				} else {
-					assert(0);
+					                                            };
+					index_table_add(index_table, read_pos);
 				}
 			}
+		}
+		else if (orig_ref_hit_not_null && ref_pos == POS_AMBIGUOUS) {
+			++stats->ambig_hits;
+		}
+
+		if (orig_snp_hit_not_null && snp_dict_pos(snp_dict, snp_hit) != POS_AMBIGUOUS) {
+			if (snp_dict->ambig_flags[snp_hit] == FLAG_UNAMBIGUOUS) {
+				const pos_t read_pos = snp_dict_pos(snp_dict, snp_hit) - offset;
+				snp_hit_contexts = hits_reserve(&w->snp_hit_contexts, &w->snp_hits_cap, n_snp_hits, 1);
+				snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = kmer,
+				                                                .position = read_pos,
+				                                                .kmer_pos = snp_dict_pos(snp_dict, snp_hit),
 #if DEBUG
-			else if (orig_snp_hit_not_null && snp_hit->pos == POS_AMBIGUOUS) {
-				++ambig_hits;
-			}
+				                                                .is_neighbor = false
+#endif
+				                                            };
+				index_table_add(index_table, read_pos);
+				++stats->unambig_hits;
+			} else if (snp_dict->ambig_flags[snp_hit] == FLAG_AMBIGUOUS) {
+				const size_t row = snp_dict_pos(snp_dict, snp_hit);
+				const size_t end = aux_offset(snp_aux, row + 1);
+
+				snp_hit_contexts = hits_reserve(&w->snp_hit_contexts, &w->snp_hits_cap, n_snp_hits, end - aux_offset(snp_aux, row));
+				for (size_t k = aux_offset(snp_aux, row); k < end; k++) {
+					const pos_t pos = aux_pos(snp_aux, k);
+					const pos_t read_pos = pos - offset;
+					snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = kmer,
+					                                                .position = read_pos,
+					                                                .kmer_pos = pos,
+#if DEBUG
+					                                                .is_neighbor = false
 #endif
+					                                            };
+					index_table_add(index_table, read_pos);
+				}
+			} else {
+				assert(0);
+			}
+		}
+		else if (orig_snp_hit_not_null && snp_dict_pos(snp_dict, snp_hit) == POS_AMBIGUOUS) {
+			++stats->ambig_hits;
+		}
 
-			/* loop over hamming neighbors of `kmer`, maybe */
-			for (unsigned i = 0; i < 64; i += 2) {
-				const unsigned diff_base_pos = i/2;
-				const uint64_t mask = 0x3UL << i;
-				const uint64_t base = (kmer & mask) >> i;
-
-				for (uint64_t j = 0; j < 0x4; j++) {
-					if (j == base) continue;
-
-					const kmer_t neighbor = (kmer & ~mask) | (j << i);
-
-					struct kmer_entry *ref_hit = query_ref_dict(neighbor, ref_jumpgate, ref_dict, ref_dict_size);
-					struct snp_kmer_entry *snp_hit = query_snp_dict(neighbor, snp_jumpgate, snp_dict, snp_dict_size);
-
-					const size_t ref_hit_diff_loc = (ref_hit != NULL &&
-					                                 ref_hit->pos != POS_AMBIGUOUS &&
-					                                 ref_hit->ambig_flag == FLAG_UNAMBIGUOUS) ?
-					                                    (ref_hit->pos + diff_base_pos) :
-					                                    0;
-
-					if (ref_hit != NULL && ref_hit->pos != POS_AMBIGUOUS) {
-						if (ref_hit->ambig_flag == FLAG_UNAMBIGUOUS &&
-#if PCOMPACT
-							ptable_get(&ptable, ref_hit_diff_loc) == NULL
-#else
-					        pileup_table[ref_hit_diff_loc].ref == 0 &&
-					        pileup_table[ref_hit_diff_loc].alt == 0
-#endif
-					       ) {
+		/* loop over hamming neighbors of `kmer`, maybe */
+		for (unsigned i = 0; i < 32; i++) {
+			const unsigned diff_base_pos = i;
 
-							const uint32_t read_pos = ref_hit->pos - offset;
-							ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = neighbor,
-							                                                .position = read_pos,
-							                                                .kmer_pos = ref_hit->pos,
-#if DEBUG
-							                                                .is_neighbor = true
-#endif
-							                                            };
-							index_table_add(&index_table, read_pos);
+			for (unsigned j = 0; j < 3; j++) {
+				const size_t n = 1 + 3*i + j;
+				const kmer_t neighbor = neighbor_keys[n];
+
+				const size_t ref_hit = ref_neighbor_hits[n];
+				const size_t snp_hit = snp_neighbor_hits[n];
+
+				bool ref_in_aux = false;
+				const pos_t ref_pos = (ref_hit != DICT_MISS) ? ref_dict_entry(ref_dict, ref_hit, &ref_in_aux) : POS_AMBIGUOUS;
+
+				const size_t ref_hit_diff_loc = (ref_hit != DICT_MISS &&
+				                                 ref_pos != POS_AMBIGUOUS &&
+				                                 !ref_in_aux) ?
+				                                    (ref_pos + diff_base_pos) :
+				                                    0;
+
+				if (ref_hit != DICT_MISS && ref_pos != POS_AMBIGUOUS) {
+					if (!ref_in_aux &&
+					    pileup_snp(w, ref_hit_diff_loc) == NULL) {
+
+						const pos_t read_pos = ref_pos - offset;
+						ref_hit_contexts = hits_reserve(&w->ref_hit_contexts, &w->ref_hits_cap, n_ref_hits, 1);
+						ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = neighbor,
+						                                                .position = read_pos,
+						                                                .kmer_pos = ref_pos,
 #if DEBUG
-							++unambig_hits;
+						                                                .is_neighbor = true
 #endif
-						} else if (ref_hit->ambig_flag == FLAG_AMBIGUOUS) {
-							const struct aux_table *p = &ref_aux_table[ref_hit->pos];
-							const uint32_t *pos_list = p->pos_list;
-
-							for (int i = 0; i < AUX_TABLE_COLS; i++) {
-								const uint32_t pos = pos_list[i];
-
-								if (pos == 0) break;
-
-								const size_t ref_hit_diff_loc = pos + diff_base_pos;
-								if (
-#if PCOMPACT
-								     ptable_get(&ptable, ref_hit_diff_loc) == NULL
-#else
-								     pileup_table[ref_hit_diff_loc].ref == 0 &&
-					                 pileup_table[ref_hit_diff_loc].alt == 0
-#endif
-								   ) {
-									const uint32_t read_pos = pos - offset;
-									ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = neighbor,
-									                                                .position = read_pos,
-									                                                .kmer_pos = pos,
+						                                            };
+						index_table_add(index_table, read_pos);
+						++stats->unambig_hits;
+					} else if (ref_in_aux) {
+						const size_t row = ref_pos;
+						const size_t end = aux_offset(ref_aux, row + 1);
+
+						ref_hit_contexts = hits_reserve(&w->ref_hit_contexts, &w->ref_hits_cap, n_ref_hits, end - aux_offset(ref_aux, row));
+						for (size_t k = aux_offset(ref_aux, row); k < end; k++) {
+							const pos_t pos = aux_pos(ref_aux, k);
+							const size_t ref_hit_diff_loc = pos + diff_base_pos;
+							if (pileup_snp(w, ref_hit_diff_loc) == NULL) {
+								const pos_t read_pos = pos - offset;
+								ref_hit_contexts[n_ref_hits++] = (kmer_context){.kmer = neighbor,
+								                                                .position = read_pos,
+								                                                .kmer_pos = pos,
 #if DEBUG
-									                                                .is_neighbor = true
+								                                                .is_neighbor = true
 #endif
-									                                            };
-									index_table_add(&index_table, read_pos);
-								}
+								                                            };
+								index_table_add(index_table, read_pos);
 							}
 						}
 					}
-#if DEBUG
-					else if (ref_hit != NULL && ref_hit->pos == POS_AMBIGUOUS) {
-						++ambig_hits;
-					}
-#endif
+				}
+				else if (ref_hit != DICT_MISS && ref_pos == POS_AMBIGUOUS) {
+					++stats->ambig_hits;
+				}
 
-					if (snp_hit != NULL && snp_hit->pos != POS_AMBIGUOUS) {
+				if (snp_hit != DICT_MISS && snp_dict_pos(snp_dict, snp_hit) != POS_AMBIGUOUS) {
 
-						if (snp_hit->ambig_flag == FLAG_UNAMBIGUOUS && SNP_INFO_POS(snp_hit->snp) != diff_base_pos) {
-							const uint32_t read_pos = snp_hit->pos - offset;
-							snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = neighbor,
-							                                                .position = read_pos,
-							                                                .kmer_pos = snp_hit->pos,
-#if DEBUG
-							                                                .is_neighbor = true
-#endif
-							                                            };
-							index_table_add(&index_table, read_pos);
+					if (snp_dict->ambig_flags[snp_hit] == FLAG_UNAMBIGUOUS && SNP_INFO_POS(snp_dict->snps[snp_hit]) != diff_base_pos) {
+						const pos_t read_pos = snp_dict_pos(snp_dict, snp_hit) - offset;
+						snp_hit_contexts = hits_reserve(&w->snp_hit_contexts, &w->snp_hits_cap, n_snp_hits, 1);
+						snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = neighbor,
+						                                                .position = read_pos,
+						                                                .kmer_pos = snp_dict_pos(snp_dict, snp_hit),
 #if DEBUG
-							++unambig_hits;
+						                                                .is_neighbor = true
 #endif
-						} else if (snp_hit->ambig_flag == FLAG_AMBIGUOUS) {
-							const struct snp_aux_table *p = &snp_aux_table[snp_hit->pos];
-							const uint32_t *pos_list = p->pos_list;
-							const uint8_t *snp_list = p->snp_list;
-
-							for (int i = 0; i < AUX_TABLE_COLS; i++) {
-								const uint32_t pos = pos_list[i];
-
-								if (pos == 0) break;
-
-								if (SNP_INFO_POS(snp_list[i]) != diff_base_pos) {
-									const uint32_t read_pos = pos - offset;
-									snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = neighbor,
-									                                                .position = read_pos,
-									                                                .kmer_pos = pos,
+						                                            };
+						index_table_add(index_table, read_pos);
+						++stats->unambig_hits;
+					} else if (snp_dict->ambig_flags[snp_hit] == FLAG_AMBIGUOUS) {
+						const size_t row = snp_dict_pos(snp_dict, snp_hit);
+						const size_t end = aux_offset(snp_aux, row + 1);
+
+						snp_hit_contexts = hits_reserve(&w->snp_hit_contexts, &w->snp_hits_cap, n_snp_hits, end - aux_offset(snp_aux, row));
+						for (size_t k = aux_offset(snp_aux, row); k < end; k++) {
+							const pos_t pos = aux_pos(snp_aux, k);
+
+							if (SNP_INFO_POS(snp_aux->snps[k]) != diff_base_pos) {
+								const pos_t read_pos = pos - offset;
+								snp_hit_contexts[n_snp_hits++] = (kmer_context){.kmer = neighbor,
+								                                                .position = read_pos,
+								                                                .kmer_pos = pos,
 #if DEBUG
-									                                                .is_neighbor = true
+								                                                .is_neighbor = true
 #endif
-									                                            };
+								                                            };
 
-									index_table_add(&index_table, read_pos);
-								}
+								index_table_add(index_table, read_pos);
 							}
 						}
 					}
-#if DEBUG
-					else if (snp_hit != NULL && snp_hit->pos == POS_AMBIGUOUS) {
-						++ambig_hits;
+				}
+				else if (snp_hit != DICT_MISS && snp_dict_pos(snp_dict, snp_hit) == POS_AMBIGUOUS) {
+					++stats->ambig_hits;
+				}
+			}
+		}
+	}
+
+	/*
+	 * Now we loop over our ref/SNP hits and find the ones that support the 'best' position
+	 * according to our index table, and use those to update the pileup table. At the same
+	 * time, we clear our index table for when we process the next read.
+	 */
+
+	const bool process_read = (index_table->best && (index_table->best->freq > 1) && !index_table->ambiguous);
+	const pos_t target_index = index_table->best ? index_table->best->index : 0;
+
+	bool read_good = false;
+
+	for (size_t i = 0; i < n_ref_hits; i++) {
+		const pos_t index = ref_hit_contexts[i].position;
+		index_table_clear_index(index_table, index);
+
+		if (process_read && index == target_index) {
+			const pos_t kmer_pos = ref_hit_contexts[i].kmer_pos;
+			const kmer_t kmer = ref_hit_contexts[i].kmer;
+			for (unsigned i = 0; i < 32; i++) {
+				const unsigned base = kmer_get_base(kmer, i);
+
+				struct pileup_entry *p = pileup_snp(w, kmer_pos + i);
+
+				if (p != NULL) {
+					switch (pileup_count(p, base)) {
+					case COUNTED_REF:
+						read_good = true;
+						++stats->ref_covs;
+						break;
+					case COUNTED_ALT:
+						read_good = true;
+						++stats->alt_covs;
+						break;
+					default:
+						++stats->non_ref_or_alt_covs;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n_snp_hits; i++) {
+		const pos_t index = snp_hit_contexts[i].position;
+		index_table_clear_index(index_table, index);
+
+		if (process_read && index == target_index) {
+			const pos_t kmer_pos = snp_hit_contexts[i].kmer_pos;
+			const kmer_t kmer = snp_hit_contexts[i].kmer;
+			for (unsigned i = 0; i < 32; i++) {
+				const unsigned base = kmer_get_base(kmer, i);
+
+				struct pileup_entry *p = pileup_snp(w, kmer_pos + i);
+
+				if (p != NULL) {
+					switch (pileup_count(p, base)) {
+					case COUNTED_REF:
+						read_good = true;
+						++stats->ref_covs;
+						break;
+					case COUNTED_ALT:
+						read_good = true;
+						++stats->alt_covs;
+						break;
+					default:
+						++stats->non_ref_or_alt_covs;
+						break;
 					}
-#endif
 				}
 			}
 		}
+	}
+
+	if (!process_read && !revcompl) {
+		revcompl = true;
+		index_table->best = NULL;
+		index_table->ambiguous = false;
+		goto head;
+	}
 
-		/*
-		 * Now we loop over our ref/SNP hits and find the ones that support the 'best' position
-		 * according to our index table, and use those to update the pileup table. At the same
-		 * time, we clear our index table for when we process the next read.
-		 */
+	if (read_good)
+		++stats->good_reads;
 
-		const bool process_read = (index_table.best && (index_table.best->freq > 1) && !index_table.ambiguous);
-		const uint32_t target_index = index_table.best ? index_table.best->index : 0;
+	if (index_table->best != NULL && index_table->best->freq > 1) {
+		if (index_table->ambiguous)
+			++stats->multi_count;
+		else
+			++stats->match_count;
+	}
 
 #if DEBUG
-		bool read_good = false;
-#endif
+	if (index_table->best) {
+		fprintf(w->read_data, "%s %d ", index_table->ambiguous ? "A" : "U", index_table->best->freq);
 
 		for (size_t i = 0; i < n_ref_hits; i++) {
-			const uint32_t index = ref_hit_contexts[i].position;
-			index_table_clear_index(&index_table, index);
-
-			if (process_read && index == target_index) {
-				const uint32_t kmer_pos = ref_hit_contexts[i].kmer_pos;
-				const kmer_t kmer = ref_hit_contexts[i].kmer;
-				for (unsigned i = 0; i < 32; i++) {
-					const unsigned base = kmer_get_base(kmer, i);
-
-#if PCOMPACT
-					struct pileup_entry *p = ptable_get(&ptable, kmer_pos + i);
-#else
-					struct pileup_entry *p = &pileup_table[kmer_pos + i];
-#endif
+			const pos_t index = ref_hit_contexts[i].position;
 
-					if (
-#if PCOMPACT
-					    p != NULL
-#else
-					    p->ref != p->alt
-#endif
-					   ) {
+			if (index == target_index) {
+				fprintf(w->read_data, "%lu:%s ", index, ref_hit_contexts[i].is_neighbor ? "1" : "0");
+			}
+		}
 
-						if (base == p->ref) {
-#if DEBUG
-							read_good = true;
-#endif
-							if (p->ref_cnt != MAX_COV)
-								++p->ref_cnt;
-#if DEBUG
-							++ref_covs;
-#endif
-						}
-						else if (base == p->alt) {
-#if DEBUG
-							read_good = true;
+		for (size_t i = 0; i < n_snp_hits; i++) {
+			const pos_t index = snp_hit_contexts[i].position;
+
+			if (index == target_index) {
+				fprintf(w->read_data, "%lu:%s ", index, snp_hit_contexts[i].is_neighbor ? "1" : "0");
+			}
+		}
+
+		fprintf(w->read_data, "\n");
+	}
 #endif
-							if (p->alt_cnt != MAX_COV)
-								++p->alt_cnt;
+
+	nohit:
+	index_table->best = NULL;
+	index_table->ambiguous = false;
+}
+
+/*
+ * Takes up to `READ_BATCH` reads from `source`, keeping only their
+ * sequences. Returns the number of reads taken (0 once all files are done).
+ */
+static size_t read_batch(struct read_source *source, char (*reads)[READ_BUF_SIZE])
+{
+	char line[READ_BUF_SIZE];
+	size_t n = 0;
+	uint64_t bytes = 0;
+
+	assert(pthread_mutex_lock(&source->lock) == 0);
+
+	while (n < READ_BATCH && source->current < source->n_files) {
+		FILE *fastq_file = source->fastq_files[source->current];
+
+		if (!fgets(line, sizeof(line), fastq_file) || !fgets(reads[n], READ_BUF_SIZE, fastq_file)) {
+			++source->current;
+			continue;
+		}
+		bytes += strlen(line) + strlen(reads[n]);
+
+		for (int i = 0; i < 2; i++) {
+			if (fgets(line, sizeof(line), fastq_file))
+				bytes += strlen(line);
+		}
 #if DEBUG
-							++alt_covs;
+		assert(!ferror(fastq_file));
 #endif
-						}
+		++n;
+	}
+
+	if (source->progress != NULL) {
+		__atomic_fetch_add(&source->progress->reads, n, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&source->progress->bytes, bytes, __ATOMIC_RELAXED);
+	}
+
+	assert(pthread_mutex_unlock(&source->lock) == 0);
+	return n;
+}
+
+/*
+ * Memory budget (`--max-mem`)
+ *
+ * Nearly all of the memory of a run is taken by the dictionaries and
+ * their aux tables, filters and indices, and by the pileup tables (one per
+ * sample genotyped at a time). All of their sizes follow from the
+ * dictionary headers and sections and the genome length, so we can size
+ * everything before loading anything. Three of them can be traded for
+ * speed at load time: jumpgates can be narrower than the dictionary
+ * records (a few more probes per search, and up to 2 more bytes per key),
+ * the reference dictionary can be packed (a shift and a mask more per key
+ * read, see `struct ref_dict`), and the pileup table can be compact. Given
+ * a budget, we keep the dense pileup table if we can, narrowing the
+ * jumpgates as far as needed and packing the reference dictionary before
+ * narrowing them further, and only then make the pileup table compact.
+ */
+
+struct mem_plan {
+	bool compact;                /* pileup table */
+	bool ref_packed;
+	unsigned ref_jumpgate_bits;  /* 0 for dictionaries in a segment, which are fixed */
+	unsigned snp_jumpgate_bits;
+	size_t dict_bytes;           /* not counting those in a segment, which are shared */
+	size_t pileup_bytes;         /* of each pileup table */
+	size_t other_bytes;          /* workers and calling tables */
+};
+
+/* what a dictionary file holds, as far as its size in memory goes */
+struct dict_shape {
+	struct dict_header header;
+	uint64_t filter_bytes;
+	uint64_t seeds_bytes;
+	uint64_t halves_size;  /* entries of the half index, if any */
+	unsigned halves_jumpgate_bits;
+};
+
+/* each SNP gives a k-mer of the SNP dictionary at each of its offsets */
+#define SNP_KMERS_PER_SITE 32
+
+/* the jumpgate width recorded in a dictionary, or the one it would have been given */
+static unsigned dict_jumpgate_bits(const struct dict_header *h)
+{
+	return h->jumpgate_bits ? h->jumpgate_bits : jumpgate_bits_for(h->size);
+}
+
+/*
+ * The values of a packed reference dictionary (see `struct ref_dict`) go
+ * up to the largest position it records (or the largest it could hold,
+ * for dictionaries that don't record it), then come its aux table rows,
+ * and all 1s is `POS_AMBIGUOUS`.
+ */
+static pos_t ref_ambig_base(const struct dict_header *h)
+{
+	if (h->max_pos > 0)
+		return h->max_pos;
+
+	return (h->flags & DICT_FLAG_WIDE_POS) ? POS_WIDE_LIMIT - 1 : POS_NARROW_LIMIT - 1;
+}
+
+static unsigned ref_value_bits(const struct dict_header *h)
+{
+	return 64 - __builtin_clzl(ref_ambig_base(h) + h->aux_size + 1);
+}
+
+/*
+ * Reads the header of the dictionary `dict_file` and the lengths of its
+ * sections, skipping over its entries, and then returns to where it was.
+ * Returns false, having read nothing, if `dict_file` can't be rewound
+ * (i.e. it's a pipe).
+ */
+static bool dict_shape_read(FILE *dict_file, const bool snp, struct dict_shape *shape)
+{
+	const long start = ftell(dict_file);
+	if (start < 0)
+		return false;
+
+	struct dict_header *h = &shape->header;
+	read_dict_header(dict_file, h);
+	dict_check_kind(h, snp);
+
+	assert(fseek(dict_file, (long)(h->size*dict_entry_bytes(h, snp) + dict_aux_bytes(h, snp)), SEEK_CUR) == 0);
+
+	shape->filter_bytes = 0;
+	shape->seeds_bytes = 0;
+	shape->halves_size = 0;
+
+	uint64_t tag;
+	uint64_t len;
+	while (read_section_header(dict_file, &tag, &len)) {
+		switch (tag) {
+		case SECTION_BLOOM:
+			shape->filter_bytes = len - sizeof(uint64_t);
+			break;
+		case SECTION_HALF_INDEX:
+			len -= read_half_index_header(dict_file, len, &shape->halves_size, &shape->halves_jumpgate_bits);
+			break;
+		case SECTION_READ_SEEDS:
+			if (snp)
+				shape->seeds_bytes = len - sizeof(uint64_t);
+			break;
+		}
+		assert(fseek(dict_file, (long)len, SEEK_CUR) == 0);
+	}
+
+	assert(fseek(dict_file, start, SEEK_SET) == 0);
+	return true;
+}
+
+/*
+ * The memory a dictionary takes once loaded with a jumpgate `bits` wide,
+ * and packed if `packed` (reference dictionaries only), see `lookup_arrays`
+ */
+static size_t dict_bytes(const struct dict_shape *shape, const bool snp, const unsigned bits, const bool packed)
+{
+	const struct dict_header *h = &shape->header;
+	const size_t entry_bytes = sizeof(uint32_t) + key_hi_bytes_for(bits) +                  /* keys */
+	                           sizeof(uint32_t) + ((h->flags & DICT_FLAG_WIDE_POS) ? 1 : 0) + /* positions */
+	                           sizeof(uint8_t) + (snp ? sizeof(snp_info) : 0);               /* flags, SNPs */
+	const size_t entries_bytes = packed ? packed_bytes(h->size, 64 - bits) + packed_bytes(h->size, ref_value_bits(h)) :
+	                                      h->size*entry_bytes;
+	/* before version 3, the positions aren't recorded, so we count full rows */
+	const size_t aux_positions = (h->version >= 3) ? h->aux_positions : h->aux_size * AUX_TABLE_COLS;
+	const size_t aux_bytes = (h->aux_size + 1) * (sizeof(uint32_t) + ((aux_positions >= POS_NARROW_LIMIT) ? 1 : 0)) +
+	                         aux_positions * (sizeof(uint32_t) + ((h->flags & DICT_FLAG_WIDE_POS) ? 1 : 0) +
+	                                          (snp ? sizeof(snp_info) : 0));
+	const size_t halves_bytes = shape->halves_size ?
+	                            shape->halves_size * 3*sizeof(uint32_t) + ((1UL << shape->halves_jumpgate_bits) + 1) * sizeof(uint32_t) :
+	                            0;
+
+	return ((1UL << bits) + 1) * sizeof(uint32_t) + entries_bytes + aux_bytes +
+	       shape->filter_bytes + shape->seeds_bytes + halves_bytes;
+}
+
+/* the memory of a pileup table covering `size` positions, with `n_sites` SNP positions */
+static size_t pileup_bytes_for(const bool compact, const size_t size, const size_t n_sites)
+{
+	return compact ? ptable_bytes_for(ptable_size_for(n_sites), n_sites) : size * sizeof(struct pileup_entry);
+}
+
+static size_t pileup_bytes(const struct pileup *pileup)
+{
+	return pileup->compact ? ptable_bytes(&pileup->ptable) : pileup->size * sizeof(*pileup->table);
+}
+
+/* the workers of a run (each with its hit buffers, as they start) and the calling tables */
+static size_t workers_bytes(const MemOptions *opts)
+{
+	const size_t hits = 2 * READ_HITS_INIT * sizeof(kmer_context);
+	return opts->threads * (sizeof(struct lava_worker) + sizeof(IndexTable) + hits) + sizeof(CallTables);
+}
+
+static size_t plan_total(const struct mem_plan *plan, const MemOptions *opts)
+{
+	return plan->dict_bytes + opts->samples * plan->pileup_bytes + plan->other_bytes;
+}
+
+static double mib(const size_t bytes)
+{
+	return bytes/(double)(1UL << 20);
+}
+
+/*
+ * Plans the memory of a run (see above), for the dictionaries of `ref` and
+ * `snp` (NULL if they are in a segment) and a pileup table covering
+ * `pileup_size` positions with about `n_sites` SNP positions. Without a
+ * budget, dictionaries keep their jumpgate widths and the reference
+ * dictionary and the pileup table their layouts unless REF_PACKED or
+ * PCOMPACT are set. Exits if nothing fits.
+ */
+static void plan_memory(const MemOptions *opts,
+                        const struct dict_shape *ref,
+                        const struct dict_shape *snp,
+                        const size_t pileup_size,
+                        const size_t n_sites,
+                        struct mem_plan *plan)
+{
+	const unsigned ref_bits = ref ? dict_jumpgate_bits(&ref->header) : 0;
+	const unsigned snp_bits = snp ? dict_jumpgate_bits(&snp->header) : 0;
+	const bool budget = (opts->max_mem > 0);
+	struct mem_plan smallest;
+	size_t smallest_total = SIZE_MAX;
+
+	/* a reference dictionary in a segment keeps the layout it was loaded with */
+	const int last_packed = ref ? 1 : 0;
+
+	for (int compact = budget ? 0 : PCOMPACT; compact <= 1; compact++) {
+		for (unsigned narrower = 0; ; narrower++) {
+			for (int packed = (budget || ref == NULL) ? 0 : REF_PACKED; packed <= last_packed; packed++) {
+				plan->compact = compact;
+				plan->ref_packed = packed;
+				plan->ref_jumpgate_bits = (ref_bits > JUMPGATE_MIN_BITS + narrower) ? ref_bits - narrower : JUMPGATE_MIN_BITS;
+				plan->snp_jumpgate_bits = (snp_bits > JUMPGATE_MIN_BITS + narrower) ? snp_bits - narrower : JUMPGATE_MIN_BITS;
+				if (ref == NULL)
+					plan->ref_jumpgate_bits = 0;
+				if (snp == NULL)
+					plan->snp_jumpgate_bits = 0;
+
+				plan->dict_bytes = (ref ? dict_bytes(ref, false, plan->ref_jumpgate_bits, packed) : 0) +
+				                   (snp ? dict_bytes(snp, true, plan->snp_jumpgate_bits, false) : 0);
+				plan->pileup_bytes = pileup_bytes_for(compact, pileup_size, n_sites);
+				plan->other_bytes = workers_bytes(opts);
+
+				if (!budget || plan_total(plan, opts) <= opts->max_mem)
+					return;
+
+				if (plan_total(plan, opts) < smallest_total) {
+					smallest = *plan;
+					smallest_total = plan_total(plan, opts);
+				}
+			}
+
+			if ((ref == NULL || plan->ref_jumpgate_bits == JUMPGATE_MIN_BITS) &&
+			    (snp == NULL || plan->snp_jumpgate_bits == JUMPGATE_MIN_BITS))
+				break;
+		}
+	}
+
+	fprintf(stderr, "Memory budget of %.1f MiB is too small: at least %.1f MiB is needed "
+	                "(dictionaries %.1f MiB, %u pileup table%s of %.1f MiB, workers %.1f MiB)\n",
+	        mib(opts->max_mem), mib(smallest_total), mib(smallest.dict_bytes),
+	        opts->samples, (opts->samples == 1) ? "" : "s", mib(smallest.pileup_bytes), mib(smallest.other_bytes));
+	exit(EXIT_FAILURE);
+}
+
+/* the value of an entry of a packed reference dictionary, see `struct ref_dict` */
+static pos_t ref_packed_value(const struct ref_dict *ref_dict, const struct dict_header *h, const pos_t pos, const uint8_t ambig_flag)
+{
+	if (pos == POS_AMBIGUOUS)
+		return (1UL << ref_dict->value_bits) - 1;
+
+	if (ambig_flag == FLAG_AMBIGUOUS) {
+		if (pos >= h->aux_size) {
+			fprintf(stderr, "Dictionary has an entry in aux table row %lu of %lu\n", pos, h->aux_size);
+			exit(EXIT_FAILURE);
+		}
+		return ref_dict->ambig_base + 1 + pos;
+	}
+
+	if (pos > ref_dict->ambig_base) {
+		fprintf(stderr, "Dictionary has position %lu, past its largest (%lu)\n", pos, ref_dict->ambig_base);
+		exit(EXIT_FAILURE);
+	}
+	return pos;
+}
+
+static void aux_set_offset(struct aux_table *aux, const size_t row, const size_t offset)
+{
+	aux->offsets[row] = (uint32_t)offset;
+	if (aux->offsets_hi != NULL)
+		aux->offsets_hi[row] = offset >> 32;
+}
+
+/*
+ * Reads the aux table of a dictionary, whose header is `h`, into `aux`
+ * (see `struct aux_table`), raising `max_pos` (unless NULL) to its largest
+ * position.
+ *
+ * Files before version 3 don't record how many positions their padded
+ * rows hold, so room is made for full rows (as `dict_bytes` counts them)
+ * and the table keeps what they turn out to hold.
+ */
+static void load_aux_table(FILE *dict_file, const struct dict_header *h, const bool snp, HugeMem *mem,
+                           const char *name, struct aux_table *aux, pos_t *max_pos)
+{
+	const bool wide = h->flags & DICT_FLAG_WIDE_POS;
+	const size_t rows = h->aux_size;
+
+	AuxReader reader;
+	aux_reader_init(&reader, dict_file, h, snp);
+	pos_t *row_pos = malloc(h->max_positions * sizeof(*row_pos));
+	snp_info *row_snps = malloc(h->max_positions * sizeof(*row_snps));
+	assert(row_pos && row_snps);
+
+	const size_t size = (h->version >= 3) ? h->aux_positions : rows * AUX_TABLE_COLS;
+
+	aux->rows = rows;
+	aux->size = size;
+	aux->offsets = hugemem_alloc(mem, (rows + 1) * sizeof(*aux->offsets), name);
+	aux->offsets_hi = NULL;
+	if (size >= POS_NARROW_LIMIT) {
+		aux->offsets_hi = hugemem_alloc(mem, (rows + 1) * sizeof(*aux->offsets_hi), name);
+	}
+	aux->pos = hugemem_alloc(mem, size * sizeof(*aux->pos), name);
+	aux->pos_hi = NULL;
+	if (wide) {
+		aux->pos_hi = hugemem_alloc(mem, size * sizeof(*aux->pos_hi), name);
+	}
+	aux->snps = NULL;
+	if (snp) {
+		aux->snps = hugemem_alloc(mem, size * sizeof(*aux->snps), name);
+	}
+
+	size_t k = 0;
+	for (size_t i = 0; i < rows; i++) {
+		const size_t n = aux_read_row(&reader, row_pos, row_snps);
+
+		if (k + n > size) {
+			fprintf(stderr, "Dictionary has more aux table positions than its header records (%lu)\n", size);
+			exit(EXIT_FAILURE);
+		}
+
+		aux_set_offset(aux, i, k);
+		for (size_t j = 0; j < n; j++, k++) {
+			aux->pos[k] = (uint32_t)row_pos[j];
+			if (wide)
+				aux->pos_hi[k] = row_pos[j] >> 32;
+			if (snp)
+				aux->snps[k] = row_snps[j];
+
+			if (max_pos != NULL && row_pos[j] > *max_pos)
+				*max_pos = row_pos[j];
+		}
+	}
+	aux_set_offset(aux, rows, k);
+	assert(h->version < 3 || k == size);
+	aux->size = k;
+
+	free(row_pos);
+	free(row_snps);
+}
+
+/*
+ * Reads the reference and SNP dictionaries into `lk`, and sets up `pileup`
+ * with the SNP positions (and their bases and frequencies) of the SNP
+ * dictionary. The pileup layout and jumpgate widths are those of `plan`,
+ * or if that is NULL, the defaults.
+ */
+static void load_dicts(FILE *refdict_file, FILE *snpdict_file, const struct mem_plan *plan, HugeMem *mem,
+                       struct lookup *lk, struct pileup *pileup)
+{
+	struct ref_dict *ref_dict = &lk->ref_dict;
+	struct snp_dict *snp_dict = &lk->snp_dict;
+	struct pileup_entry *pileup_table = NULL;
+
+	size_t last_hi;
+	pos_t max_pos = 0;
+
+	/* === Reference Dictionary Construction === */
+	struct dict_header ref_header;
+	read_dict_header(refdict_file, &ref_header);
+	dict_check_kind(&ref_header, false);
+	const size_t ref_dict_size = ref_header.size;
+	const bool ref_wide = ref_header.flags & DICT_FLAG_WIDE_POS;
+
+	const bool ref_packed = plan ? plan->ref_packed : REF_PACKED;
+
+	ref_dict->size = ref_dict_size;
+	ref_dict->jumpgate_bits = plan ? plan->ref_jumpgate_bits : dict_jumpgate_bits(&ref_header);
+	ref_dict->key_hi_bytes = ref_packed ? KEYS_PACKED : key_hi_bytes_for(ref_dict->jumpgate_bits);
+	ref_dict->n_jumpgate_wraps = 0;
+	const unsigned ref_key_bits = 64 - ref_dict->jumpgate_bits;
+	const size_t ref_buckets = 1UL << ref_dict->jumpgate_bits;
+	ref_dict->jumpgate = hugemem_alloc(mem, (ref_buckets + 1) * sizeof(*ref_dict->jumpgate), "ref jumpgate");
+	ref_dict->keys = NULL;
+	ref_dict->keys_hi = NULL;
+	ref_dict->pos = NULL;
+	ref_dict->pos_hi = NULL;
+	ref_dict->ambig_flags = NULL;
+	ref_dict->packed_keys = NULL;
+	ref_dict->packed_values = NULL;
+	ref_dict->value_bits = 0;
+	ref_dict->ambig_base = 0;
+	if (ref_packed) {
+		ref_dict->value_bits = ref_value_bits(&ref_header);
+		ref_dict->ambig_base = ref_ambig_base(&ref_header);
+		ref_dict->packed_keys = hugemem_alloc(mem, packed_bytes(ref_dict_size, ref_key_bits), "ref keys");
+		ref_dict->packed_values = hugemem_alloc(mem, packed_bytes(ref_dict_size, ref_dict->value_bits), "ref positions");
+	} else {
+		ref_dict->keys = hugemem_alloc(mem, ref_dict_size * sizeof(*ref_dict->keys), "ref keys");
+		if (ref_dict->key_hi_bytes) {
+			ref_dict->keys_hi = hugemem_alloc(mem, ref_dict_size * ref_dict->key_hi_bytes, "ref keys");
+		}
+		ref_dict->pos = hugemem_alloc(mem, ref_dict_size * sizeof(*ref_dict->pos), "ref positions");
+		if (ref_wide) {
+			ref_dict->pos_hi = hugemem_alloc(mem, ref_dict_size * sizeof(*ref_dict->pos_hi), "ref positions");
+		}
+		ref_dict->ambig_flags = hugemem_alloc(mem, ref_dict_size * sizeof(*ref_dict->ambig_flags), "ref flags");
+	}
+
+	ref_dict->jumpgate[0] = 0;
+	last_hi = 0;
+	for (size_t i = 0; i < ref_dict_size; i++) {
+		const kmer_t kmer = read_uint64(refdict_file);
+		const pos_t pos = read_pos(refdict_file, ref_wide);
+		const uint8_t ambig_flag = read_uint8(refdict_file);
+
+		if (ref_packed) {
+			packed_set(ref_dict->packed_keys, ref_key_bits, i, dict_lo_key(kmer, ref_key_bits));
+			packed_set(ref_dict->packed_values, ref_dict->value_bits, i, ref_packed_value(ref_dict, &ref_header, pos, ambig_flag));
+		} else {
+			ref_dict->keys[i] = LO(kmer);
+			dict_set_key_hi(ref_dict->keys_hi, ref_dict->key_hi_bytes, i, dict_lo_key(kmer, ref_key_bits));
+			ref_dict->pos[i] = (uint32_t)pos;
+			if (ref_wide)
+				ref_dict->pos_hi[i] = pos >> 32;
+			ref_dict->ambig_flags[i] = ambig_flag;
+		}
+
+		/* ambiguous entries hold aux table indices (or `POS_AMBIGUOUS`) */
+		if (ambig_flag == FLAG_UNAMBIGUOUS && pos > max_pos)
+			max_pos = pos;
+
+		const size_t hi = kmer >> ref_key_bits;
+
+		if (hi != last_hi) {
 #if DEBUG
-						else {
-							++non_ref_or_alt_covs;
-						}
-#endif
-					}
-#if DEBUG && !PCOMPACT
-					else {
-						assert(p->ref == 0 && p->alt == 0);
-					}
+			assert(hi > last_hi);
 #endif
+			for (size_t j = (last_hi + 1); j <= hi; j++)
+				jumpgate_set(ref_dict->jumpgate, ref_dict->jumpgate_wraps, &ref_dict->n_jumpgate_wraps, j, i);
+
+			last_hi = hi;
+		}
+	}
+
+	/* including the final entry */
+	for (size_t j = (last_hi + 1); j <= ref_buckets; j++)
+		jumpgate_set(ref_dict->jumpgate, ref_dict->jumpgate_wraps, &ref_dict->n_jumpgate_wraps, j, ref_dict_size);
+
+	load_aux_table(refdict_file, &ref_header, false, mem, "ref aux table", &lk->ref_aux, &max_pos);
+
+	read_dict_sections(refdict_file, &ref_dict->filter, &ref_dict->halves, NULL, mem);
+
+	/* === Pileup Table Initialization === */
+	/*
+	 * We assume that the maximum position encountered in the
+	 * reference dictionary will not be smaller than the
+	 * maximum position that will be encountered in the SNP
+	 * dictionary. If not, we will reallocate our pileup table.
+	 */
+	pileup->compact = plan ? plan->compact : PCOMPACT;
+	size_t pileup_size = (size_t)max_pos + 32 + 1;
+	if (!pileup->compact)
+		pileup_table = hugemem_alloc(mem, pileup_size * sizeof(*pileup_table), "pileup table");
+
+	/* === SNP Dictionary Construction === */
+	struct dict_header snp_header;
+	read_dict_header(snpdict_file, &snp_header);
+	dict_check_kind(&snp_header, true);
+	const size_t snp_dict_size = snp_header.size;
+	const bool snp_wide = snp_header.flags & DICT_FLAG_WIDE_POS;
+
+	/* sized for the sites estimated from the SNP k-mers, as for the memory budget */
+	if (pileup->compact)
+		ptable_init(&pileup->ptable, ptable_size_for(snp_dict_size / SNP_KMERS_PER_SITE));
+
+	snp_dict->size = snp_dict_size;
+	snp_dict->jumpgate_bits = plan ? plan->snp_jumpgate_bits : dict_jumpgate_bits(&snp_header);
+	snp_dict->key_hi_bytes = key_hi_bytes_for(snp_dict->jumpgate_bits);
+	snp_dict->n_jumpgate_wraps = 0;
+	const unsigned snp_key_bits = 64 - snp_dict->jumpgate_bits;
+	const size_t snp_buckets = 1UL << snp_dict->jumpgate_bits;
+	snp_dict->jumpgate = hugemem_alloc(mem, (snp_buckets + 1) * sizeof(*snp_dict->jumpgate), "SNP jumpgate");
+	snp_dict->keys = hugemem_alloc(mem, snp_dict_size * sizeof(*snp_dict->keys), "SNP keys");
+	snp_dict->keys_hi = NULL;
+	if (snp_dict->key_hi_bytes) {
+		snp_dict->keys_hi = hugemem_alloc(mem, snp_dict_size * snp_dict->key_hi_bytes, "SNP keys");
+	}
+	snp_dict->pos = hugemem_alloc(mem, snp_dict_size * sizeof(*snp_dict->pos), "SNP positions");
+	snp_dict->pos_hi = NULL;
+	if (snp_wide) {
+		snp_dict->pos_hi = hugemem_alloc(mem, snp_dict_size * sizeof(*snp_dict->pos_hi), "SNP positions");
+	}
+	snp_dict->snps = hugemem_alloc(mem, snp_dict_size * sizeof(*snp_dict->snps), "SNP info");
+	snp_dict->ambig_flags = hugemem_alloc(mem, snp_dict_size * sizeof(*snp_dict->ambig_flags), "SNP flags");
+
+	snp_dict->jumpgate[0] = 0;
+	last_hi = 0;
+	for (size_t i = 0; i < snp_dict_size; i++) {
+		const kmer_t kmer = read_uint64(snpdict_file);
+		const pos_t pos = read_pos(snpdict_file, snp_wide);
+		const snp_info snp = read_uint8(snpdict_file);
+		const uint8_t ambig_flag = read_uint8(snpdict_file);
+		const uint8_t ref_freq = read_uint8(snpdict_file);
+		const uint8_t alt_freq = read_uint8(snpdict_file);
+
+		snp_dict->keys[i] = LO(kmer);
+		dict_set_key_hi(snp_dict->keys_hi, snp_dict->key_hi_bytes, i, dict_lo_key(kmer, snp_key_bits));
+		snp_dict->pos[i] = (uint32_t)pos;
+		if (snp_wide)
+			snp_dict->pos_hi[i] = pos >> 32;
+		snp_dict->snps[i] = snp;
+		snp_dict->ambig_flags[i] = ambig_flag;
+
+		const unsigned snp_info_ref = SNP_INFO_REF(snp);
+
+		if ((snp_info_ref & BASE_N) == 0 &&  // i.e. if the reference base is A, C, G or T
+		     pos != POS_AMBIGUOUS &&
+		     ambig_flag == FLAG_UNAMBIGUOUS) {
+
+			const unsigned snp_info_pos = SNP_INFO_POS(snp);  // relative to k-mer
+			const pos_t snp_pos = pos + snp_info_pos;         // relative to reference
+
+			if (snp_pos >= pileup_size) {
+				const size_t new_size = snp_pos + 1;
+				if (!pileup->compact) {
+					printf("Re-allocing pileup table to %lu entries...\n", new_size);
+					pileup_table = hugemem_realloc(mem, pileup_table, new_size * sizeof(*pileup_table));
 				}
+				pileup_size = new_size;
 			}
-		}
 
-		for (size_t i = 0; i < n_snp_hits; i++) {
-			const uint32_t index = snp_hit_contexts[i].position;
-			index_table_clear_index(&index_table, index);
-
-			if (process_read && index == target_index) {
-				const uint32_t kmer_pos = snp_hit_contexts[i].kmer_pos;
-				const kmer_t kmer = snp_hit_contexts[i].kmer;
-				for (unsigned i = 0; i < 32; i++) {
-					const unsigned base = kmer_get_base(kmer, i);
-
-#if PCOMPACT
-					struct pileup_entry *p = ptable_get(&ptable, kmer_pos + i);
-#else
-					struct pileup_entry *p = &pileup_table[kmer_pos + i];
-#endif
+			if (pileup->compact) {
+				ptable_add(&pileup->ptable, snp_pos, snp_info_ref, kmer_get_base(kmer, snp_info_pos), ref_freq, alt_freq);
+			} else {
+				pileup_table[snp_pos].ref = snp_info_ref;
+				pileup_table[snp_pos].alt = kmer_get_base(kmer, snp_info_pos);
+				pileup_table[snp_pos].ref_freq = ref_freq;
+				pileup_table[snp_pos].alt_freq = alt_freq;
+			}
+		}
 
-					if (
-#if PCOMPACT
-					    p != NULL
-#else
-					    p->ref != p->alt
-#endif
-					   ) {
+		const size_t hi = kmer >> snp_key_bits;
 
-						if (base == p->ref) {
-#if DEBUG
-							read_good = true;
-#endif
-							if (p->ref_cnt != MAX_COV)
-								++p->ref_cnt;
-#if DEBUG
-							++ref_covs;
-#endif
-						}
-						else if (base == p->alt) {
-#if DEBUG
-							read_good = true;
-#endif
-							if (p->alt_cnt != MAX_COV)
-								++p->alt_cnt;
-#if DEBUG
-							++alt_covs;
-#endif
-						}
+		if (hi != last_hi) {
 #if DEBUG
-						else {
-							++non_ref_or_alt_covs;
-						}
-#endif
-					}
-#if DEBUG && !PCOMPACT
-					else {
-						assert(p->ref == 0 && p->alt == 0);
-					}
+			assert(hi > last_hi);
 #endif
-				}
-			}
-		}
+			for (size_t j = (last_hi + 1); j <= hi; j++)
+				jumpgate_set(snp_dict->jumpgate, snp_dict->jumpgate_wraps, &snp_dict->n_jumpgate_wraps, j, i);
 
-		if (!process_read && !revcompl) {
-			revcompl = true;
-			index_table.best = NULL;
-			index_table.ambiguous = false;
-			goto head;
+			last_hi = hi;
 		}
+	}
 
-#if DEBUG
-		if (read_good)
-			++good_reads;
-		else
-			++bad_reads;
+	/* including the final entry */
+	for (size_t j = (last_hi + 1); j <= snp_buckets; j++)
+		jumpgate_set(snp_dict->jumpgate, snp_dict->jumpgate_wraps, &snp_dict->n_jumpgate_wraps, j, snp_dict_size);
 
-		++total_count;
+	load_aux_table(snpdict_file, &snp_header, true, mem, "SNP aux table", &lk->snp_aux, NULL);
 
-		if (index_table.best) {
-			fprintf(read_data, "%s %d ", index_table.ambiguous ? "A" : "U", index_table.best->freq);
+	read_dict_sections(snpdict_file, &snp_dict->filter, &snp_dict->halves, &snp_dict->read_seeds, mem);
 
-			for (size_t i = 0; i < n_ref_hits; i++) {
-				const uint32_t index = ref_hit_contexts[i].position;
+	pileup->table = pileup_table;
+	pileup->size = pileup_size;
+}
 
-				if (index == target_index) {
-					fprintf(read_data, "%u:%s ", index, ref_hit_contexts[i].is_neighbor ? "1" : "0");
-				}
-			}
+/*
+ * Shared dictionaries (`lava load`)
+ *
+ * A segment holds the arrays of a lookup, in `lookup_arrays` order, and
+ * then the SNP positions of the pileup table, with a `struct dict_image`
+ * as its metadata. Processes that attach to it map the arrays read-only
+ * and build their own pileup table from the SNP positions, so startup
+ * costs next to nothing and any number of processes share one copy.
+ */
 
-			for (size_t i = 0; i < n_snp_hits; i++) {
-				const uint32_t index = snp_hit_contexts[i].position;
+#define DICT_IMAGE_VERSION 6
+
+/* a SNP position of the pileup table, with counts of 0 */
+struct pileup_site {
+	uint64_t pos;
+	uint8_t ref;
+	uint8_t alt;
+	uint8_t ref_freq;
+	uint8_t alt_freq;
+};
+
+struct dict_image {
+	uint64_t version;
+	struct lookup lookup;  /* with NULL pointers, since the arrays follow */
+	uint64_t pileup_size;  /* positions covered by the pileup table */
+	uint64_t n_sites;
+};
+
+/* differs between builds whose segments aren't interchangeable */
+#define DICT_IMAGE_LAYOUT (((uint64_t)DICT_IMAGE_VERSION << 48) | \
+                           (sizeof(struct dict_image) << 24) | \
+                           (sizeof(struct aux_table) << 8) | \
+                           sizeof(struct pileup_site))
+
+static void add_site(struct pileup_site **sites, size_t *n, size_t *cap,
+                     const uint64_t pos, const struct pileup_entry *e)
+{
+	if (*n == *cap) {
+		*cap = *cap ? 2 * *cap : 1024;
+		*sites = realloc(*sites, *cap * sizeof(**sites));
+		assert(*sites);
+	}
 
-				if (index == target_index) {
-					fprintf(read_data, "%u:%s ", index, snp_hit_contexts[i].is_neighbor ? "1" : "0");
-				}
+	(*sites)[(*n)++] = (struct pileup_site){.pos = pos,
+	                                        .ref = e->ref,
+	                                        .alt = e->alt,
+	                                        .ref_freq = e->ref_freq,
+	                                        .alt_freq = e->alt_freq};
+}
+
+static struct pileup_site *pileup_sites(const struct pileup *pileup, size_t *count)
+{
+	struct pileup_site *sites = NULL;
+	size_t n = 0;
+	size_t cap = 0;
+
+	if (pileup->compact) {
+		for (size_t i = 0; i < pileup->ptable.size; i++) {
+			for (const struct ptable_entry *e = pileup->ptable.table[i]; e != NULL; e = e->next) {
+				add_site(&sites, &n, &cap, e->key, &e->entry);
 			}
+		}
+	} else {
+		for (size_t i = 0; i < pileup->size; i++) {
+			const struct pileup_entry *e = &pileup->table[i];
+			if (e->ref != e->alt)
+				add_site(&sites, &n, &cap, i, e);
+		}
+	}
+
+	*count = n;
+	return sites;
+}
 
-			fprintf(read_data, "\n");
+static void pileup_from_sites(struct pileup *pileup, HugeMem *mem, const bool compact, const size_t size,
+                              const struct pileup_site *sites, const size_t n)
+{
+	pileup->compact = compact;
+	pileup->size = size;
+
+	if (compact) {
+		pileup->table = NULL;
+		ptable_init(&pileup->ptable, ptable_size_for(n));
+		for (size_t i = 0; i < n; i++) {
+			const struct pileup_site *site = &sites[i];
+			ptable_add(&pileup->ptable, site->pos, site->ref, site->alt, site->ref_freq, site->alt_freq);
 		}
+		return;
+	}
 
-		if (index_table.best != NULL && index_table.best->freq > 1 && !index_table.ambiguous) {
-			++match_count;
-		} else {
-			if (index_table.best != NULL && index_table.best->freq > 1 && index_table.ambiguous) {
-				++multi_count;
-			}
-			else {
-				++nohit_count;
+	pileup->table = hugemem_alloc(mem, size * sizeof(*pileup->table), "pileup table");
+	for (size_t i = 0; i < n; i++) {
+		const struct pileup_site *site = &sites[i];
+		struct pileup_entry *e = &pileup->table[site->pos];
+		e->ref = site->ref;
+		e->alt = site->alt;
+		e->ref_freq = site->ref_freq;
+		e->alt_freq = site->alt_freq;
+	}
+}
+
+/* sets all counts of `pileup` back to 0, for the next sample */
+static void pileup_reset(struct pileup *pileup)
+{
+	if (pileup->compact) {
+		for (size_t i = 0; i < pileup->ptable.size; i++) {
+			for (struct ptable_entry *e = pileup->ptable.table[i]; e != NULL; e = e->next) {
+				e->entry.ref_cnt = 0;
+				e->entry.alt_cnt = 0;
 			}
 		}
-#endif
+		return;
+	}
 
-		nohit:
-		index_table.best = NULL;
-		index_table.ambiguous = false;
+	for (size_t i = 0; i < pileup->size; i++) {
+		struct pileup_entry *e = &pileup->table[i];
+		e->ref_cnt = 0;
+		e->alt_cnt = 0;
 	}
+}
 
-#if DEBUG
-	fclose(read_data);
-#endif
+/* makes `dst` a copy of `src`, e.g. for genotyping another sample concurrently */
+static void pileup_clone(struct pileup *dst, const struct pileup *src, HugeMem *mem)
+{
+	size_t n_sites;
+	struct pileup_site *sites = pileup_sites(src, &n_sites);
+	pileup_from_sites(dst, mem, src->compact, src->size, sites, n_sites);
+	free(sites);
+}
 
-	size_t ref_call_count = 0;
-	size_t alt_call_count = 0;
-	size_t het_call_count = 0;
+static void pileup_dealloc(struct pileup *pileup, HugeMem *mem)
+{
+	if (pileup->compact)
+		ptable_dealloc(&pileup->ptable);
+	else
+		hugemem_free(mem, pileup->table);
+	pileup->table = NULL;
+	pileup->size = 0;
+}
 
-#if PCOMPACT
-	struct pileup_entry **table = ptable.table;
-	const size_t pileup_size = ptable.size;
-#endif
+/* publishes `lk` and the SNP positions of `pileup` as segment `name` */
+static void publish_dicts(const char *name, struct lookup *lk, const struct pileup *pileup)
+{
+	struct lookup_array arrays[LOOKUP_MAX_ARRAYS];
+	const size_t n_arrays = lookup_arrays(lk, arrays);
+	void *data[LOOKUP_MAX_ARRAYS + 1];
+	size_t sizes[LOOKUP_MAX_ARRAYS + 1];
+
+	for (size_t i = 0; i < n_arrays; i++) {
+		data[i] = arrays[i].size ? lookup_array_get(&arrays[i]) : NULL;
+		sizes[i] = arrays[i].size;
+	}
 
-	for (size_t i = 0; i < pileup_size; i++) {
-#if PCOMPACT
-		for (struct pileup_entry *p = table[i]; p != NULL; p = p->next) {
-#else
-		struct pileup_entry *p = &pileup_table[i];
-#endif
+	size_t n_sites;
+	struct pileup_site *sites = pileup_sites(pileup, &n_sites);
+	data[n_arrays] = sites;
+	sizes[n_arrays] = n_sites * sizeof(*sites);
 
-			if (p->ref == p->alt) {
-				continue;  // no SNP here
-			}
+	struct dict_image image = {.version = DICT_IMAGE_VERSION,
+	                           .lookup = *lk,
+	                           .pileup_size = pileup->size,
+	                           .n_sites = n_sites};
 
-#if PCOMPACT
-			size_t index = p->key;
-#else
-			size_t index = i;
-#endif
+	const size_t n = lookup_arrays(&image.lookup, arrays);
+	for (size_t i = 0; i < n; i++) {
+		lookup_array_set(&arrays[i], NULL);
+	}
 
-			/* index w.r.t. correct chromosome */
-			size_t j;
-			for (j = 0; j < num_chrs && index > chrlens[j].len; j++) {
-				index -= chrlens[j].len;
-			}
+	segment_publish(name, DICT_IMAGE_LAYOUT, &image, sizeof(image), data, sizes, n_arrays + 1);
+	free(sites);
+}
+
+/*
+ * Points `lk` at the arrays of segment `name`, and returns its SNP
+ * positions (`n_sites` of them, over a pileup table of `pileup_size`
+ * positions), from which each process builds its own pileup table. The
+ * arrays are mapped read-only.
+ */
+static const struct pileup_site *attach_dicts(const char *name, Segment *segment, struct lookup *lk,
+                                              size_t *pileup_size, size_t *n_sites)
+{
+	segment_attach(segment, name, DICT_IMAGE_LAYOUT);
+	const struct dict_image *image = segment_meta(segment, sizeof(*image));
+	assert(image->version == DICT_IMAGE_VERSION);
 
-			const struct call call = choose_best_genotype(p->ref_cnt, p->alt_cnt, p->ref_freq, p->alt_freq);
+	*lk = image->lookup;
 
-			switch (call.genotype) {
-			case GTYPE_NONE:
-				break;
-			case GTYPE_REF:
-				++ref_call_count;
-				break;
-			case GTYPE_ALT:
-				++alt_call_count;
-				fprintf(out, "%s %lu %.15g\n", chrlens[j].name, index, call.confidence);
-				break;
-			case GTYPE_HET:
-				++het_call_count;
-				fprintf(out, "%s %lu %.15g\n", chrlens[j].name, index, call.confidence);
-				break;
-			}
+	struct lookup_array arrays[LOOKUP_MAX_ARRAYS];
+	const size_t n = lookup_arrays(lk, arrays);
 
-#if PCOMPACT
-		}
-#endif
+	for (size_t i = 0; i < n; i++) {
+		size_t size;
+		const void *p = segment_array(segment, i, &size);
+
+		/* optional arrays (computed as empty while their pointers are NULL) take the segment's size */
+		assert(size == arrays[i].size || arrays[i].size == 0);
+		lookup_array_set(&arrays[i], (void *)p);
 	}
 
-	end = clock();
-	time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
-	printf("Time: %f sec\n", time_spent);
+	size_t size;
+	const struct pileup_site *sites = segment_array(segment, n, &size);
+	assert(size == image->n_sites * sizeof(*sites));
 
-#if DEBUG
-	/*
-	static const char bases[] = {'A', 'C', 'G', 'T'};
-	FILE *counts = fopen("counts.txt", "w");
-	FILE *all_snps = fopen("all_snps.txt", "w");
-	for (size_t i = 0; i < pileup_size; i++) {
-		struct pileup_entry *p = &pileup_table[i];
-		if (p->ref == p->alt) {
-			assert(p->ref == 0 && p->alt == 0);
-			continue;  // no SNP here
-		}
+	*pileup_size = image->pileup_size;
+	*n_sites = image->n_sites;
+	return sites;
+}
+
+void lava_dicts_publish(FILE *refdict_file, FILE *snpdict_file, const char *name)
+{
+	const MemOptions mem_opts = {.hugetlb = false, .prefault = false, .lock = false, .threads = 1, .interleave = NULL};
+	HugeMem mem;
+	hugemem_init(&mem, &mem_opts);
 
-		size_t index = i;
+	struct lookup lk;
+	struct pileup pileup;
+	load_dicts(refdict_file, snpdict_file, NULL, &mem, &lk, &pileup);
+	publish_dicts(name, &lk, &pileup);
 
-		// index w.r.t. correct chromosome
-		size_t j;
-		for (j = 0; j < num_chrs && index > chrlens[j].len; j++) {
-			index -= chrlens[j].len;
+	fprintf(stderr, "Loaded dictionaries into segment %s (%.2f GiB)\n", name, lookup_bytes(&lk)/(double)(1UL << 30));
+
+	lookup_release(&lk, &mem);
+	pileup_dealloc(&pileup, &mem);
+	hugemem_dealloc(&mem);
+}
+
+/*
+ * Genotyping (see `liblava.h`)
+ *
+ * A `LavaDicts` holds everything that is loaded once and then shared by
+ * any number of samples: the contig table, the dictionaries (possibly
+ * replicated per NUMA node) and the calling tables. Each sample needs only
+ * a pileup table. The first sample takes over the pileup table built while
+ * loading; later ones get copies of it.
+ */
+struct lava_dicts {
+	ContigTable contigs;
+	Topology topo;
+	NumaPolicy numa;
+	HugeMem mem;  /* backs the dictionary arrays and the pileup tables */
+	bool from_segment;
+	Segment segment;
+	struct lookup base;
+	struct lookup *lookups;  /* the one used by workers on each node */
+	bool replicated;
+	struct mem_plan plan;
+	struct pileup pileup;    /* as loaded, i.e. with all counts 0 until a sample takes it */
+	bool pileup_taken;
+	bool pileup_dirty;       /* counts need resetting before the next sample takes it */
+	CallTables *call_tables;
+	pthread_mutex_t lock;    /* guards `mem` and `pileup` once loaded */
+};
+
+struct lava_sample {
+	LavaDicts *dicts;
+	struct pileup pileup;
+	bool owns_pileup;  /* i.e. it isn't the dictionaries' own */
+	PerfStats *perf;   /* NULL unless stages are being measured */
+	struct read_stats stats;  /* of freed workers */
+};
+
+/*
+ * Prints the memory taken by each structure of `d` (arrays of the same
+ * name are added up) and returns the total, not counting dictionaries
+ * shared in a segment. Every sample genotyped at a time has its own copy
+ * of the pileup table.
+ */
+static size_t memory_report(LavaDicts *d, FILE *out)
+{
+	const MemOptions *opts = &d->mem.opts;
+	const struct mem_plan *plan = &d->plan;
+	struct lookup_array arrays[LOOKUP_MAX_ARRAYS];
+	const size_t n = lookup_arrays(&d->base, arrays);
+	size_t total = 0;
+
+	fprintf(out, "Memory (%s pileup table", plan->compact ? "compact" : "dense");
+	if (!d->from_segment)
+		fprintf(out, ", jumpgates of %u and %u bits", plan->ref_jumpgate_bits, plan->snp_jumpgate_bits);
+	if (d->base.ref_dict.key_hi_bytes == KEYS_PACKED)
+		fprintf(out, ", packed ref dictionary");
+	fprintf(out, "):\n");
+
+	for (size_t i = 0; i < n; i++) {
+		bool seen = false;
+		for (size_t j = 0; j < i; j++) {
+			if (STREQ(arrays[j].name, arrays[i].name))
+				seen = true;
 		}
+		if (seen)
+			continue;
 
-		if (p->ref_cnt != 0 || p->alt_cnt != 0) {
-			fprintf(counts, "%s %lu (%c:%f / %c:%f) : %u / %u\n",
-			                chrlens[j].name,
-			                index,
-			                bases[p->ref],
-			                p->ref_freq/255.0f,
-			                bases[p->alt],
-			                p->alt_freq/255.0f,
-			                p->ref_cnt,
-			                p->alt_cnt);
+		size_t bytes = 0;
+		for (size_t j = i; j < n; j++) {
+			if (STREQ(arrays[j].name, arrays[i].name))
+				bytes += arrays[j].size;
 		}
-		fprintf(all_snps, "%s %lu\n", chrlens[j].name, index);
+		if (bytes == 0)
+			continue;
+
+		fprintf(out, "  %-16s %10.1f MiB%s\n", arrays[i].name, mib(bytes), d->from_segment ? " (shared)" : "");
+		if (!d->from_segment)
+			total += bytes;
 	}
 
-	fclose(all_snps);
-	fclose(counts);
-	*/
+	const size_t pileup = pileup_bytes(&d->pileup);
+	fprintf(out, "  %-16s %10.1f MiB", "pileup table", mib(pileup));
+	if (opts->samples > 1)
+		fprintf(out, " (x %u samples)", opts->samples);
+	fprintf(out, "\n");
+	fprintf(out, "  %-16s %10.1f MiB\n", "workers", mib(plan->other_bytes));
+	total += opts->samples * pileup + plan->other_bytes;
 
-	printf("Total: %lu\n", total_count);
-	printf("Match: %lu\n", match_count);
-	printf("Multi: %lu\n", multi_count);
-	printf("NoHit: %lu\n", nohit_count);
-	printf("\n");
-	printf("Unambig. hits: %lu\n", unambig_hits);
-	printf("Ambig. hits:   %lu\n", ambig_hits);
-	printf("\n");
-	printf("Good reads: %lu\n", good_reads);
-	printf("Bad reads: %lu\n", bad_reads);
-	printf("\n");
-	printf("Ref calls: %lu\n", ref_call_count);
-	printf("Alt calls: %lu\n", alt_call_count);
-	printf("Het calls: %lu\n", het_call_count);
-	printf("\n");
-	printf("Ref covs:         %lu\n", ref_covs);
-	printf("Alt covs:         %lu\n", alt_covs);
-	printf("Non ref/alt covs: %lu\n", non_ref_or_alt_covs);
-#endif
+	fprintf(out, "  %-16s %10.1f MiB", "total", mib(total));
+	if (opts->max_mem > 0)
+		fprintf(out, " (budget: %.1f MiB)", mib(opts->max_mem));
+	fprintf(out, "\n");
 
-	free(ref_jumpgate);
-	free(ref_dict);
-	free(ref_aux_table);
-	free(snp_jumpgate);
-	free(snp_dict);
-	free(snp_aux_table);
-
-#if PCOMPACT
-	ptable_dealloc(&ptable);
-#else
-	free(pileup_table);
-#endif
+	return total;
 }
 
-static inline struct call choose_best_genotype(const int ref_cnt,
-                                               const int alt_cnt,
-                                               const uint8_t ref_freq_enc,
-                                               const uint8_t alt_freq_enc)
+static LavaDicts *dicts_init(FILE *refdict_file,
+                             FILE *snpdict_file,
+                             const char *segment_name,
+                             FILE *chrlens_file,
+                             const MemOptions *mem_opts,
+                             const NumaPolicy numa)
 {
-	static struct {
-		double g0;  // P(counts|G0)/(ref_cnt + alt_cnt choose ref_cnt)
-		double g1;  // P(counts|G1)/(ref_cnt + alt_cnt choose ref_cnt)
-		double g2;  // P(counts|G2)/(ref_cnt + alt_cnt choose ref_cnt)
-	} cache[MAX_COV + 1][MAX_COV + 1];
+	LavaDicts *d = malloc(sizeof(*d));
+	assert(d);
+
+	/* Load chrlens file */
+	contig_table_init(&d->contigs);
+	contig_table_load(&d->contigs, chrlens_file);
 
-	static double poisson[2*MAX_COV + 1];
+	/* NUMA placement is a no-op on single-node machines */
+	topology_init(&d->topo);
+	d->numa = (d->topo.n_nodes <= 1) ? NUMA_OFF : numa;
 
-	static bool init = false;
+	MemOptions opts = *mem_opts;
+	if (d->numa != NUMA_OFF)
+		opts.interleave = &d->topo;
+	if (opts.samples == 0)
+		opts.samples = 1;
+	hugemem_init(&d->mem, &opts);
 
-	if (!init) {
-		for (int ref_cnt = 0; ref_cnt <= MAX_COV; ref_cnt++) {
-			for (int alt_cnt = 0; alt_cnt <= MAX_COV; alt_cnt++) {
-				cache[ref_cnt][alt_cnt].g0 = pow(1.0 - ERR_RATE, ref_cnt) * pow(ERR_RATE, alt_cnt);
-				cache[ref_cnt][alt_cnt].g1 = pow(0.5, ref_cnt + alt_cnt);
-				cache[ref_cnt][alt_cnt].g2 = pow(ERR_RATE, ref_cnt) * pow(1.0 - ERR_RATE, alt_cnt);
-			}
-		}
+	fprintf(stderr, "Initializing...\n");
 
-		const double M = exp(-AVG_COV);
-		for (int i = 0; i <= (2*MAX_COV); i++) {
-			poisson[i] = (M*pow(AVG_COV, i))/exp(lgamma(i+1.0));
+	/* the memory plan comes first, so that we fail before loading anything if it doesn't fit */
+	d->from_segment = (segment_name != NULL);
+	if (d->from_segment) {
+		size_t pileup_size, n_sites;
+		const struct pileup_site *sites = attach_dicts(segment_name, &d->segment, &d->base, &pileup_size, &n_sites);
+		plan_memory(&opts, NULL, NULL, pileup_size, n_sites, &d->plan);
+		pileup_from_sites(&d->pileup, &d->mem, d->plan.compact, pileup_size, sites, n_sites);
+	} else {
+		struct dict_shape ref_shape, snp_shape;
+		if (dict_shape_read(refdict_file, false, &ref_shape) && dict_shape_read(snpdict_file, true, &snp_shape)) {
+			/* the dense table covers the genome (see `load_dicts`); the sites are an estimate */
+			const size_t genome_len = d->contigs.count ? d->contigs.ends[d->contigs.count - 1] : 0;
+			plan_memory(&opts, &ref_shape, &snp_shape, genome_len + 32 + 1,
+			            snp_shape.header.size / SNP_KMERS_PER_SITE, &d->plan);
+			load_dicts(refdict_file, snpdict_file, &d->plan, &d->mem, &d->base, &d->pileup);
+		} else {
+			/* piped dictionaries can only be read once, so they keep their layouts and the plan is what was loaded */
+			if (opts.max_mem > 0)
+				fprintf(stderr, "Dictionaries read from a pipe can't be planned; the memory budget is checked once they are loaded\n");
+			load_dicts(refdict_file, snpdict_file, NULL, &d->mem, &d->base, &d->pileup);
+			d->plan.compact = d->pileup.compact;
+			d->plan.ref_packed = (d->base.ref_dict.key_hi_bytes == KEYS_PACKED);
+			d->plan.ref_jumpgate_bits = d->base.ref_dict.jumpgate_bits;
+			d->plan.snp_jumpgate_bits = d->base.snp_dict.jumpgate_bits;
+			d->plan.dict_bytes = lookup_bytes(&d->base);
+			d->plan.pileup_bytes = pileup_bytes(&d->pileup);
+			d->plan.other_bytes = workers_bytes(&opts);
 		}
-
-		init = true;
 	}
+	d->pileup_taken = false;
+	d->pileup_dirty = false;
+
+	const size_t total_bytes = memory_report(d, stderr);
+	hugemem_report(&d->mem, stderr);
 
-	if ((ref_cnt == 0 && alt_cnt == 0) || (ref_cnt == MAX_COV && alt_cnt == MAX_COV)) {
-		return CALL(GTYPE_NONE, 0.0);
+	if (opts.max_mem > 0 && total_bytes > opts.max_mem) {
+		fprintf(stderr, "Memory budget of %.1f MiB exceeded once loaded (%.1f MiB)\n", mib(opts.max_mem), mib(total_bytes));
+		exit(EXIT_FAILURE);
 	}
 
-	const double g0 = cache[ref_cnt][alt_cnt].g0;
-	const double g1 = cache[ref_cnt][alt_cnt].g1;
-	const double g2 = cache[ref_cnt][alt_cnt].g2;
+	/* === NUMA Placement === */
+	const unsigned n_lookups = (d->numa == NUMA_OFF) ? 1 : d->topo.n_nodes;
+	d->lookups = malloc(n_lookups * sizeof(*d->lookups));
+	assert(d->lookups);
+	d->replicated = false;
 
-	const double p = ref_freq_enc/255.0;
-	const double q = alt_freq_enc/255.0;
-	const double p2 = p*p;
-	const double q2 = q*q;
+	for (unsigned node = 0; node < n_lookups; node++) {
+		d->lookups[node] = d->base;
+	}
 
-	const double p_g0 = p2*g0;
-	const double p_g1 = (1.0 - p2 - q2)*g1;
-	const double p_g2 = q2*g2;
-	const double total = p_g0 + p_g1 + p_g2;
+	/* replicas are private copies, which take the place of the loaded dictionaries */
+	const size_t replica_bytes = d->topo.n_nodes * lookup_bytes(&d->base) - (d->from_segment ? 0 : lookup_bytes(&d->base));
+	if (d->numa == NUMA_REPLICATE && opts.max_mem > 0 && total_bytes + replica_bytes > opts.max_mem) {
+		fprintf(stderr, "NUMA: replicating the dictionaries would exceed the memory budget; interleaving instead\n");
+		d->numa = NUMA_INTERLEAVE;
+	}
 
-	const int n = ref_cnt + alt_cnt;
+	if (d->numa == NUMA_REPLICATE) {
+		if (replicas_fit(&d->base, &d->topo)) {
+			for (unsigned node = 0; node < n_lookups; node++) {
+				lookup_replicate(&d->lookups[node], &d->mem, &d->topo, node);
+			}
+			/* workers only use the replicas from here on */
+			if (d->from_segment)
+				segment_detach(&d->segment);
+			else
+				lookup_release(&d->base, &d->mem);
+			d->replicated = true;
+			fprintf(stderr, "NUMA: dictionaries replicated on %u nodes\n", d->topo.n_nodes);
+		} else {
+			fprintf(stderr, "NUMA: not enough free memory to replicate dictionaries; interleaving instead\n");
+			d->numa = NUMA_INTERLEAVE;
+		}
+	}
 
-	if (p_g0 > p_g1 && p_g0 > p_g2) {
-		return CALL(GTYPE_REF, ((double)(p_g0/total))*poisson[n]);
-	} else if (p_g1 > p_g0 && p_g1 > p_g2) {
-		return CALL(GTYPE_HET, ((double)(p_g1/total))*poisson[n]);
-	} else {
-		return CALL(GTYPE_ALT, ((double)(p_g2/total))*poisson[n]);
+	if (d->numa == NUMA_INTERLEAVE) {
+		fprintf(stderr, "NUMA: memory interleaved over %u nodes\n", d->topo.n_nodes);
 	}
-}
 
+	d->call_tables = malloc(sizeof(*d->call_tables));
+	assert(d->call_tables);
+	call_tables_init(d->call_tables);
 
-/* === Front-End === */
+	assert(pthread_mutex_init(&d->lock, NULL) == 0);
+	return d;
+}
 
-static void print_help(void)
+LavaDicts *lava_dicts_load(FILE *refdict_file,
+                           FILE *snpdict_file,
+                           FILE *chrlens_file,
+                           const MemOptions *mem_opts,
+                           const NumaPolicy numa)
 {
-	fprintf(stderr, "Usage: lava <option> [option parameters ...]\n");
-	fprintf(stderr, "Option  Description                   Parameters\n");
-	fprintf(stderr, "------  -----------                   ----------\n");
-	fprintf(stderr, "dict    Generate dictionary files     "
-	                "<input FASTA> <input SNPs> <output ref dict> <output SNP dict>\n");
-	fprintf(stderr, "filt    Filter reference dictionary   "
-		            "<ref dict> <snp_pos file> <output ref dict>\n");
-	fprintf(stderr, "lava    Perform genotyping            "
-	                "<input ref dict> <input SNP dict> <input FASTQ> <chrlens file> <output file>\n");
+	return dicts_init(refdict_file, snpdict_file, NULL, chrlens_file, mem_opts, numa);
 }
 
-static void arg_check(int argc, int expected)
+LavaDicts *lava_dicts_attach(const char *segment_name,
+                             FILE *chrlens_file,
+                             const MemOptions *mem_opts,
+                             const NumaPolicy numa)
 {
-	if (argc - 2 != expected) {  /* -2 because option params start at argv[2] */
-		print_help();
-		exit(EXIT_FAILURE);
+	return dicts_init(NULL, NULL, segment_name, chrlens_file, mem_opts, numa);
+}
+
+void lava_dicts_free(LavaDicts *d)
+{
+	assert(!d->pileup_taken);
+
+	if (!d->replicated) {
+		if (d->from_segment)
+			segment_detach(&d->segment);
+		else
+			lookup_release(&d->base, &d->mem);
 	}
+
+	pthread_mutex_destroy(&d->lock);
+	pileup_dealloc(&d->pileup, &d->mem);
+	free(d->lookups);
+	free(d->call_tables);
+	contig_table_dealloc(&d->contigs);
+	topology_dealloc(&d->topo);
+	hugemem_dealloc(&d->mem);  /* dictionary arrays and the pileup tables */
+	free(d);
 }
 
-int main(const int argc, const char *argv[])
+LavaSample *lava_sample_new(LavaDicts *d)
 {
-	if (argc < 2) {
-		print_help();
-		exit(EXIT_FAILURE);
+	LavaSample *s = malloc(sizeof(*s));
+	assert(s);
+	s->dicts = d;
+	s->perf = NULL;
+	memset(&s->stats, 0, sizeof(s->stats));
+
+	assert(pthread_mutex_lock(&d->lock) == 0);
+
+	if (!d->pileup_taken) {
+		if (d->pileup_dirty)
+			pileup_reset(&d->pileup);
+		s->pileup = d->pileup;
+		s->owns_pileup = false;
+		d->pileup_taken = true;
+	} else {
+		pileup_clone(&s->pileup, &d->pileup, &d->mem);
+		s->owns_pileup = true;
 	}
 
-	const char *opt = argv[1];
+	assert(pthread_mutex_unlock(&d->lock) == 0);
+	return s;
+}
 
-	if (STREQ(opt, "dict")) {
-		arg_check(argc, 4);
-		const char *ref_filename = argv[2];
-		const char *snp_filename = argv[3];
-		const char *refdict_filename = argv[4];
-		const char *snpdict_filename = argv[5];
+void lava_sample_reset(LavaSample *s)
+{
+	pileup_reset(&s->pileup);
+	memset(&s->stats, 0, sizeof(s->stats));
+}
 
-		SeqVec ref = parse_fasta(ref_filename);
+void lava_sample_set_perf(LavaSample *s, PerfStats *perf)
+{
+	s->perf = perf;
+}
 
-#define CHRLENS_EXT ".chrlens"
-		char chrlens_filename[4096];
-		assert(strlen(ref_filename) < (sizeof(chrlens_filename) - strlen(CHRLENS_EXT)));
-		sprintf(chrlens_filename, "%s" CHRLENS_EXT, ref_filename);
-		FILE *chrlens = fopen(chrlens_filename, "w");
-		assert(chrlens);
-#undef CHRLENS_EXT
+void lava_sample_stats(const LavaSample *s, LavaStats *stats)
+{
+	const struct read_stats *r = &s->stats;
+	stats->reads = r->total_count;
+	stats->placed = r->match_count;
+	stats->multi = r->multi_count;
+	stats->skipped = r->skipped_count;
+	stats->unplaced = r->total_count - r->match_count - r->multi_count - r->skipped_count;
+	stats->informative = r->good_reads;
+	stats->unambig_hits = r->unambig_hits;
+	stats->ambig_hits = r->ambig_hits;
+	stats->ref_covs = r->ref_covs;
+	stats->alt_covs = r->alt_covs;
+	stats->other_covs = r->non_ref_or_alt_covs;
+}
 
-		for (size_t i = 0; i < ref.size; i++) {
-			fprintf(chrlens, "%s %lu\n", ref.seqs[i].name, ref.seqs[i].size);
-		}
+void lava_sample_free(LavaSample *s)
+{
+	LavaDicts *d = s->dicts;
+	assert(pthread_mutex_lock(&d->lock) == 0);
 
-		fclose(chrlens);
+	if (s->owns_pileup) {
+		pileup_dealloc(&s->pileup, &d->mem);
+	} else {
+		d->pileup = s->pileup;  /* the compact table may have been reallocated */
+		d->pileup_taken = false;
+		d->pileup_dirty = true;
+	}
 
-		FILE *snp_file = fopen(snp_filename, "r");
-		assert(snp_file);
+	assert(pthread_mutex_unlock(&d->lock) == 0);
+	free(s);
+}
 
-		FILE *snpdict_file = fopen(snpdict_filename, "wb");
-		assert(snpdict_file);
+/* the CPU for worker `index`, and the node it is on, or -1 if placement is off */
+static int worker_cpu(const LavaDicts *d, const unsigned index, unsigned *node)
+{
+	*node = 0;
+	return (d->numa == NUMA_OFF) ? -1 : topology_worker_cpu(&d->topo, index, node);
+}
 
-		bool *snp_locations;
-		size_t snp_locs_size;
-		make_snp_dict(ref, snp_file, snpdict_file, &snp_locations, &snp_locs_size);
-		assert(snp_locations);
+LavaWorker *lava_worker_new(LavaSample *s, const unsigned index)
+{
+	const LavaDicts *d = s->dicts;
+	unsigned node;
+	LavaWorker *w = malloc(sizeof(*w));
+	assert(w);
+
+	w->sample = s;
+	w->cpu = worker_cpu(d, index, &node);
+	w->lookup = &d->lookups[node];
+	w->ptable = s->pileup.compact ? &s->pileup.ptable : NULL;
+	w->pileup_table = s->pileup.table;
+	w->source = NULL;
+	w->index_table = malloc(sizeof(*w->index_table));
+	assert(w->index_table);
+	index_table_clear(w->index_table);
+	w->ref_hits_cap = READ_HITS_INIT;
+	w->snp_hits_cap = READ_HITS_INIT;
+	w->ref_hit_contexts = malloc(w->ref_hits_cap * sizeof(*w->ref_hit_contexts));
+	w->snp_hit_contexts = malloc(w->snp_hits_cap * sizeof(*w->snp_hit_contexts));
+	assert(w->ref_hit_contexts && w->snp_hit_contexts);
+	memset(&w->stats, 0, sizeof(w->stats));
+#if DEBUG
+	w->read_data = fopen("read_data.txt", "w");
+	assert(w->read_data);
+#endif
+	return w;
+}
 
-#if GEN_FLT_DATA
-		FILE *snp_locs = fopen("snp_locs", "wb");
-		assert(snp_locs);
-		serialize_uint64(snp_locs, snp_locs_size);
-		for (size_t i = 0; i < snp_locs_size; i++) {
-			serialize_uint8(snp_locs, snp_locations[i]);
-		}
-		fclose(snp_locs);
+int lava_worker_cpu(const LavaWorker *w)
+{
+	return w->cpu;
+}
+
+void lava_worker_add_read(LavaWorker *w, const char *seq)
+{
+	/* `pileup_read` wants a line (with its newline) that it may modify */
+	char *read = w->reads[0];
+	size_t len = strcspn(seq, "\n");
+	if (len > READ_BUF_SIZE - 2)
+		len = READ_BUF_SIZE - 2;
+
+	memcpy(read, seq, len);
+	read[len] = '\n';
+	read[len + 1] = '\0';
+	pileup_read(w, read);
+}
+
+void lava_worker_free(LavaWorker *w)
+{
+	LavaDicts *d = w->sample->dicts;
+	assert(pthread_mutex_lock(&d->lock) == 0);
+	read_stats_add(&w->sample->stats, &w->stats);
+	assert(pthread_mutex_unlock(&d->lock) == 0);
+#if DEBUG
+	fclose(w->read_data);
 #endif
+	free(w->index_table);
+	free(w->ref_hit_contexts);
+	free(w->snp_hit_contexts);
+	free(w);
+}
+
+struct read_thread {
+	LavaSample *sample;
+	struct read_source *source;
+	unsigned index;
+};
 
-		FILE *refdict_file = fopen(refdict_filename, "wb");
-		assert(refdict_file);
+static void *read_thread_run(void *arg)
+{
+	const struct read_thread *t = arg;
+	unsigned node;
+
+	/*
+	 * Keep to our node first, so that the worker's buffers are placed on
+	 * it. We leave the CPU within the node to the scheduler, which spreads
+	 * the workers of concurrent runs, and leave threads alone altogether
+	 * if we were confined to some CPUs (e.g. by `taskset` or a cpuset).
+	 */
+	static bool bind_failed = false;  /* so that we only warn once */
+	const LavaDicts *d = t->sample->dicts;
+	if (worker_cpu(d, t->index, &node) >= 0 && d->topo.bind && !topology_bind_node(&d->topo, node) &&
+	    !__atomic_exchange_n(&bind_failed, true, __ATOMIC_RELAXED))
+		fprintf(stderr, "Warning: could not bind threads to NUMA nodes; continuing unbound\n");
+
+	LavaWorker *w = lava_worker_new(t->sample, t->index);
+	w->source = t->source;
+
+	size_t n;
+	while ((n = read_batch(w->source, w->reads)) > 0) {
+		const uint64_t placed = w->stats.match_count;
+		for (size_t i = 0; i < n; i++) {
+			pileup_read(w, w->reads[i]);
+		}
 
-		make_ref_dict(ref, refdict_file);
+		if (w->source->progress != NULL)
+			__atomic_fetch_add(&w->source->progress->placed, w->stats.match_count - placed, __ATOMIC_RELAXED);
+	}
 
-		fclose(refdict_file);
-		free(snp_locations);
+	lava_worker_free(w);
+	return NULL;
+}
 
-		seqvec_dealloc(&ref);
-		fclose(snp_file);
-		fclose(snpdict_file);
-	} else if (STREQ(opt, "filt")) {
-		arg_check(argc, 3);
+void lava_sample_add_fastq(LavaSample *s,
+                           FILE **fastq_files,
+                           const size_t n_fastq_files,
+                           const unsigned threads,
+                           const unsigned first_worker,
+                           LavaProgress *progress)
+{
+	/* === Walk FASTQ File === */
+	const unsigned n_threads = DEBUG ? 1 : threads;  /* `read_data.txt` is written by one worker */
+	struct read_source source = {.fastq_files = fastq_files,
+	                             .n_files = n_fastq_files,
+	                             .current = 0,
+	                             .progress = progress};
+	assert(pthread_mutex_init(&source.lock, NULL) == 0);
+
+	struct read_thread read_threads[n_threads];
+	pthread_t tids[n_threads];
+
+	if (s->perf)
+		perf_begin(s->perf, "reads");
+
+	for (unsigned i = 0; i < n_threads; i++) {
+		read_threads[i] = (struct read_thread){.sample = s, .source = &source, .index = first_worker + i};
+		assert(pthread_create(&tids[i], NULL, read_thread_run, &read_threads[i]) == 0);
+	}
 
-		const char *refdict_filename = argv[2];
-		const char *snp_pos_filename = argv[3];
-		const char *out_filename = argv[4];
+	for (unsigned i = 0; i < n_threads; i++) {
+		assert(pthread_join(tids[i], NULL) == 0);
+	}
 
-		FILE *refdict_file = fopen(refdict_filename, "rb");
-		assert(refdict_file);
+	if (s->perf)
+		perf_end(s->perf);
 
-		FILE *snp_pos_file = fopen(snp_pos_filename, "rb");
-		assert(snp_pos_file);
+	pthread_mutex_destroy(&source.lock);
+}
 
-		FILE *out_file = fopen(out_filename, "wb");
-		assert(out_file);
+void lava_sample_write_calls(const LavaSample *s,
+                             FILE *out,
+                             const bool binary_out,
+                             const unsigned threads,
+                             LavaCallCounts *counts)
+{
+	const LavaDicts *d = s->dicts;
 
-		dict_filt(refdict_file, snp_pos_file, out_file);
-	} else if (STREQ(opt, "lava")) {
-		arg_check(argc, 5);
-		const char *refdict_filename = argv[2];
-		const char *snpdict_filename = argv[3];
-		const char *fastq_filename = argv[4];
-		const char *chrlens_filename = argv[5];
-		const char *out_filename = argv[6];
+	/* === Call Genotypes === */
+	if (s->perf)
+		perf_begin(s->perf, "calling");
 
-		FILE *refdict_file = fopen(refdict_filename, "rb");
-		assert(refdict_file);
+	CallList calls;
+	if (s->pileup.compact)
+		call_ptable(d->call_tables, &s->pileup.ptable, threads, &calls);
+	else
+		call_pileup(d->call_tables, s->pileup.table, s->pileup.size, threads, &calls);
 
-		FILE *snpdict_file = fopen(snpdict_filename, "rb");
-		assert(snpdict_file);
+	if (s->perf) {
+		perf_end(s->perf);
+		perf_begin(s->perf, "output");
+	}
 
-		FILE *fastq_file = fopen(fastq_filename, "r");
-		assert(fastq_file);
+	const size_t ref_call_count = calls.ref_calls;
+	const size_t alt_call_count = calls.alt_calls;
+	const size_t het_call_count = calls.het_calls;
 
-		FILE *chrlens_file = fopen(chrlens_filename, "r");
-		assert(chrlens_file);
+	write_calls(&calls, &d->contigs, out, binary_out);
+	fflush(out);
 
-		FILE *out_file = fopen(out_filename, "w");
-		assert(out_file);
+	call_list_dealloc(&calls);
 
-		genotype(refdict_file, snpdict_file, fastq_file, chrlens_file, out_file);
+	if (s->perf)
+		perf_end(s->perf);
 
-		fclose(refdict_file);
-		fclose(snpdict_file);
-		fclose(fastq_file);
-		fclose(chrlens_file);
-		fclose(out_file);
-	} else if (STREQ(opt, "help")) {
-		print_help();
-		exit(EXIT_SUCCESS);
-	} else {
-		print_help();
-		exit(EXIT_FAILURE);
+	if (counts != NULL) {
+		counts->ref_calls = ref_call_count;
+		counts->alt_calls = alt_call_count;
+		counts->het_calls = het_call_count;
 	}
-}
 
+#if DEBUG
+	LavaStats stats;
+	lava_sample_stats(s, &stats);
+	/*
+	static const char bases[] = {'A', 'C', 'G', 'T'};
+	FILE *counts = fopen("counts.txt", "w");
+	FILE *all_snps = fopen("all_snps.txt", "w");
+	for (size_t i = 0; i < pileup_size; i++) {
+		struct pileup_entry *p = &pileup_table[i];
+		if (p->ref == p->alt) {
+			assert(p->ref == 0 && p->alt == 0);
+			continue;  // no SNP here
+		}
+
+		// index w.r.t. correct chromosome
+		const size_t j = contig_for_pos(&g->contigs, i, 0);
+		const size_t index = i - g->contigs.ends[j] + g->contigs.lens[j];
+
+		if (p->ref_cnt != 0 || p->alt_cnt != 0) {
+			fprintf(counts, "%s %lu (%c:%f / %c:%f) : %u / %u\n",
+			                g->contigs.names[j],
+			                index,
+			                bases[p->ref],
+			                p->ref_freq/255.0f,
+			                bases[p->alt],
+			                p->alt_freq/255.0f,
+			                p->ref_cnt,
+			                p->alt_cnt);
+		}
+		fprintf(all_snps, "%s %lu\n", g->contigs.names[j], index);
+	}
+
+	fclose(all_snps);
+	fclose(counts);
+	*/
+
+	printf("Total: %lu\n", stats.reads);
+	printf("Match: %lu\n", stats.placed);
+	printf("Multi: %lu\n", stats.multi);
+	printf("NoHit: %lu\n", stats.unplaced);
+	printf("Skipped: %lu\n", stats.skipped);
+	printf("\n");
+	printf("Unambig. hits: %lu\n", stats.unambig_hits);
+	printf("Ambig. hits:   %lu\n", stats.ambig_hits);
+	printf("\n");
+	printf("Good reads: %lu\n", stats.informative);
+	printf("Bad reads: %lu\n", stats.reads - stats.informative);
+	printf("\n");
+	printf("Ref calls: %lu\n", ref_call_count);
+	printf("Alt calls: %lu\n", alt_call_count);
+	printf("Het calls: %lu\n", het_call_count);
+	printf("\n");
+	printf("Ref covs:         %lu\n", stats.ref_covs);
+	printf("Alt covs:         %lu\n", stats.alt_covs);
+	printf("Non ref/alt covs: %lu\n", stats.other_covs);
+#endif
+}
@@ -0,0 +1,1624 @@
+/*
+ * The `lava` command line front-end, built on liblava (see `liblava.h`)
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <assert.h>
+#include "fasta_parser.h"
+#include "dictgen.h"
+#include "dict_filt.h"
+#include "dict_stats.h"
+#include "util.h"
+#include "lava.h"
+#include "segment.h"
+#include "unixsock.h"
+#include "liblava.h"
+#include "sim.h"
+#include "progress.h"
+
+/* the dictionaries of `segment_name`, or if that is NULL, of the dictionary files */
+static LavaDicts *dicts_open(FILE *refdict_file,
+                             FILE *snpdict_file,
+                             const char *segment_name,
+                             FILE *chrlens_file,
+                             const MemOptions *mem_opts,
+                             const NumaPolicy numa)
+{
+	if (segment_name != NULL)
+		return lava_dicts_attach(segment_name, chrlens_file, mem_opts, numa);
+	return lava_dicts_load(refdict_file, snpdict_file, chrlens_file, mem_opts, numa);
+}
+
+static double seconds_since(const struct timespec *t)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec)/1e9;
+}
+
+static void json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (const char *c = str; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(out, "\\%c", *c);
+		else if ((unsigned char)*c < 0x20)
+			fprintf(out, "\\u%04x", *c);
+		else
+			fputc(*c, out);
+	}
+	fputc('"', out);
+}
+
+/*
+ * Writes the statistics of a run on one sample to `filename` as JSON: the
+ * read counts (see `LavaStats`), the calls, the time taken by each stage
+ * (and its hardware counts, if they were read) and the peak RSS of the
+ * process (which, in batch and server mode, covers all samples). Failing
+ * to write them only gets a warning, as the calls are what matter.
+ */
+static void write_stats(const char *filename,
+                        const char *sample_name,
+                        const LavaSample *sample,
+                        const LavaCallCounts *counts,
+                        const PerfStats *perf,
+                        const unsigned threads,
+                        const double seconds)
+{
+	FILE *out = fopen(filename, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Could not write statistics to %s: %s\n", filename, strerror(errno));
+		return;
+	}
+
+	LavaStats stats;
+	lava_sample_stats(sample, &stats);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(out, "{\"sample\": ");
+	json_string(out, sample_name);
+	fprintf(out, ",\n \"threads\": %u,\n \"seconds\": %.6f,\n \"peak_rss_bytes\": %lu,\n",
+	        threads, seconds, (uint64_t)usage.ru_maxrss * 1024);
+	fprintf(out, " \"reads\": {\"total\": %lu, \"placed\": %lu, \"multi\": %lu, \"unplaced\": %lu, "
+	             "\"skipped\": %lu, \"informative\": %lu},\n",
+	        stats.reads, stats.placed, stats.multi, stats.unplaced, stats.skipped, stats.informative);
+	fprintf(out, " \"hits\": {\"unambiguous\": %lu, \"ambiguous\": %lu},\n", stats.unambig_hits, stats.ambig_hits);
+	fprintf(out, " \"coverage\": {\"ref\": %lu, \"alt\": %lu, \"other\": %lu},\n",
+	        stats.ref_covs, stats.alt_covs, stats.other_covs);
+	fprintf(out, " \"calls\": {\"ref\": %lu, \"alt\": %lu, \"het\": %lu},\n",
+	        counts->ref_calls, counts->alt_calls, counts->het_calls);
+	fprintf(out, " \"perf\": ");
+	perf_report(perf, out, true);
+	fprintf(out, "}\n");
+
+	if (fclose(out) != 0)
+		fprintf(stderr, "Could not write statistics to %s: %s\n", filename, strerror(errno));
+}
+
+static void genotype(FILE *refdict_file,
+                     FILE *snpdict_file,
+                     const char *segment_name,
+                     FILE *fastq_file,
+                     FILE *chrlens_file,
+                     const char *out_filename,
+                     const unsigned threads,
+                     const bool binary_out,
+                     const MemOptions *mem_opts,
+                     const NumaPolicy numa,
+                     PerfStats *perf,
+                     const char *sample_name,
+                     const char *stats_filename,
+                     const unsigned progress_interval,
+                     const char *status_filename)
+{
+	struct timespec begin;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	perf_begin(perf, "load");
+	LavaDicts *dicts = dicts_open(refdict_file, snpdict_file, segment_name, chrlens_file, mem_opts, numa);
+	LavaSample *sample = lava_sample_new(dicts);
+	perf_end(perf);
+	lava_sample_set_perf(sample, perf);
+
+	/* only now, so that an existing output isn't truncated if the dictionaries don't load (or fit) */
+	FILE *out = fopen(out_filename, binary_out ? "wb" : "w");
+	assert(out);
+
+	/* the size of the input, if it's a file, for the time left */
+	struct stat st;
+	const uint64_t total_bytes = (fstat(fileno(fastq_file), &st) == 0 && S_ISREG(st.st_mode)) ? st.st_size : 0;
+
+	fprintf(stderr, "Processing...\n");
+	LavaProgress progress = {0};
+	ProgressMonitor monitor;
+	const bool monitor_progress = progress_interval > 0 || status_filename != NULL;
+	if (monitor_progress) {
+		progress_monitor_start(&monitor, &progress, total_bytes, progress_interval ? progress_interval : PROGRESS_DEFAULT_INTERVAL,
+		                       progress_interval > 0, status_filename);
+	}
+
+	LavaCallCounts counts;
+	lava_sample_add_fastq(sample, &fastq_file, 1, threads, 0, &progress);
+	if (monitor_progress)
+		progress_monitor_stop(&monitor);
+	lava_sample_write_calls(sample, out, binary_out, threads, &counts);
+	if (fclose(out) != 0) {
+		fprintf(stderr, "Could not write %s: %s\n", out_filename, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	const double seconds = seconds_since(&begin);
+	printf("Time: %f sec\n", seconds);
+	write_stats(stats_filename, sample_name, sample, &counts, perf, threads, seconds);
+
+	lava_sample_free(sample);
+	lava_dicts_free(dicts);
+}
+
+/*
+ * Batch mode (`lava batch`)
+ *
+ * The dictionaries are loaded once and the samples of a manifest are then
+ * genotyped in turn, `concurrent` at a time with `threads/concurrent`
+ * threads each. Every concurrent slot has its own pileup table, which is
+ * reset between samples.
+ *
+ * Each line of the manifest names a sample, its FASTQ file(s) (separated
+ * by commas) and its output file; blank lines and lines starting with '#'
+ * are ignored.
+ */
+
+struct batch_sample {
+	char *name;
+	char **fastq_filenames;
+	size_t n_fastq;
+	char *out_filename;
+};
+
+struct batch {
+	LavaDicts *dicts;
+	struct batch_sample *samples;
+	size_t n_samples;
+	size_t next;  /* next sample to genotype */
+	size_t done;
+	size_t failed;
+	unsigned threads;  /* per sample */
+	bool binary_out;
+	pthread_mutex_t lock;
+};
+
+struct batch_slot {
+	struct batch *batch;
+	LavaSample *pileup;
+	unsigned first_worker;
+};
+
+/*
+ * Sets up `sample` from the fields of a manifest line (or of a `lava serve`
+ * job): its name, its FASTQ files separated by commas and its output file.
+ */
+static void sample_init(struct batch_sample *sample, const char *name, char *fastqs, const char *out)
+{
+	sample->name = strdup(name);
+	sample->out_filename = strdup(out);
+	assert(sample->name && sample->out_filename);
+
+	sample->n_fastq = 0;
+	sample->fastq_filenames = NULL;
+	char *save;
+	for (char *f = strtok_r(fastqs, ",", &save); f != NULL; f = strtok_r(NULL, ",", &save)) {
+		sample->fastq_filenames = realloc(sample->fastq_filenames, (sample->n_fastq + 1) * sizeof(char *));
+		assert(sample->fastq_filenames);
+		sample->fastq_filenames[sample->n_fastq] = strdup(f);
+		assert(sample->fastq_filenames[sample->n_fastq]);
+		++sample->n_fastq;
+	}
+}
+
+static void sample_dealloc(struct batch_sample *sample)
+{
+	for (size_t j = 0; j < sample->n_fastq; j++) {
+		free(sample->fastq_filenames[j]);
+	}
+	free(sample->fastq_filenames);
+	free(sample->name);
+	free(sample->out_filename);
+}
+
+static void manifest_load(FILE *manifest, struct batch_sample **samples_out, size_t *count)
+{
+	struct batch_sample *samples = NULL;
+	size_t n = 0;
+	size_t cap = 0;
+
+	char line[4096];
+	size_t line_no = 0;
+
+	while (fgets(line, sizeof(line), manifest)) {
+		++line_no;
+
+		char *save;
+		char *name = strtok_r(line, " \t\r\n", &save);
+		if (name == NULL || name[0] == '#')
+			continue;
+
+		char *fastqs = strtok_r(NULL, " \t\r\n", &save);
+		char *out = strtok_r(NULL, " \t\r\n", &save);
+
+		if (fastqs == NULL || out == NULL || strtok_r(NULL, " \t\r\n", &save) != NULL) {
+			fprintf(stderr, "Manifest line %lu: expected <sample> <FASTQ>[,<FASTQ>...] <output file>\n", line_no);
+			exit(EXIT_FAILURE);
+		}
+
+		if (n == cap) {
+			cap = cap ? 2*cap : 64;
+			samples = realloc(samples, cap * sizeof(*samples));
+			assert(samples);
+		}
+
+		sample_init(&samples[n++], name, fastqs, out);
+	}
+
+	*samples_out = samples;
+	*count = n;
+}
+
+static void manifest_dealloc(struct batch_sample *samples, const size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		sample_dealloc(&samples[i]);
+	}
+	free(samples);
+}
+
+/*
+ * Opens the files of `sample` and genotypes it into `pileup`, which is
+ * reset for the next sample afterwards, and writes its statistics to
+ * `<output file>.stats.json`. Returns false, with the reason in `err`, if
+ * a file can't be opened or the calls can't be written.
+ */
+static bool sample_genotype(LavaSample *pileup,
+                            const struct batch_sample *sample,
+                            const unsigned threads,
+                            const unsigned first_worker,
+                            const bool binary_out,
+                            LavaProgress *progress,
+                            char *err,
+                            const size_t err_len)
+{
+	FILE *fastq_files[sample->n_fastq];
+	size_t opened = 0;
+	bool ok = true;
+
+	for (; opened < sample->n_fastq; opened++) {
+		fastq_files[opened] = fopen(sample->fastq_filenames[opened], "r");
+		if (fastq_files[opened] == NULL) {
+			snprintf(err, err_len, "could not open %s: %s", sample->fastq_filenames[opened], strerror(errno));
+			ok = false;
+			break;
+		}
+	}
+
+	FILE *out_file = NULL;
+	if (ok) {
+		out_file = fopen(sample->out_filename, binary_out ? "wb" : "w");
+		if (out_file == NULL) {
+			snprintf(err, err_len, "could not open %s: %s", sample->out_filename, strerror(errno));
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		struct timespec begin;
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+
+		/* samples may run concurrently, so only their times are taken */
+		PerfStats perf;
+		perf_init(&perf, false);
+		lava_sample_set_perf(pileup, &perf);
+
+		LavaCallCounts counts;
+		lava_sample_add_fastq(pileup, fastq_files, sample->n_fastq, threads, first_worker, progress);
+		lava_sample_write_calls(pileup, out_file, binary_out, threads, &counts);
+		if (fclose(out_file) != 0) {
+			snprintf(err, err_len, "could not write %s: %s", sample->out_filename, strerror(errno));
+			ok = false;
+		}
+
+		char stats_filename[4096];
+		assert((size_t)snprintf(stats_filename, sizeof(stats_filename), "%s.stats.json", sample->out_filename) < sizeof(stats_filename));
+		write_stats(stats_filename, sample->name, pileup, &counts, &perf, threads, seconds_since(&begin));
+
+		lava_sample_set_perf(pileup, NULL);
+		perf_dealloc(&perf);
+		lava_sample_reset(pileup);
+	}
+
+	for (size_t i = 0; i < opened; i++) {
+		fclose(fastq_files[i]);
+	}
+
+	return ok;
+}
+
+/*
+ * Genotypes one sample of a batch. A sample whose files can't be opened
+ * is skipped (and counted as failed) rather than ending the whole batch.
+ */
+static bool batch_run_sample(struct batch_slot *slot, const struct batch_sample *sample)
+{
+	const struct batch *batch = slot->batch;
+	char err[512];
+
+	if (!sample_genotype(slot->pileup, sample, batch->threads, slot->first_worker,
+	                     batch->binary_out, NULL, err, sizeof(err))) {
+		fprintf(stderr, "Sample %s: %s\n", sample->name, err);
+		return false;
+	}
+
+	return true;
+}
+
+static void *batch_slot_run(void *arg)
+{
+	struct batch_slot *slot = arg;
+	struct batch *batch = slot->batch;
+
+	while (true) {
+		assert(pthread_mutex_lock(&batch->lock) == 0);
+		const size_t i = batch->next++;
+		assert(pthread_mutex_unlock(&batch->lock) == 0);
+
+		if (i >= batch->n_samples)
+			break;
+
+		const struct batch_sample *sample = &batch->samples[i];
+		const bool ok = batch_run_sample(slot, sample);
+
+		assert(pthread_mutex_lock(&batch->lock) == 0);
+		if (ok)
+			fprintf(stderr, "Sample %s done (%lu of %lu)\n", sample->name, ++batch->done, batch->n_samples);
+		else
+			++batch->failed;
+		assert(pthread_mutex_unlock(&batch->lock) == 0);
+	}
+
+	return NULL;
+}
+
+/* returns the number of samples that failed */
+static size_t genotype_batch(FILE *refdict_file,
+                             FILE *snpdict_file,
+                             const char *segment_name,
+                             FILE *chrlens_file,
+                             FILE *manifest,
+                             const unsigned threads,
+                             unsigned concurrent,
+                             const bool binary_out,
+                             const MemOptions *mem_opts,
+                             const NumaPolicy numa)
+{
+	struct batch batch;
+	manifest_load(manifest, &batch.samples, &batch.n_samples);
+
+	if (concurrent > batch.n_samples)
+		concurrent = batch.n_samples ? batch.n_samples : 1;
+	if (concurrent > threads)
+		concurrent = threads;
+#if DEBUG
+	concurrent = 1;  /* samples would share `read_data.txt` */
+#endif
+
+	batch.dicts = dicts_open(refdict_file, snpdict_file, segment_name, chrlens_file, mem_opts, numa);
+	batch.next = 0;
+	batch.done = 0;
+	batch.failed = 0;
+	batch.threads = threads/concurrent;
+	batch.binary_out = binary_out;
+	assert(pthread_mutex_init(&batch.lock, NULL) == 0);
+
+	fprintf(stderr, "Processing %lu samples, %u at a time...\n", batch.n_samples, concurrent);
+
+	struct batch_slot slots[concurrent];
+	pthread_t tids[concurrent];
+
+	for (unsigned i = 0; i < concurrent; i++) {
+		slots[i].batch = &batch;
+		slots[i].first_worker = i * batch.threads;
+		slots[i].pileup = lava_sample_new(batch.dicts);
+	}
+
+	for (unsigned i = 0; i < concurrent; i++) {
+		assert(pthread_create(&tids[i], NULL, batch_slot_run, &slots[i]) == 0);
+	}
+
+	for (unsigned i = 0; i < concurrent; i++) {
+		assert(pthread_join(tids[i], NULL) == 0);
+		lava_sample_free(slots[i].pileup);
+	}
+
+	pthread_mutex_destroy(&batch.lock);
+
+	const size_t failed = batch.failed;
+	manifest_dealloc(batch.samples, batch.n_samples);
+	lava_dicts_free(batch.dicts);
+	return failed;
+}
+
+/*
+ * Server mode (`lava serve`)
+ *
+ * The dictionaries are loaded once, and genotyping jobs are then taken over
+ * a Unix domain socket for as long as the server runs. Each connection
+ * carries one request line:
+ *
+ *   genotype <sample> <FASTQ>[,<FASTQ>...] <output file> [binary|text]
+ *   status
+ *   shutdown
+ *
+ * Jobs wait in a bounded queue (requests beyond its capacity are refused
+ * as busy) for one of `concurrent` job slots, which work like those of
+ * batch mode. A job's connection stays open until it ends, and gets a line
+ * when it is queued, when it starts, every `SERVE_PROGRESS_SECS` while it
+ * runs and when it is done or has failed. The replies are described in the
+ * README.
+ *
+ * On `SIGINT`, `SIGTERM` or a shutdown request the server stops accepting
+ * connections, finishes the jobs it has and exits.
+ */
+
+#define SERVE_PROGRESS_SECS   5
+#define SERVE_REQUEST_TIMEOUT 5000  /* ms to wait for a request line */
+#define SERVE_MAX_ARGS        5
+#define SERVE_DEFAULT_QUEUE   64
+
+struct serve_job {
+	unsigned long id;
+	struct batch_sample sample;
+	bool binary_out;
+	int client;            /* the connection that submitted the job */
+	uint64_t total_bytes;  /* of the FASTQ files, 0 if unknown (e.g. pipes) */
+	struct timespec start;
+	LavaProgress progress;
+	struct serve_job *next;
+};
+
+struct server {
+	unsigned threads;  /* per job */
+	bool binary_out;   /* unless a job says otherwise */
+
+	struct serve_job *head;  /* queued jobs, oldest first */
+	struct serve_job *tail;
+	size_t queued;
+	size_t capacity;
+	struct serve_job **running;  /* by slot, NULL if idle */
+	unsigned n_slots;
+
+	unsigned long last_id;
+	size_t done;
+	size_t failed;
+	bool stopping;  /* slots exit once the queue is empty */
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+};
+
+struct serve_slot {
+	struct server *server;
+	unsigned index;
+	LavaSample *pileup;
+	unsigned first_worker;
+};
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig)
+{
+	UNUSED(sig);
+	serve_stop = 1;
+}
+
+static void serve_job_free(struct serve_job *job)
+{
+	close(job->client);
+	sample_dealloc(&job->sample);
+	free(job);
+}
+
+static void *serve_slot_run(void *arg)
+{
+	struct serve_slot *slot = arg;
+	struct server *server = slot->server;
+
+	while (true) {
+		assert(pthread_mutex_lock(&server->lock) == 0);
+		while (server->head == NULL && !server->stopping) {
+			assert(pthread_cond_wait(&server->ready, &server->lock) == 0);
+		}
+
+		struct serve_job *job = server->head;
+		if (job == NULL) {  /* stopping, and nothing is left */
+			assert(pthread_mutex_unlock(&server->lock) == 0);
+			break;
+		}
+
+		server->head = job->next;
+		if (server->head == NULL)
+			server->tail = NULL;
+		--server->queued;
+		server->running[slot->index] = job;
+		clock_gettime(CLOCK_MONOTONIC, &job->start);
+		unixsock_printf(job->client, "started %lu", job->id);
+		assert(pthread_mutex_unlock(&server->lock) == 0);
+
+		char err[512];
+		const bool ok = sample_genotype(slot->pileup, &job->sample, server->threads, slot->first_worker,
+		                                job->binary_out, &job->progress, err, sizeof(err));
+		const double secs = seconds_since(&job->start);
+
+		assert(pthread_mutex_lock(&server->lock) == 0);
+		server->running[slot->index] = NULL;
+		if (ok) {
+			++server->done;
+			unixsock_printf(job->client, "done %lu reads=%lu seconds=%.1f", job->id, job->progress.reads, secs);
+			fprintf(stderr, "Job %lu (%s) done in %.1f sec\n", job->id, job->sample.name, secs);
+		} else {
+			++server->failed;
+			unixsock_printf(job->client, "failed %lu %s", job->id, err);
+			fprintf(stderr, "Job %lu (%s) failed: %s\n", job->id, job->sample.name, err);
+		}
+		assert(pthread_mutex_unlock(&server->lock) == 0);
+
+		serve_job_free(job);
+	}
+
+	return NULL;
+}
+
+/* queues a job, or refuses it; takes over `client` in either case */
+static void serve_submit(struct server *server, const int client, char **args, const int n_args)
+{
+	if (n_args < 4 || n_args > 5) {
+		unixsock_printf(client, "error expected: genotype <sample> <FASTQ>[,<FASTQ>...] <output file> [binary|text]");
+		close(client);
+		return;
+	}
+
+	bool binary_out = server->binary_out;
+	if (n_args == 5) {
+		if (STREQ(args[4], "binary")) {
+			binary_out = true;
+		} else if (STREQ(args[4], "text")) {
+			binary_out = false;
+		} else {
+			unixsock_printf(client, "error unknown output format: %s", args[4]);
+			close(client);
+			return;
+		}
+	}
+
+	struct serve_job *job = calloc(1, sizeof(*job));
+	assert(job);
+	sample_init(&job->sample, args[1], args[2], args[3]);
+	job->binary_out = binary_out;
+	job->client = client;
+
+	/* relative paths would be taken from the server's directory, not the client's */
+	bool absolute = (job->sample.out_filename[0] == '/');
+	for (size_t i = 0; i < job->sample.n_fastq; i++) {
+		struct stat st;
+		absolute = absolute && (job->sample.fastq_filenames[i][0] == '/');
+
+		if (stat(job->sample.fastq_filenames[i], &st) == 0 && S_ISREG(st.st_mode)) {
+			job->total_bytes += st.st_size;
+		} else {
+			job->total_bytes = 0;
+			break;
+		}
+	}
+
+	if (!absolute) {
+		unixsock_printf(client, "error paths must be absolute");
+		serve_job_free(job);
+		return;
+	}
+
+	assert(pthread_mutex_lock(&server->lock) == 0);
+
+	if (server->queued >= server->capacity) {
+		unixsock_printf(client, "busy queued=%lu", server->queued);
+		assert(pthread_mutex_unlock(&server->lock) == 0);
+		serve_job_free(job);
+		return;
+	}
+
+	job->id = ++server->last_id;
+	if (server->tail != NULL)
+		server->tail->next = job;
+	else
+		server->head = job;
+	server->tail = job;
+	++server->queued;
+
+	unixsock_printf(client, "queued %lu position=%lu", job->id, server->queued);
+	fprintf(stderr, "Job %lu (%s) queued\n", job->id, job->sample.name);
+
+	assert(pthread_cond_signal(&server->ready) == 0);
+	assert(pthread_mutex_unlock(&server->lock) == 0);
+}
+
+static void serve_status(struct server *server, const int client)
+{
+	assert(pthread_mutex_lock(&server->lock) == 0);
+
+	unsigned running = 0;
+	for (unsigned i = 0; i < server->n_slots; i++) {
+		running += (server->running[i] != NULL);
+	}
+
+	unixsock_printf(client, "status running=%u queued=%lu capacity=%lu done=%lu failed=%lu",
+	                running, server->queued, server->capacity, server->done, server->failed);
+
+	for (unsigned i = 0; i < server->n_slots; i++) {
+		const struct serve_job *job = server->running[i];
+		if (job != NULL) {
+			unixsock_printf(client, "job %lu %s running reads=%lu bytes=%lu total=%lu seconds=%.1f",
+			                job->id, job->sample.name,
+			                __atomic_load_n(&job->progress.reads, __ATOMIC_RELAXED),
+			                __atomic_load_n(&job->progress.bytes, __ATOMIC_RELAXED),
+			                job->total_bytes, seconds_since(&job->start));
+		}
+	}
+
+	for (const struct serve_job *job = server->head; job != NULL; job = job->next) {
+		unixsock_printf(client, "job %lu %s queued", job->id, job->sample.name);
+	}
+
+	assert(pthread_mutex_unlock(&server->lock) == 0);
+
+	unixsock_printf(client, "end");
+	close(client);
+}
+
+/* tells the client of each running job how far it has got */
+static void serve_progress(struct server *server)
+{
+	assert(pthread_mutex_lock(&server->lock) == 0);
+
+	for (unsigned i = 0; i < server->n_slots; i++) {
+		const struct serve_job *job = server->running[i];
+		if (job != NULL) {
+			unixsock_printf(job->client, "progress %lu reads=%lu bytes=%lu total=%lu",
+			                job->id,
+			                __atomic_load_n(&job->progress.reads, __ATOMIC_RELAXED),
+			                __atomic_load_n(&job->progress.bytes, __ATOMIC_RELAXED),
+			                job->total_bytes);
+		}
+	}
+
+	assert(pthread_mutex_unlock(&server->lock) == 0);
+}
+
+static size_t serve_pending(struct server *server)
+{
+	assert(pthread_mutex_lock(&server->lock) == 0);
+
+	size_t pending = server->queued;
+	for (unsigned i = 0; i < server->n_slots; i++) {
+		pending += (server->running[i] != NULL);
+	}
+
+	assert(pthread_mutex_unlock(&server->lock) == 0);
+	return pending;
+}
+
+static void serve_request(struct server *server, const int client)
+{
+	char line[UNIXSOCK_LINE_MAX];
+
+	if (!unixsock_read_line(client, line, sizeof(line), SERVE_REQUEST_TIMEOUT)) {
+		close(client);
+		return;
+	}
+
+	char *args[SERVE_MAX_ARGS + 1];
+	int n_args = 0;
+	char *save;
+	for (char *arg = strtok_r(line, " \t", &save); arg != NULL && n_args <= SERVE_MAX_ARGS; arg = strtok_r(NULL, " \t", &save)) {
+		args[n_args++] = arg;
+	}
+
+	if (n_args == 0) {
+		unixsock_printf(client, "error empty request");
+		close(client);
+	} else if (STREQ(args[0], "genotype")) {
+		serve_submit(server, client, args, n_args);
+	} else if (STREQ(args[0], "status")) {
+		serve_status(server, client);
+	} else if (STREQ(args[0], "shutdown")) {
+		serve_stop = 1;
+		unixsock_printf(client, "ok");
+		close(client);
+	} else {
+		unixsock_printf(client, "error unknown request: %s", args[0]);
+		close(client);
+	}
+}
+
+static void serve(FILE *refdict_file,
+                  FILE *snpdict_file,
+                  const char *segment_name,
+                  FILE *chrlens_file,
+                  const char *socket_path,
+                  const unsigned threads,
+                  unsigned concurrent,
+                  const size_t capacity,
+                  const bool binary_out,
+                  const MemOptions *mem_opts,
+                  const NumaPolicy numa)
+{
+	if (concurrent > threads)
+		concurrent = threads;
+#if DEBUG
+	concurrent = 1;  /* jobs would share `read_data.txt` */
+#endif
+
+	LavaDicts *dicts = dicts_open(refdict_file, snpdict_file, segment_name, chrlens_file, mem_opts, numa);
+
+	struct server server = {.threads = threads/concurrent,
+	                        .binary_out = binary_out,
+	                        .head = NULL,
+	                        .tail = NULL,
+	                        .queued = 0,
+	                        .capacity = capacity,
+	                        .n_slots = concurrent,
+	                        .last_id = 0,
+	                        .done = 0,
+	                        .failed = 0,
+	                        .stopping = false};
+	server.running = calloc(concurrent, sizeof(*server.running));
+	assert(server.running);
+	assert(pthread_mutex_init(&server.lock, NULL) == 0);
+	assert(pthread_cond_init(&server.ready, NULL) == 0);
+
+	struct serve_slot slots[concurrent];
+	pthread_t tids[concurrent];
+
+	for (unsigned i = 0; i < concurrent; i++) {
+		slots[i].server = &server;
+		slots[i].index = i;
+		slots[i].first_worker = i * server.threads;
+		slots[i].pileup = lava_sample_new(dicts);
+	}
+
+	/* a second signal ends the server right away */
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_signal;
+	sa.sa_flags = SA_RESETHAND;
+	sigemptyset(&sa.sa_mask);
+	assert(sigaction(SIGINT, &sa, NULL) == 0);
+	assert(sigaction(SIGTERM, &sa, NULL) == 0);
+
+	const int listener = unixsock_listen(socket_path);
+
+	for (unsigned i = 0; i < concurrent; i++) {
+		assert(pthread_create(&tids[i], NULL, serve_slot_run, &slots[i]) == 0);
+	}
+
+	fprintf(stderr, "Serving on %s (%u jobs at a time, up to %lu queued)...\n", socket_path, concurrent, capacity);
+
+	struct timespec last_progress;
+	clock_gettime(CLOCK_MONOTONIC, &last_progress);
+
+	/* the timeout bounds how late signals and progress lines are noticed */
+	while (!serve_stop) {
+		struct pollfd pfd = {.fd = listener, .events = POLLIN};
+
+		if (poll(&pfd, 1, 1000) > 0) {
+			const int client = unixsock_accept(listener);
+			if (client >= 0)
+				serve_request(&server, client);
+		}
+
+		if (seconds_since(&last_progress) >= SERVE_PROGRESS_SECS) {
+			serve_progress(&server);
+			clock_gettime(CLOCK_MONOTONIC, &last_progress);
+		}
+	}
+
+	close(listener);
+	unlink(socket_path);
+
+	fprintf(stderr, "Shutting down after %lu pending jobs...\n", serve_pending(&server));
+
+	assert(pthread_mutex_lock(&server.lock) == 0);
+	server.stopping = true;
+	assert(pthread_cond_broadcast(&server.ready) == 0);
+	assert(pthread_mutex_unlock(&server.lock) == 0);
+
+	while (serve_pending(&server) > 0) {
+		poll(NULL, 0, 1000);
+		if (seconds_since(&last_progress) >= SERVE_PROGRESS_SECS) {
+			serve_progress(&server);
+			clock_gettime(CLOCK_MONOTONIC, &last_progress);
+		}
+	}
+
+	for (unsigned i = 0; i < concurrent; i++) {
+		assert(pthread_join(tids[i], NULL) == 0);
+		lava_sample_free(slots[i].pileup);
+	}
+
+	fprintf(stderr, "Jobs done: %lu, failed: %lu\n", server.done, server.failed);
+
+	pthread_cond_destroy(&server.ready);
+	pthread_mutex_destroy(&server.lock);
+	free(server.running);
+	lava_dicts_free(dicts);
+}
+
+/*
+ * Writes `path` to `buf` as an absolute path, relative to the current
+ * directory, since the server doesn't share it.
+ */
+static void absolute_path(const char *path, char *buf, const size_t len)
+{
+	if (path[0] == '/') {
+		assert((size_t)snprintf(buf, len, "%s", path) < len);
+		return;
+	}
+
+	char cwd[4096];
+	assert(getcwd(cwd, sizeof(cwd)) != NULL);
+	assert((size_t)snprintf(buf, len, "%s/%s", cwd, path) < len);
+}
+
+/*
+ * Sends `request` to the server on `socket_path` and copies its replies to
+ * standard output. Returns true if the last reply starts with `success`.
+ */
+static bool serve_client(const char *socket_path, const char *request, const char *success)
+{
+	const int fd = unixsock_connect(socket_path);
+	if (fd < 0) {
+		fprintf(stderr, "Could not connect to %s: %s (see `lava serve`)\n", socket_path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (!unixsock_printf(fd, "%s", request)) {
+		fprintf(stderr, "Could not send request to %s\n", socket_path);
+		exit(EXIT_FAILURE);
+	}
+
+	FILE *replies = fdopen(fd, "r");
+	assert(replies);
+
+	char line[UNIXSOCK_LINE_MAX];
+	bool ok = false;
+	while (fgets(line, sizeof(line), replies)) {
+		fputs(line, stdout);
+		fflush(stdout);
+		ok = (strncmp(line, success, strlen(success)) == 0);
+	}
+
+	fclose(replies);
+	return ok;
+}
+
+/* submits a job to the server on `socket_path` and follows it until it ends */
+static bool submit(const char *socket_path,
+                   const char *sample,
+                   const char *fastqs,
+                   const char *out_filename,
+                   const char *format)
+{
+	char request[UNIXSOCK_LINE_MAX];
+	char path[4096];
+	size_t len = snprintf(request, sizeof(request), "genotype %s ", sample);
+
+	char *list = strdup(fastqs);
+	assert(list);
+	char *save;
+	for (char *f = strtok_r(list, ",", &save); f != NULL; f = strtok_r(NULL, ",", &save)) {
+		absolute_path(f, path, sizeof(path));
+		len += snprintf(request + len, sizeof(request) - len, "%s%s", (f == list) ? "" : ",", path);
+		assert(len < sizeof(request));
+	}
+	free(list);
+
+	absolute_path(out_filename, path, sizeof(path));
+	len += snprintf(request + len, sizeof(request) - len, " %s%s%s", path, format ? " " : "", format ? format : "");
+	assert(len < sizeof(request));
+
+	return serve_client(socket_path, request, "done ");
+}
+
+/* === Front-End === */
+
+static void print_help(void)
+{
+	SimOptions sim_defaults;
+	sim_options_default(&sim_defaults);
+
+	fprintf(stderr, "Usage: lava <option> [option parameters ...]\n");
+	fprintf(stderr, "Option  Description                   Parameters\n");
+	fprintf(stderr, "------  -----------                   ----------\n");
+	fprintf(stderr, "dict    Generate dictionary files     "
+	                "<input FASTA> <input SNPs> <output ref dict> <output SNP dict> [--half-index] [--wide-pos] [--max-positions=N]\n");
+	fprintf(stderr, "filt    Filter reference dictionary   "
+		            "<ref dict> <snp_pos file> <output ref dict>\n");
+	fprintf(stderr, "stats   Describe a dictionary         "
+	                "<ref or SNP dict>\n");
+	fprintf(stderr, "lava    Perform genotyping            "
+	                "<input ref dict> <input SNP dict> <input FASTQ> <chrlens file> <output file>\n");
+	fprintf(stderr, "                                      "
+	                "--shm=<segment> <input FASTQ> <chrlens file> <output file>\n");
+	fprintf(stderr, "batch   Genotype many samples         "
+	                "<input ref dict> <input SNP dict> <chrlens file> <manifest>\n");
+	fprintf(stderr, "                                      "
+	                "--shm=<segment> <chrlens file> <manifest>\n");
+	fprintf(stderr, "serve   Genotype jobs from a socket   "
+	                "<input ref dict> <input SNP dict> <chrlens file> <socket>\n");
+	fprintf(stderr, "                                      "
+	                "--shm=<segment> <chrlens file> <socket>\n");
+	fprintf(stderr, "submit  Submit a job to lava serve    "
+	                "<socket> <sample> <FASTQ>[,<FASTQ>...] <output file> [--binary|--text]\n");
+	fprintf(stderr, "status  Show the jobs of lava serve   "
+	                "<socket> [--shutdown]\n");
+	fprintf(stderr, "load    Load shared dictionaries      "
+	                "<input ref dict> <input SNP dict> <segment>\n");
+	fprintf(stderr, "unload  Remove shared dictionaries    "
+	                "<segment>\n");
+	fprintf(stderr, "sim     Simulate a genome and reads   "
+	                "<output prefix>\n");
+	fprintf(stderr, "concord Compare calls with the truth  "
+	                "<sim truth file> <binary calls file>\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Flags for dict:\n");
+	fprintf(stderr, "  --half-index  also index k-mer halves, for 1-mismatch search without neighbor enumeration\n");
+	fprintf(stderr, "  --wide-pos    store 40-bit positions (implied for references of 2^32 - 1 bases or more)\n");
+	fprintf(stderr, "  --max-positions=N keep the positions of k-mers that occur up to N times (default: %d); drop the rest\n",
+	        AUX_TABLE_COLS);
+	fprintf(stderr, "Flags for lava:\n");
+	fprintf(stderr, "  --stats=F     write run statistics (JSON) to F rather than to <output file>.stats.json\n");
+	fprintf(stderr, "  --progress=S  report progress every S seconds while reading (default: %d)\n", PROGRESS_DEFAULT_INTERVAL);
+	fprintf(stderr, "  --no-progress don't report progress\n");
+	fprintf(stderr, "  --status-file=F keep the progress, as JSON, in F (replaced at each report)\n");
+	fprintf(stderr, "Flags for dict, filt and lava:\n");
+	fprintf(stderr, "  --perf[=json] report the time and hardware counters (where available) of each stage at exit\n");
+	fprintf(stderr, "Flags for lava, batch and serve:\n");
+	fprintf(stderr, "  --threads=N   threads used to process reads and call genotypes (default: all online CPUs)\n");
+	fprintf(stderr, "  --binary      write calls in binary form rather than text\n");
+	fprintf(stderr, "  --hugetlb     back the dictionaries with reserved huge pages when available\n");
+	fprintf(stderr, "  --prefault    fault all dictionary and pileup pages in while loading\n");
+	fprintf(stderr, "  --mlock       lock the dictionaries and pileup table in memory\n");
+	fprintf(stderr, "  --numa=P      NUMA placement: interleave (default), replicate or off\n");
+	fprintf(stderr, "  --shm=S       use the dictionaries in segment S (see load) instead of dictionary files\n");
+	fprintf(stderr, "  --max-mem=M   fit the dictionaries and pileup tables in M bytes (suffixes K, M, G, T), by\n"
+	                "                narrowing jumpgates, packing the reference dictionary or using a compact\n"
+	                "                pileup table, or fail before loading\n");
+	fprintf(stderr, "Flags for batch and serve:\n");
+	fprintf(stderr, "  --samples=K   genotype K samples at a time, splitting the threads between them (default: 1)\n");
+	fprintf(stderr, "Flags for serve:\n");
+	fprintf(stderr, "  --queue=Q     queue up to Q jobs, refusing any more (default: %d)\n", SERVE_DEFAULT_QUEUE);
+	fprintf(stderr, "Flags for status:\n");
+	fprintf(stderr, "  --shutdown    stop the server once its jobs are done\n");
+	fprintf(stderr, "Flags for sim (defaults in parentheses):\n");
+	fprintf(stderr, "  --genome=N    genome length in bases (%lu)\n", sim_defaults.genome_len);
+	fprintf(stderr, "  --chroms=C    number of contigs (%u)\n", sim_defaults.n_chroms);
+	fprintf(stderr, "  --snp-rate=R  SNPs per base (%g)\n", sim_defaults.snp_rate);
+	fprintf(stderr, "  --repeats=F   fraction of the genome copied from elsewhere in it (%g)\n", sim_defaults.repeat_frac);
+	fprintf(stderr, "  --read-len=L  read length (%u)\n", sim_defaults.read_len);
+	fprintf(stderr, "  --coverage=X  mean read depth (%g)\n", sim_defaults.coverage);
+	fprintf(stderr, "  --error=E     substitution error rate per base (%g)\n", sim_defaults.error_rate);
+	fprintf(stderr, "  --seed=S      random seed (%lu)\n", sim_defaults.seed);
+}
+
+static bool is_flag(const char *arg)
+{
+	return arg[0] == '-' && arg[1] == '-';
+}
+
+/*
+ * Flags in `flags` that end in '=' take a value, e.g. "--threads=" matches
+ * "--threads=4".
+ */
+static bool flag_matches(const char *arg, const char *flag)
+{
+	const size_t len = strlen(flag);
+	return (flag[len - 1] == '=') ? (strncmp(arg, flag, len) == 0) : STREQ(arg, flag);
+}
+
+/*
+ * Checks that there are `expected` option parameters, not counting flags,
+ * and that any flags given are in `flags` (a NULL-terminated list).
+ */
+static void arg_check(int argc, const char *argv[], int expected, const char **flags)
+{
+	int params = 0;
+
+	for (int i = 2; i < argc; i++) {  /* option params start at argv[2] */
+		if (!is_flag(argv[i])) {
+			++params;
+			continue;
+		}
+
+		bool known = false;
+		for (const char **flag = flags; flag && *flag; flag++) {
+			if (flag_matches(argv[i], *flag)) {
+				known = true;
+				break;
+			}
+		}
+
+		if (!known) {
+			fprintf(stderr, "Unknown flag: %s\n", argv[i]);
+			print_help();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (params != expected) {
+		print_help();
+		exit(EXIT_FAILURE);
+	}
+}
+
+static bool has_flag(int argc, const char *argv[], const char *flag)
+{
+	for (int i = 2; i < argc; i++) {
+		if (STREQ(argv[i], flag))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Returns the value of a flag such as "--threads=", or NULL if not given.
+ */
+static const char *flag_value(int argc, const char *argv[], const char *flag)
+{
+	for (int i = 2; i < argc; i++) {
+		if (flag_matches(argv[i], flag))
+			return argv[i] + strlen(flag);
+	}
+	return NULL;
+}
+
+static unsigned parse_threads(int argc, const char *argv[])
+{
+	const char *value = flag_value(argc, argv, "--threads=");
+
+	if (value == NULL) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		return (cpus > 0) ? (unsigned)cpus : 1;
+	}
+
+	const int threads = atoi(value);
+	if (threads < 1) {
+		fprintf(stderr, "Invalid thread count: %s\n", value);
+		exit(EXIT_FAILURE);
+	}
+	return threads;
+}
+
+static NumaPolicy parse_numa(int argc, const char *argv[])
+{
+	const char *value = flag_value(argc, argv, "--numa=");
+
+	if (value == NULL || STREQ(value, "interleave"))
+		return NUMA_INTERLEAVE;
+	if (STREQ(value, "replicate"))
+		return NUMA_REPLICATE;
+	if (STREQ(value, "off"))
+		return NUMA_OFF;
+
+	fprintf(stderr, "Invalid NUMA policy: %s\n", value);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Returns the value of a flag such as "--max-mem=", a number of bytes
+ * with an optional K, M, G or T suffix (powers of 1024), or 0 if not given.
+ */
+static size_t parse_size(int argc, const char *argv[], const char *flag, const char *what)
+{
+	const char *value = flag_value(argc, argv, flag);
+
+	if (value == NULL)
+		return 0;
+
+	static const char units[] = "KMGT";
+	char *end;
+	double size = strtod(value, &end);
+	bool valid = (end != value);
+
+	if (valid && *end != '\0') {
+		const char *unit = strchr(units, *end);
+		valid = (unit != NULL && end[1] == '\0');
+		for (const char *u = units; valid && u <= unit; u++)
+			size *= 1024;
+	}
+
+	if (!valid || size < 1) {
+		fprintf(stderr, "Invalid %s: %s\n", what, value);
+		exit(EXIT_FAILURE);
+	}
+	return (size_t)size;
+}
+
+static MemOptions parse_mem_opts(int argc, const char *argv[], const unsigned threads, const unsigned samples)
+{
+	return (MemOptions){.hugetlb = has_flag(argc, argv, "--hugetlb"),
+	                    .prefault = has_flag(argc, argv, "--prefault"),
+	                    .lock = has_flag(argc, argv, "--mlock"),
+	                    .threads = threads,
+	                    .interleave = NULL,
+	                    .max_mem = parse_size(argc, argv, "--max-mem=", "memory budget"),
+	                    .samples = samples};
+}
+
+/*
+ * Returns the value of a flag such as "--samples=", which must be a
+ * positive count (`what` names it in errors), or `def` if not given.
+ */
+static unsigned parse_count(int argc, const char *argv[], const char *flag, const unsigned def, const char *what)
+{
+	const char *value = flag_value(argc, argv, flag);
+
+	if (value == NULL)
+		return def;
+
+	const int count = atoi(value);
+	if (count < 1) {
+		fprintf(stderr, "Invalid %s: %s\n", what, value);
+		exit(EXIT_FAILURE);
+	}
+	return count;
+}
+
+/*
+ * Returns the value of a flag such as "--coverage=", which must be a number
+ * in [`min`, `max`], or `def` if not given.
+ */
+static double parse_real(int argc, const char *argv[], const char *flag, const double def,
+                         const double min, const double max, const char *what)
+{
+	const char *value = flag_value(argc, argv, flag);
+
+	if (value == NULL)
+		return def;
+
+	char *end;
+	const double x = strtod(value, &end);
+	if (end == value || *end != '\0' || !(x >= min && x <= max)) {
+		fprintf(stderr, "Invalid %s: %s\n", what, value);
+		exit(EXIT_FAILURE);
+	}
+	return x;
+}
+
+/* `<output file>.stats.json`, or the file given by `--stats=` */
+static void stats_path(int argc, const char *argv[], const char *out_filename, char *buf, const size_t len)
+{
+	const char *value = flag_value(argc, argv, "--stats=");
+	if (value != NULL)
+		assert((size_t)snprintf(buf, len, "%s", value) < len);
+	else
+		assert((size_t)snprintf(buf, len, "%s.stats.json", out_filename) < len);
+}
+
+/*
+ * Returns whether `--perf` or `--perf=json` is given, setting `json` to
+ * the report format.
+ */
+static bool parse_perf(int argc, const char *argv[], bool *json)
+{
+	const char *value = flag_value(argc, argv, "--perf=");
+	*json = (value != NULL && STREQ(value, "json"));
+
+	if (value != NULL && !*json && !STREQ(value, "table")) {
+		fprintf(stderr, "Invalid report format: %s\n", value);
+		exit(EXIT_FAILURE);
+	}
+
+	return value != NULL || has_flag(argc, argv, "--perf");
+}
+
+static void perf_finish(PerfStats *perf, const bool json)
+{
+	perf_report(perf, stderr, json);
+	perf_dealloc(perf);
+}
+
+/*
+ * Returns the `n`th (0-based) option parameter, skipping flags.
+ */
+static const char *param(int argc, const char *argv[], int n)
+{
+	for (int i = 2; i < argc; i++) {
+		if (!is_flag(argv[i]) && n-- == 0)
+			return argv[i];
+	}
+	assert(0);
+	return NULL;
+}
+
+int main(const int argc, const char *argv[])
+{
+	if (argc < 2) {
+		print_help();
+		exit(EXIT_FAILURE);
+	}
+
+	const char *opt = argv[1];
+
+	if (STREQ(opt, "dict")) {
+		static const char *dict_flags[] = {"--half-index", "--wide-pos", "--max-positions=", "--perf", "--perf=", NULL};
+		arg_check(argc, argv, 4, dict_flags);
+		const char *ref_filename = param(argc, argv, 0);
+		const char *snp_filename = param(argc, argv, 1);
+		const char *refdict_filename = param(argc, argv, 2);
+		const char *snpdict_filename = param(argc, argv, 3);
+
+		PerfStats perf;
+		bool perf_json;
+		const bool measure = parse_perf(argc, argv, &perf_json);
+		if (measure)
+			perf_init(&perf, true);
+
+		if (measure)
+			perf_begin(&perf, "parse");
+		SeqVec ref = parse_fasta(ref_filename);
+		if (measure)
+			perf_end(&perf);
+
+		uint64_t ref_total_len = 0;
+		for (size_t i = 0; i < ref.size; i++) {
+			ref_total_len += ref.seqs[i].size;
+		}
+
+		if (ref_total_len >= POS_WIDE_LIMIT) {
+			fprintf(stderr, "Reference is too large (limit: %lu bases)\n", (uint64_t)POS_WIDE_LIMIT - 1);
+			exit(EXIT_FAILURE);
+		}
+
+		DictOptions dict_opts = {.half_index = has_flag(argc, argv, "--half-index"),
+		                         .wide_pos = has_flag(argc, argv, "--wide-pos"),
+		                         .max_positions = parse_count(argc, argv, "--max-positions=", AUX_TABLE_COLS,
+		                                                      "cap on positions per k-mer")};
+
+		if (!dict_opts.wide_pos && ref_total_len >= POS_NARROW_LIMIT) {
+			printf("Reference has %lu bases; using 40-bit positions\n", ref_total_len);
+			dict_opts.wide_pos = true;
+		}
+
+#define CHRLENS_EXT ".chrlens"
+		char chrlens_filename[4096];
+		assert(strlen(ref_filename) < (sizeof(chrlens_filename) - strlen(CHRLENS_EXT)));
+		sprintf(chrlens_filename, "%s" CHRLENS_EXT, ref_filename);
+		FILE *chrlens = fopen(chrlens_filename, "w");
+		assert(chrlens);
+#undef CHRLENS_EXT
+
+		for (size_t i = 0; i < ref.size; i++) {
+			fprintf(chrlens, "%s %lu\n", ref.seqs[i].name, ref.seqs[i].size);
+		}
+
+		fclose(chrlens);
+
+		FILE *snp_file = fopen(snp_filename, "r");
+		assert(snp_file);
+
+		FILE *snpdict_file = fopen(snpdict_filename, "wb");
+		assert(snpdict_file);
+
+		bool *snp_locations;
+		size_t snp_locs_size;
+		if (measure)
+			perf_begin(&perf, "snp_dict");
+		make_snp_dict(ref, snp_file, snpdict_file, &snp_locations, &snp_locs_size, &dict_opts);
+		if (measure)
+			perf_end(&perf);
+		assert(snp_locations);
+
+#if GEN_FLT_DATA
+		FILE *snp_locs = fopen("snp_locs", "wb");
+		assert(snp_locs);
+		serialize_uint64(snp_locs, snp_locs_size);
+		for (size_t i = 0; i < snp_locs_size; i++) {
+			serialize_uint8(snp_locs, snp_locations[i]);
+		}
+		fclose(snp_locs);
+#endif
+
+		FILE *refdict_file = fopen(refdict_filename, "wb");
+		assert(refdict_file);
+
+		if (measure)
+			perf_begin(&perf, "ref_dict");
+		make_ref_dict(ref, refdict_file, &dict_opts);
+		fclose(refdict_file);
+		if (measure)
+			perf_end(&perf);
+
+		free(snp_locations);
+
+		seqvec_dealloc(&ref);
+		fclose(snp_file);
+		fclose(snpdict_file);
+
+		if (measure)
+			perf_finish(&perf, perf_json);
+	} else if (STREQ(opt, "filt")) {
+		static const char *filt_flags[] = {"--perf", "--perf=", NULL};
+		arg_check(argc, argv, 3, filt_flags);
+
+		const char *refdict_filename = param(argc, argv, 0);
+		const char *snp_pos_filename = param(argc, argv, 1);
+		const char *out_filename = param(argc, argv, 2);
+
+		PerfStats perf;
+		bool perf_json;
+		const bool measure = parse_perf(argc, argv, &perf_json);
+		if (measure)
+			perf_init(&perf, true);
+
+		FILE *refdict_file = fopen(refdict_filename, "rb");
+		assert(refdict_file);
+
+		FILE *snp_pos_file = fopen(snp_pos_filename, "rb");
+		assert(snp_pos_file);
+
+		FILE *out_file = fopen(out_filename, "wb");
+		assert(out_file);
+
+		if (measure)
+			perf_begin(&perf, "filter");
+		dict_filt(refdict_file, snp_pos_file, out_file);
+		if (measure) {
+			perf_end(&perf);
+			perf_finish(&perf, perf_json);
+		}
+	} else if (STREQ(opt, "stats")) {
+		arg_check(argc, argv, 1, NULL);
+
+		FILE *dict_file = fopen(param(argc, argv, 0), "rb");
+		assert(dict_file);
+
+		dict_stats(dict_file, stdout);
+		fclose(dict_file);
+	} else if (STREQ(opt, "load")) {
+		arg_check(argc, argv, 3, NULL);
+		const char *refdict_filename = param(argc, argv, 0);
+		const char *snpdict_filename = param(argc, argv, 1);
+		const char *segment_name = param(argc, argv, 2);
+
+		FILE *refdict_file = fopen(refdict_filename, "rb");
+		assert(refdict_file);
+
+		FILE *snpdict_file = fopen(snpdict_filename, "rb");
+		assert(snpdict_file);
+
+		lava_dicts_publish(refdict_file, snpdict_file, segment_name);
+
+		fclose(refdict_file);
+		fclose(snpdict_file);
+	} else if (STREQ(opt, "unload")) {
+		arg_check(argc, argv, 1, NULL);
+		segment_remove(param(argc, argv, 0));
+	} else if (STREQ(opt, "lava")) {
+		static const char *lava_flags[] = {"--threads=", "--binary", "--hugetlb", "--prefault", "--mlock", "--numa=", "--shm=", "--max-mem=",
+		                                   "--perf", "--perf=", "--stats=", "--progress=", "--no-progress", "--status-file=", NULL};
+		const char *segment_name = flag_value(argc, argv, "--shm=");
+		const int dict_params = segment_name ? 0 : 2;  /* the dictionaries come from the segment */
+		arg_check(argc, argv, dict_params + 3, lava_flags);
+		const char *refdict_filename = segment_name ? NULL : param(argc, argv, 0);
+		const char *snpdict_filename = segment_name ? NULL : param(argc, argv, 1);
+		const char *fastq_filename = param(argc, argv, dict_params);
+		const char *chrlens_filename = param(argc, argv, dict_params + 1);
+		const char *out_filename = param(argc, argv, dict_params + 2);
+		const unsigned threads = parse_threads(argc, argv);
+		const bool binary_out = has_flag(argc, argv, "--binary");
+		const MemOptions mem_opts = parse_mem_opts(argc, argv, threads, 1);
+		const NumaPolicy numa = parse_numa(argc, argv);
+
+		FILE *refdict_file = NULL;
+		FILE *snpdict_file = NULL;
+
+		if (segment_name == NULL) {
+			refdict_file = fopen(refdict_filename, "rb");
+			assert(refdict_file);
+
+			snpdict_file = fopen(snpdict_filename, "rb");
+			assert(snpdict_file);
+		}
+
+		FILE *fastq_file = fopen(fastq_filename, "r");
+		assert(fastq_file);
+
+		FILE *chrlens_file = fopen(chrlens_filename, "r");
+		assert(chrlens_file);
+
+		char stats_filename[4096];
+		stats_path(argc, argv, out_filename, stats_filename, sizeof(stats_filename));
+		const unsigned progress_interval = has_flag(argc, argv, "--no-progress") ? 0 :
+		                                   parse_count(argc, argv, "--progress=", PROGRESS_DEFAULT_INTERVAL, "progress interval");
+		const char *status_filename = flag_value(argc, argv, "--status-file=");
+
+		/* stages are always timed; hardware counters are only read with `--perf` */
+		PerfStats perf;
+		bool perf_json;
+		const bool report_perf = parse_perf(argc, argv, &perf_json);
+		perf_init(&perf, report_perf);
+
+		genotype(refdict_file, snpdict_file, segment_name, fastq_file, chrlens_file, out_filename,
+		         threads, binary_out, &mem_opts, numa, &perf, fastq_filename, stats_filename,
+		         progress_interval, status_filename);
+
+		if (report_perf)
+			perf_report(&perf, stderr, perf_json);
+		perf_dealloc(&perf);
+
+		if (segment_name == NULL) {
+			fclose(refdict_file);
+			fclose(snpdict_file);
+		}
+		fclose(fastq_file);
+		fclose(chrlens_file);
+	} else if (STREQ(opt, "batch")) {
+		static const char *batch_flags[] = {"--threads=", "--binary", "--hugetlb", "--prefault", "--mlock", "--numa=", "--shm=",
+		                                    "--max-mem=", "--samples=", NULL};
+		const char *segment_name = flag_value(argc, argv, "--shm=");
+		const int dict_params = segment_name ? 0 : 2;  /* the dictionaries come from the segment */
+		arg_check(argc, argv, dict_params + 2, batch_flags);
+		const char *chrlens_filename = param(argc, argv, dict_params);
+		const char *manifest_filename = param(argc, argv, dict_params + 1);
+		const unsigned threads = parse_threads(argc, argv);
+		const unsigned samples = parse_count(argc, argv, "--samples=", 1, "concurrent sample count");
+		const bool binary_out = has_flag(argc, argv, "--binary");
+		const MemOptions mem_opts = parse_mem_opts(argc, argv, threads, samples);
+		const NumaPolicy numa = parse_numa(argc, argv);
+
+		FILE *refdict_file = NULL;
+		FILE *snpdict_file = NULL;
+
+		if (segment_name == NULL) {
+			refdict_file = fopen(param(argc, argv, 0), "rb");
+			assert(refdict_file);
+
+			snpdict_file = fopen(param(argc, argv, 1), "rb");
+			assert(snpdict_file);
+		}
+
+		FILE *chrlens_file = fopen(chrlens_filename, "r");
+		assert(chrlens_file);
+
+		FILE *manifest_file = fopen(manifest_filename, "r");
+		assert(manifest_file);
+
+		const size_t failed = genotype_batch(refdict_file, snpdict_file, segment_name, chrlens_file, manifest_file,
+		                                     threads, samples, binary_out, &mem_opts, numa);
+
+		if (segment_name == NULL) {
+			fclose(refdict_file);
+			fclose(snpdict_file);
+		}
+		fclose(chrlens_file);
+		fclose(manifest_file);
+
+		if (failed) {
+			fprintf(stderr, "%lu samples failed\n", failed);
+			exit(EXIT_FAILURE);
+		}
+	} else if (STREQ(opt, "serve")) {
+		static const char *serve_flags[] = {"--threads=", "--binary", "--hugetlb", "--prefault", "--mlock", "--numa=", "--shm=",
+		                                    "--max-mem=", "--samples=", "--queue=", NULL};
+		const char *segment_name = flag_value(argc, argv, "--shm=");
+		const int dict_params = segment_name ? 0 : 2;  /* the dictionaries come from the segment */
+		arg_check(argc, argv, dict_params + 2, serve_flags);
+		const char *chrlens_filename = param(argc, argv, dict_params);
+		const char *socket_path = param(argc, argv, dict_params + 1);
+		const unsigned threads = parse_threads(argc, argv);
+		const unsigned samples = parse_count(argc, argv, "--samples=", 1, "concurrent sample count");
+		const unsigned queue = parse_count(argc, argv, "--queue=", SERVE_DEFAULT_QUEUE, "queue capacity");
+		const bool binary_out = has_flag(argc, argv, "--binary");
+		const MemOptions mem_opts = parse_mem_opts(argc, argv, threads, samples);
+		const NumaPolicy numa = parse_numa(argc, argv);
+
+		FILE *refdict_file = NULL;
+		FILE *snpdict_file = NULL;
+
+		if (segment_name == NULL) {
+			refdict_file = fopen(param(argc, argv, 0), "rb");
+			assert(refdict_file);
+
+			snpdict_file = fopen(param(argc, argv, 1), "rb");
+			assert(snpdict_file);
+		}
+
+		FILE *chrlens_file = fopen(chrlens_filename, "r");
+		assert(chrlens_file);
+
+		serve(refdict_file, snpdict_file, segment_name, chrlens_file, socket_path,
+		      threads, samples, queue, binary_out, &mem_opts, numa);
+
+		if (segment_name == NULL) {
+			fclose(refdict_file);
+			fclose(snpdict_file);
+		}
+		fclose(chrlens_file);
+	} else if (STREQ(opt, "submit")) {
+		static const char *submit_flags[] = {"--binary", "--text", NULL};
+		arg_check(argc, argv, 4, submit_flags);
+		const char *format = has_flag(argc, argv, "--binary") ? "binary" :
+		                     has_flag(argc, argv, "--text") ? "text" : NULL;
+
+		if (!submit(param(argc, argv, 0), param(argc, argv, 1), param(argc, argv, 2), param(argc, argv, 3), format))
+			exit(EXIT_FAILURE);
+	} else if (STREQ(opt, "status")) {
+		static const char *status_flags[] = {"--shutdown", NULL};
+		arg_check(argc, argv, 1, status_flags);
+		const bool shutdown = has_flag(argc, argv, "--shutdown");
+
+		if (!serve_client(param(argc, argv, 0), shutdown ? "shutdown" : "status", shutdown ? "ok" : "end"))
+			exit(EXIT_FAILURE);
+	} else if (STREQ(opt, "sim")) {
+		static const char *sim_flags[] = {"--genome=", "--chroms=", "--snp-rate=", "--repeats=", "--read-len=", "--coverage=",
+		                                  "--error=", "--seed=", NULL};
+		arg_check(argc, argv, 1, sim_flags);
+
+		SimOptions sim_opts;
+		sim_options_default(&sim_opts);
+		sim_opts.genome_len = parse_real(argc, argv, "--genome=", sim_opts.genome_len, 1000, POS_WIDE_LIMIT - 1, "genome length");
+		sim_opts.n_chroms = parse_count(argc, argv, "--chroms=", sim_opts.n_chroms, "contig count");
+		sim_opts.snp_rate = parse_real(argc, argv, "--snp-rate=", sim_opts.snp_rate, 0, 1, "SNP rate");
+		sim_opts.repeat_frac = parse_real(argc, argv, "--repeats=", sim_opts.repeat_frac, 0, 1, "repeat fraction");
+		sim_opts.read_len = parse_count(argc, argv, "--read-len=", sim_opts.read_len, "read length");
+		sim_opts.coverage = parse_real(argc, argv, "--coverage=", sim_opts.coverage, 0, 1e6, "coverage");
+		sim_opts.error_rate = parse_real(argc, argv, "--error=", sim_opts.error_rate, 0, 1, "error rate");
+		sim_opts.seed = parse_real(argc, argv, "--seed=", sim_opts.seed, 0, UINT32_MAX, "seed");
+
+		if (sim_opts.read_len < 32 || sim_opts.genome_len / sim_opts.n_chroms < 2*sim_opts.read_len) {
+			fprintf(stderr, "Reads must have at least 32 bases and fit in the contigs at least twice\n");
+			exit(EXIT_FAILURE);
+		}
+
+		sim_generate(&sim_opts, param(argc, argv, 0));
+	} else if (STREQ(opt, "concord")) {
+		arg_check(argc, argv, 2, NULL);
+
+		FILE *truth_file = fopen(param(argc, argv, 0), "r");
+		assert(truth_file);
+
+		FILE *calls_file = fopen(param(argc, argv, 1), "rb");
+		assert(calls_file);
+
+		sim_concordance(truth_file, calls_file, stdout);
+
+		fclose(truth_file);
+		fclose(calls_file);
+	} else if (STREQ(opt, "help")) {
+		print_help();
+		exit(EXIT_SUCCESS);
+	} else {
+		print_help();
+		exit(EXIT_FAILURE);
+	}
+}
+
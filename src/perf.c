@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <assert.h>
+#include "util.h"
+#include "perf.h"
+
+static const struct {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} events[PERF_N_EVENTS] = {
+	[PERF_CYCLES]       = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	[PERF_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	[PERF_CACHE_MISSES] = {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	[PERF_DTLB_MISSES]  = {"dtlb_misses", PERF_TYPE_HW_CACHE,
+	                       PERF_COUNT_HW_CACHE_DTLB |
+	                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+	                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+	[PERF_BRANCH_MISSES] = {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static double wall_seconds(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+static int event_open(const unsigned e)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[e].type;
+	attr.config = events[e].config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;  /* allowed at the default `perf_event_paranoid` */
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* the count of `fd` so far, scaled up for the time the event wasn't scheduled (when multiplexed) */
+static uint64_t event_read(const int fd)
+{
+	uint64_t v[3];  /* value, time enabled, time running */
+	if (read(fd, v, sizeof(v)) != sizeof(v) || v[2] == 0)
+		return 0;
+	return (v[2] < v[1]) ? (uint64_t)((double)v[0] * v[1] / v[2]) : v[0];
+}
+
+void perf_init(PerfStats *p, const bool counters)
+{
+	memset(p, 0, sizeof(*p));
+	p->error = counters ? 0 : ENOSYS;
+
+	for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+		p->fds[e] = counters ? event_open(e) : -1;
+
+		if (p->fds[e] >= 0)
+			++p->n_open;
+		else if (counters && p->error == 0)
+			p->error = errno;
+	}
+
+	if (p->n_open > 0)
+		p->error = 0;
+	else if (counters)
+		fprintf(stderr, "Hardware counters unavailable (%s); timing stages by the wall clock only\n", strerror(p->error));
+}
+
+void perf_dealloc(PerfStats *p)
+{
+	for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+		if (p->fds[e] >= 0)
+			close(p->fds[e]);
+	}
+}
+
+void perf_begin(PerfStats *p, const char *stage)
+{
+	assert(p->current == NULL);
+
+	PerfStage *s = NULL;
+	for (unsigned i = 0; i < p->n_stages; i++) {
+		if (STREQ(p->stages[i].name, stage)) {
+			s = &p->stages[i];
+			break;
+		}
+	}
+
+	if (s == NULL) {
+		assert(p->n_stages < PERF_MAX_STAGES);
+		s = &p->stages[p->n_stages++];
+		s->name = stage;
+	}
+
+	p->current = s;
+	for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+		p->start_counts[e] = (p->fds[e] >= 0) ? event_read(p->fds[e]) : 0;
+	}
+	p->start = wall_seconds();
+}
+
+void perf_end(PerfStats *p)
+{
+	const double end = wall_seconds();
+	PerfStage *s = p->current;
+	assert(s != NULL);
+
+	for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+		if (p->fds[e] >= 0)
+			s->counts[e] += event_read(p->fds[e]) - p->start_counts[e];
+	}
+	s->seconds += end - p->start;
+	++s->runs;
+	p->current = NULL;
+}
+
+static void print_count(const PerfStats *p, const PerfStage *s, const unsigned e, FILE *out)
+{
+	if (p->fds[e] >= 0)
+		fprintf(out, " %15lu", s->counts[e]);
+	else
+		fprintf(out, " %15s", "-");
+}
+
+void perf_report(const PerfStats *p, FILE *out, const bool json)
+{
+	if (json) {
+		fprintf(out, "{\"counters\": %s, \"stages\": [", p->n_open ? "true" : "false");
+		for (unsigned i = 0; i < p->n_stages; i++) {
+			const PerfStage *s = &p->stages[i];
+			fprintf(out, "%s\n  {\"stage\": \"%s\", \"runs\": %u, \"seconds\": %.6f",
+			        i ? "," : "", s->name, s->runs, s->seconds);
+			for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+				if (p->fds[e] >= 0)
+					fprintf(out, ", \"%s\": %lu", events[e].name, s->counts[e]);
+				else
+					fprintf(out, ", \"%s\": null", events[e].name);
+			}
+			fprintf(out, "}");
+		}
+		fprintf(out, "\n]}\n");
+		return;
+	}
+
+	fprintf(out, "%-10s %10s", "stage", "seconds");
+	for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+		fprintf(out, " %15s", events[e].name);
+	}
+	fprintf(out, " %6s\n", "IPC");
+
+	for (unsigned i = 0; i < p->n_stages; i++) {
+		const PerfStage *s = &p->stages[i];
+		fprintf(out, "%-10s %10.3f", s->name, s->seconds);
+		for (unsigned e = 0; e < PERF_N_EVENTS; e++) {
+			print_count(p, s, e, out);
+		}
+
+		if (p->fds[PERF_CYCLES] >= 0 && p->fds[PERF_INSTRUCTIONS] >= 0 && s->counts[PERF_CYCLES] > 0)
+			fprintf(out, " %6.2f\n", (double)s->counts[PERF_INSTRUCTIONS] / s->counts[PERF_CYCLES]);
+		else
+			fprintf(out, " %6s\n", "-");
+	}
+}
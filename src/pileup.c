@@ -18,12 +18,12 @@ void ptable_init(PileupTable *p, const size_t size)
 
 void ptable_dealloc(PileupTable *p)
 {
-	struct pileup_entry **table = p->table;
+	struct ptable_entry **table = p->table;
 	const size_t size = p->size;
 	for (size_t i = 0; i < size; i++) {
-		struct pileup_entry *e = table[i];
+		struct ptable_entry *e = table[i];
 		while (e != NULL) {
-			struct pileup_entry *temp = e;
+			struct ptable_entry *temp = e;
 			e = e->next;
 			free(temp);
 		}
@@ -34,17 +34,17 @@ void ptable_dealloc(PileupTable *p)
 static void grow(PileupTable *p)
 {
 	const size_t size = p->size;
-	struct pileup_entry **table = p->table;
+	struct ptable_entry **table = p->table;
 
 	const size_t new_size = 2*size;
-	struct pileup_entry **new_table = calloc(new_size, sizeof(*new_table));
+	struct ptable_entry **new_table = calloc(new_size, sizeof(*new_table));
 	assert(new_table);
 
 	for (size_t i = 0; i < size; i++) {
-		struct pileup_entry *e = table[i];
+		struct ptable_entry *e = table[i];
 		while (e != NULL) {
-			struct pileup_entry *next = e->next;
-			const uint32_t n = hash(e->key) & (new_size - 1);
+			struct ptable_entry *next = e->next;
+			const uint32_t n = ptable_hash(e->key) & (new_size - 1);
 			e->next = new_table[n];
 			new_table[n] = e;
 			e = next;
@@ -57,7 +57,7 @@ static void grow(PileupTable *p)
 	free(table);
 }
 
-void ptable_add(PileupTable *p, const uint32_t key,
+void ptable_add(PileupTable *p, const uint64_t key,
                 unsigned ref, unsigned alt,
                 uint8_t ref_freq, uint8_t alt_freq)
 {
@@ -66,17 +66,18 @@ void ptable_add(PileupTable *p, const uint32_t key,
 	}
 
 	const size_t size = p->size;
-	struct pileup_entry **table = p->table;
+	struct ptable_entry **table = p->table;
 
-	const uint32_t n = hash(key) & (size - 1);
+	const uint32_t n = ptable_hash(key) & (size - 1);
 
-	struct pileup_entry *e = malloc(sizeof(*e));
-	e->ref = ref;
-	e->alt = alt;
-	e->ref_cnt = 0;
-	e->alt_cnt = 0;
-	e->ref_freq = ref_freq;
-	e->alt_freq = alt_freq;
+	struct ptable_entry *e = malloc(sizeof(*e));
+	assert(e);
+	e->entry.ref = ref;
+	e->entry.alt = alt;
+	e->entry.ref_cnt = 0;
+	e->entry.alt_cnt = 0;
+	e->entry.ref_freq = ref_freq;
+	e->entry.alt_freq = alt_freq;
 	e->key = key;
 	e->next = table[n];
 	table[n] = e;
@@ -86,3 +87,24 @@ void ptable_add(PileupTable *p, const uint32_t key,
 	}
 }
 
+
+size_t ptable_bytes(const PileupTable *p)
+{
+	return p->size * sizeof(*p->table) + p->count * (sizeof(struct ptable_entry) + PTABLE_ALLOC_OVERHEAD);
+}
+
+size_t ptable_size_for(const size_t count)
+{
+	size_t size = 1024;
+	while (count > (size_t)(size * LOAD_FACTOR))
+		size *= 2;
+	return size;
+}
+
+size_t ptable_bytes_for(size_t size, const size_t count)
+{
+	/* as `ptable_add` grows it */
+	while (count > 0 && count - 1 > (size_t)(size * LOAD_FACTOR))
+		size *= 2;
+	return size * sizeof(struct ptable_entry *) + count * (sizeof(struct ptable_entry) + PTABLE_ALLOC_OVERHEAD);
+}
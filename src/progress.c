@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+#include "progress.h"
+
+static double elapsed(const struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) + (now.tv_nsec - since->tv_nsec)/1e9;
+}
+
+static uint64_t rss_bytes(void)
+{
+	FILE *statm = fopen("/proc/self/statm", "r");
+	unsigned long pages = 0;
+
+	if (statm == NULL)
+		return 0;
+	if (fscanf(statm, "%*u %lu", &pages) != 1)
+		pages = 0;
+	fclose(statm);
+	return (uint64_t)pages * sysconf(_SC_PAGESIZE);
+}
+
+static void sample(ProgressMonitor *m)
+{
+	const unsigned i = m->window_next;
+	m->window_t[i] = elapsed(&m->start);
+	m->window_reads[i] = __atomic_load_n(&m->progress->reads, __ATOMIC_RELAXED);
+	m->window_bytes[i] = __atomic_load_n(&m->progress->bytes, __ATOMIC_RELAXED);
+
+	m->window_next = (i + 1) % (PROGRESS_WINDOW + 1);
+	if (m->window_len < PROGRESS_WINDOW + 1)
+		++m->window_len;
+}
+
+/* writes `h:mm:ss` to `buf` */
+static void format_duration(char *buf, const size_t len, const double seconds)
+{
+	const unsigned long s = (unsigned long)(seconds + 0.5);
+	snprintf(buf, len, "%lu:%02lu:%02lu", s/3600, (s/60) % 60, s % 60);
+}
+
+static void write_status(ProgressMonitor *m, const bool done, const double t, const uint64_t reads, const uint64_t bytes,
+                         const double read_rate, const double placed, const double eta, const uint64_t rss)
+{
+	char tmp_filename[4096];
+	assert((size_t)snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", m->status_filename) < sizeof(tmp_filename));
+
+	FILE *out = fopen(tmp_filename, "w");
+	bool ok = (out != NULL);
+
+	if (ok) {
+		fprintf(out, "{\"state\": \"%s\", \"updated\": %ld, \"elapsed_seconds\": %.1f, \"reads\": %lu, "
+		             "\"bytes\": %lu, \"total_bytes\": %lu, \"reads_per_second\": %.1f, \"placed_fraction\": %.4f, ",
+		        done ? "done" : "running", (long)time(NULL), t, reads, bytes, m->total_bytes, read_rate, placed);
+		if (eta >= 0)
+			fprintf(out, "\"eta_seconds\": %.0f, ", eta);
+		else
+			fprintf(out, "\"eta_seconds\": null, ");
+		fprintf(out, "\"rss_bytes\": %lu}\n", rss);
+
+		ok = (fclose(out) == 0) && (rename(tmp_filename, m->status_filename) == 0);
+	}
+
+	if (!ok && !m->status_failed) {
+		fprintf(stderr, "Could not write status file %s: %s\n", m->status_filename, strerror(errno));
+		m->status_failed = true;
+	}
+}
+
+static void report(ProgressMonitor *m, const bool done)
+{
+	const unsigned newest = (m->window_next + PROGRESS_WINDOW) % (PROGRESS_WINDOW + 1);
+	const unsigned oldest = (m->window_len < PROGRESS_WINDOW + 1) ? 0 : m->window_next;
+	const double t = m->window_t[newest];
+	const uint64_t reads = m->window_reads[newest];
+	const uint64_t bytes = m->window_bytes[newest];
+	const uint64_t placed = __atomic_load_n(&m->progress->placed, __ATOMIC_RELAXED);
+
+	/* over the whole run at the end, and over the window before that */
+	const unsigned from = done ? newest : oldest;
+	const double span = done ? t : t - m->window_t[from];
+	const double read_rate = (span > 0) ? (reads - (done ? 0 : m->window_reads[from])) / span : 0;
+	const double byte_rate = (span > 0) ? (bytes - (done ? 0 : m->window_bytes[from])) / span : 0;
+	const double placed_frac = reads ? (double)placed / reads : 0;
+	const double eta = done ? 0 :
+	                   (m->total_bytes > bytes && byte_rate > 0) ? (m->total_bytes - bytes) / byte_rate :
+	                   (m->total_bytes > 0 && bytes >= m->total_bytes) ? 0 : -1;
+	const uint64_t rss = rss_bytes();
+
+	if (m->print) {
+		char elapsed_str[32], eta_str[32], total_str[64];
+		format_duration(elapsed_str, sizeof(elapsed_str), t);
+		if (eta >= 0)
+			format_duration(eta_str, sizeof(eta_str), eta);
+		else
+			snprintf(eta_str, sizeof(eta_str), "unknown");
+		if (m->total_bytes > 0)
+			snprintf(total_str, sizeof(total_str), " of %.1f MiB (%.1f%%)", m->total_bytes / 1048576.0,
+			         100.0 * bytes / m->total_bytes);
+		else
+			total_str[0] = '\0';
+
+		fprintf(stderr, "%s %s: %lu reads, %.1f MiB%s, %.0f reads/s, %.1f%% placed, ETA %s, RSS %.2f GiB\n",
+		        done ? "Done" : "Progress", elapsed_str, reads, bytes / 1048576.0, total_str,
+		        read_rate, 100.0 * placed_frac, eta_str, rss / 1073741824.0);
+	}
+
+	if (m->status_filename != NULL)
+		write_status(m, done, t, reads, bytes, read_rate, placed_frac, eta, rss);
+}
+
+static void *monitor_run(void *arg)
+{
+	ProgressMonitor *m = arg;
+	unsigned ticks = 0;
+
+	assert(pthread_mutex_lock(&m->lock) == 0);
+
+	while (!m->stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		++deadline.tv_sec;
+
+		while (!m->stop && pthread_cond_timedwait(&m->cond, &m->lock, &deadline) != ETIMEDOUT)
+			;
+		if (m->stop)
+			break;
+
+		sample(m);
+		if (++ticks % m->interval == 0)
+			report(m, false);
+	}
+
+	assert(pthread_mutex_unlock(&m->lock) == 0);
+	return NULL;
+}
+
+void progress_monitor_start(ProgressMonitor *m,
+                            LavaProgress *progress,
+                            const uint64_t total_bytes,
+                            const unsigned interval,
+                            const bool print,
+                            const char *status_filename)
+{
+	assert(interval > 0);
+	memset(m, 0, sizeof(*m));
+	m->progress = progress;
+	m->total_bytes = total_bytes;
+	m->interval = interval;
+	m->print = print;
+	m->status_filename = status_filename;
+	clock_gettime(CLOCK_MONOTONIC, &m->start);
+	sample(m);
+
+	pthread_condattr_t attr;
+	assert(pthread_condattr_init(&attr) == 0);
+	assert(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0);
+	assert(pthread_cond_init(&m->cond, &attr) == 0);
+	pthread_condattr_destroy(&attr);
+	assert(pthread_mutex_init(&m->lock, NULL) == 0);
+
+	if (m->status_filename != NULL)
+		report(m, false);  /* so that the file exists from the start */
+
+	assert(pthread_create(&m->thread, NULL, monitor_run, m) == 0);
+}
+
+void progress_monitor_stop(ProgressMonitor *m)
+{
+	assert(pthread_mutex_lock(&m->lock) == 0);
+	m->stop = true;
+	assert(pthread_cond_signal(&m->cond) == 0);
+	assert(pthread_mutex_unlock(&m->lock) == 0);
+	assert(pthread_join(m->thread, NULL) == 0);
+
+	sample(m);
+	report(m, true);
+
+	pthread_cond_destroy(&m->cond);
+	pthread_mutex_destroy(&m->lock);
+}
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include "segment.h"
+
+/* segments are sized in whole huge pages, as hugetlbfs requires */
+#define SEGMENT_SIZE_ALIGN (1UL << 21)
+
+static size_t round_up(const size_t x, const size_t align)
+{
+	return (x + align - 1) & ~(align - 1);
+}
+
+static bool is_path(const char *name)
+{
+	return strchr(name, '/') != NULL;
+}
+
+/* `shm_open` wants names of the form "/name" */
+static void shm_name(const char *name, char *buf, const size_t len)
+{
+	assert((size_t)snprintf(buf, len, "/%s", name) < len);
+}
+
+static int segment_open(const char *name, const int flags, const mode_t mode)
+{
+	if (is_path(name))
+		return open(name, flags, mode);
+
+	char buf[256];
+	shm_name(name, buf, sizeof(buf));
+	return shm_open(buf, flags, mode);
+}
+
+void segment_publish(const char *name, const uint64_t layout,
+                     const void *meta, const size_t meta_size,
+                     void *const *arrays, const size_t *sizes, const size_t n)
+{
+	assert(n <= SEGMENT_MAX_ARRAYS);
+
+	struct segment_header header = {.magic = 0,
+	                                .version = SEGMENT_VERSION,
+	                                .layout = layout,
+	                                .meta_offset = round_up(sizeof(header), SEGMENT_ALIGN),
+	                                .meta_size = meta_size,
+	                                .n_arrays = n};
+
+	size_t offset = round_up(header.meta_offset + meta_size, SEGMENT_ALIGN);
+	for (size_t i = 0; i < n; i++) {
+		assert(arrays[i] != NULL || sizes[i] == 0);
+		header.arrays[i] = (struct segment_array){.offset = offset, .size = sizes[i]};
+		offset = round_up(offset + sizes[i], SEGMENT_ALIGN);
+	}
+	header.size = round_up(offset, SEGMENT_SIZE_ALIGN);
+
+	const int fd = segment_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Could not create segment %s: %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (ftruncate(fd, header.size) != 0) {
+		fprintf(stderr, "Could not size segment %s to %lu bytes: %s\n", name, header.size, strerror(errno));
+		close(fd);
+		segment_remove(name);
+		exit(EXIT_FAILURE);
+	}
+
+	uint8_t *base = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	assert(base != MAP_FAILED);
+	close(fd);
+
+	memcpy(base + header.meta_offset, meta, meta_size);
+	for (size_t i = 0; i < n; i++) {
+		if (sizes[i])
+			memcpy(base + header.arrays[i].offset, arrays[i], sizes[i]);
+	}
+	memcpy(base, &header, sizeof(header));
+
+	/* readers check the magic first, so it goes in once everything else is there */
+	__atomic_store_n((uint64_t *)base, SEGMENT_MAGIC, __ATOMIC_RELEASE);
+
+	assert(munmap(base, header.size) == 0);
+}
+
+void segment_attach(Segment *s, const char *name, const uint64_t layout)
+{
+	const int fd = segment_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open segment %s: %s (see `lava load`)\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	struct stat st;
+	assert(fstat(fd, &st) == 0);
+
+	if ((size_t)st.st_size < sizeof(struct segment_header)) {
+		fprintf(stderr, "Segment %s is not a lava segment\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	s->size = st.st_size;
+	s->base = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fd, 0);
+	assert(s->base != MAP_FAILED);
+	close(fd);
+
+	const struct segment_header *header = (const struct segment_header *)s->base;
+
+	if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SEGMENT_MAGIC) {
+		fprintf(stderr, "Segment %s is not a lava segment, or is still being loaded\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	if (header->version != SEGMENT_VERSION || header->layout != layout) {
+		fprintf(stderr, "Segment %s was loaded by an incompatible version of lava; reload it\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	assert(header->size == s->size);
+	assert(header->n_arrays <= SEGMENT_MAX_ARRAYS);
+}
+
+void segment_detach(Segment *s)
+{
+	assert(munmap(s->base, s->size) == 0);
+	s->base = NULL;
+	s->size = 0;
+}
+
+void segment_remove(const char *name)
+{
+	int ret;
+
+	if (is_path(name)) {
+		ret = unlink(name);
+	} else {
+		char buf[256];
+		shm_name(name, buf, sizeof(buf));
+		ret = shm_unlink(buf);
+	}
+
+	if (ret != 0) {
+		fprintf(stderr, "Could not remove segment %s: %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+}
+
+const void *segment_meta(const Segment *s, const size_t meta_size)
+{
+	const struct segment_header *header = (const struct segment_header *)s->base;
+	assert(header->meta_size == meta_size);
+	return s->base + header->meta_offset;
+}
+
+const void *segment_array(const Segment *s, const size_t i, size_t *size)
+{
+	const struct segment_header *header = (const struct segment_header *)s->base;
+	assert(i < header->n_arrays);
+
+	*size = header->arrays[i].size;
+	return *size ? s->base + header->arrays[i].offset : NULL;
+}
@@ -0,0 +1,479 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include "lava.h"
+#include "util.h"
+#include "sim.h"
+
+#define FASTA_LINE_LEN  60
+#define REPEAT_LEN      300   /* length of each copied segment */
+#define SNP_MARGIN      32    /* `lava dict` ignores SNPs this close to a contig end */
+#define CALLS_MAGIC     0x534c4c4143564c4cUL  /* see `write_calls` */
+
+static const char bases[] = {'A', 'C', 'G', 'T'};
+
+struct sim_snp {
+	uint64_t pos;  /* 0-based, within its contig */
+	char ref;
+	char alt;
+	uint8_t genotype;  /* number of alt alleles */
+	float ref_freq;
+};
+
+struct sim_chrom {
+	char name[32];
+	char *seq;
+	uint64_t len;
+	struct sim_snp *snps;
+	size_t n_snps;
+};
+
+/* splitmix64, so that a seed gives the same data everywhere */
+static uint64_t rng_next(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15UL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+	return z ^ (z >> 31);
+}
+
+static double rng_uniform(uint64_t *state)
+{
+	return (rng_next(state) >> 11) * (1.0 / (1UL << 53));
+}
+
+static uint64_t rng_below(uint64_t *state, const uint64_t n)
+{
+	return rng_next(state) % n;
+}
+
+static char complement(const char c)
+{
+	switch (c) {
+	case 'A': return 'T';
+	case 'C': return 'G';
+	case 'G': return 'C';
+	case 'T': return 'A';
+	default:  return c;
+	}
+}
+
+static char other_base(uint64_t *rng, const char b)
+{
+	char c;
+	do {
+		c = bases[rng_below(rng, 4)];
+	} while (c == b);
+	return c;
+}
+
+void sim_options_default(SimOptions *opts)
+{
+	opts->seed = 1;
+	opts->genome_len = 1000000;
+	opts->n_chroms = 3;
+	opts->snp_rate = 0.003;
+	opts->repeat_frac = 0.02;
+	opts->read_len = READ_LEN;
+	opts->coverage = 10.0;
+	opts->error_rate = 0.01;
+}
+
+static FILE *open_output(const char *prefix, const char *ext)
+{
+	char filename[4096];
+	assert((size_t)snprintf(filename, sizeof(filename), "%s%s", prefix, ext) < sizeof(filename));
+
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Could not create %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	return f;
+}
+
+static void make_chrom(struct sim_chrom *chrom, const unsigned i, const uint64_t len, const SimOptions *opts, uint64_t *rng)
+{
+	snprintf(chrom->name, sizeof(chrom->name), "chr%u", i + 1);
+	chrom->len = len;
+	chrom->seq = malloc(len + 1);
+	assert(chrom->seq);
+
+	for (uint64_t j = 0; j < len; j++) {
+		chrom->seq[j] = bases[rng_below(rng, 4)];
+	}
+	chrom->seq[len] = '\0';
+
+	/* copies make k-mers that occur more than once, like real repeats */
+	if (len > 2*REPEAT_LEN) {
+		const uint64_t n_repeats = (uint64_t)(opts->repeat_frac * len / REPEAT_LEN);
+		for (uint64_t r = 0; r < n_repeats; r++) {
+			const uint64_t src = rng_below(rng, len - REPEAT_LEN);
+			const uint64_t dst = rng_below(rng, len - REPEAT_LEN);
+			memmove(&chrom->seq[dst], &chrom->seq[src], REPEAT_LEN);
+		}
+	}
+
+	size_t cap = 0;
+	chrom->snps = NULL;
+	chrom->n_snps = 0;
+
+	for (uint64_t pos = SNP_MARGIN; pos + SNP_MARGIN < len; pos++) {
+		if (rng_uniform(rng) >= opts->snp_rate)
+			continue;
+
+		if (chrom->n_snps == cap) {
+			cap = cap ? 2*cap : 1024;
+			chrom->snps = realloc(chrom->snps, cap * sizeof(*chrom->snps));
+			assert(chrom->snps);
+		}
+
+		struct sim_snp *snp = &chrom->snps[chrom->n_snps++];
+		snp->pos = pos;
+		snp->ref = chrom->seq[pos];
+		snp->alt = other_base(rng, snp->ref);
+		snp->ref_freq = 0.05 + 0.9*rng_uniform(rng);
+
+		/* Hardy-Weinberg */
+		const double p = snp->ref_freq;
+		const double u = rng_uniform(rng);
+		snp->genotype = (u < p*p) ? 0 : (u < p*p + 2*p*(1 - p)) ? 1 : 2;
+	}
+}
+
+static void write_fasta(const struct sim_chrom *chroms, const unsigned n, FILE *out)
+{
+	for (unsigned i = 0; i < n; i++) {
+		fprintf(out, ">%s simulated\n", chroms[i].name);
+		for (uint64_t j = 0; j < chroms[i].len; j += FASTA_LINE_LEN) {
+			const int line_len = (chroms[i].len - j < FASTA_LINE_LEN) ? (int)(chroms[i].len - j) : FASTA_LINE_LEN;
+			fprintf(out, "%.*s\n", line_len, &chroms[i].seq[j]);
+		}
+	}
+}
+
+/*
+ * One line per SNP, with the fields that `make_snp_dict` reads filled in
+ * and the rest given placeholder values. Some SNPs are given on the minus
+ * strand, as in dbSNP.
+ */
+static void write_snps(const struct sim_chrom *chroms, const unsigned n, FILE *out, uint64_t *rng)
+{
+	size_t id = 0;
+
+	for (unsigned i = 0; i < n; i++) {
+		for (size_t k = 0; k < chroms[i].n_snps; k++) {
+			const struct sim_snp *snp = &chroms[i].snps[k];
+			const bool neg = (rng_uniform(rng) < 0.1);
+			const char a1 = neg ? complement(snp->ref) : snp->ref;
+			const char a2 = neg ? complement(snp->alt) : snp->alt;
+
+			fprintf(out,
+			        "0\t%s\t%lu\t%lu\trs%lu\t0\t%c\t%c\t%c\t%c/%c\tgenomic\tsingle\tunknown\t0\t0\tunknown\texact\t1\t\t1\tSIM,\t"
+			        "2\t%c,%c,\t100.000000,100.000000,\t%f,%f,\n",
+			        chroms[i].name, snp->pos, snp->pos + 1, ++id, neg ? '-' : '+',
+			        snp->ref, snp->ref, a1, a2,
+			        a1, a2, snp->ref_freq, 1 - snp->ref_freq);
+		}
+	}
+}
+
+static void write_snp_locs(const struct sim_chrom *chroms, const unsigned n, const uint64_t total_len, FILE *out)
+{
+	uint8_t *locs = calloc(total_len + 1, 1);
+	assert(locs);
+
+	uint64_t start = 1;  /* positions are 1-based over all contigs */
+	for (unsigned i = 0; i < n; i++) {
+		for (size_t k = 0; k < chroms[i].n_snps; k++) {
+			locs[start + chroms[i].snps[k].pos] = 1;
+		}
+		start += chroms[i].len;
+	}
+
+	serialize_uint64(out, total_len + 1);
+	assert(fwrite(locs, 1, total_len + 1, out) == total_len + 1);
+	free(locs);
+}
+
+static void write_truth(const struct sim_chrom *chroms, const unsigned n, FILE *out)
+{
+	for (unsigned i = 0; i < n; i++) {
+		for (size_t k = 0; k < chroms[i].n_snps; k++) {
+			const struct sim_snp *snp = &chroms[i].snps[k];
+			fprintf(out, "%s %lu %u\n", chroms[i].name, snp->pos + 1, snp->genotype);
+		}
+	}
+}
+
+/* index of the first SNP of `chrom` at or after `pos` */
+static size_t first_snp_at(const struct sim_chrom *chrom, const uint64_t pos)
+{
+	size_t lo = 0;
+	size_t hi = chrom->n_snps;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo)/2;
+		if (chrom->snps[mid].pos < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void write_reads(const struct sim_chrom *chroms, const uint64_t total_len,
+                        const SimOptions *opts, FILE *out, uint64_t *rng)
+{
+	const unsigned len = opts->read_len;
+	const uint64_t n_reads = (uint64_t)(opts->coverage * total_len / len);
+	char *read = malloc(len + 1);
+	char *qual = malloc(len + 1);
+	assert(read && qual);
+	memset(qual, 'I', len);
+	qual[len] = '\0';
+	read[len] = '\0';
+
+	for (uint64_t r = 0; r < n_reads; r++) {
+		/* uniform over the genome, so contigs get reads in proportion to their length */
+		const struct sim_chrom *chrom;
+		uint64_t pos;
+		do {
+			uint64_t g = rng_below(rng, total_len);
+			unsigned i = 0;
+			while (g >= chroms[i].len) {
+				g -= chroms[i].len;
+				++i;
+			}
+			chrom = &chroms[i];
+			pos = g;
+		} while (pos + len > chrom->len);
+
+		memcpy(read, &chrom->seq[pos], len);
+
+		/* the haplotype's alleles */
+		const unsigned hap = rng_below(rng, 2);
+		for (size_t k = first_snp_at(chrom, pos); k < chrom->n_snps && chrom->snps[k].pos < pos + len; k++) {
+			const struct sim_snp *snp = &chrom->snps[k];
+			if (snp->genotype == 2 || (snp->genotype == 1 && hap == 1))
+				read[snp->pos - pos] = snp->alt;
+		}
+
+		for (unsigned j = 0; j < len; j++) {
+			if (rng_uniform(rng) < opts->error_rate)
+				read[j] = other_base(rng, read[j]);
+		}
+
+		const bool rc = rng_below(rng, 2);
+		if (rc) {
+			for (unsigned j = 0; j < len/2; j++) {
+				const char t = read[j];
+				read[j] = complement(read[len - 1 - j]);
+				read[len - 1 - j] = complement(t);
+			}
+			if (len % 2)
+				read[len/2] = complement(read[len/2]);
+		}
+
+		fprintf(out, "@sim%lu %s:%lu:%c\n%s\n+\n%s\n", r + 1, chrom->name, pos + 1, rc ? '-' : '+', read, qual);
+	}
+
+	free(read);
+	free(qual);
+}
+
+void sim_generate(const SimOptions *opts, const char *prefix)
+{
+	assert(opts->n_chroms > 0);
+	uint64_t rng = opts->seed;
+
+	struct sim_chrom *chroms = malloc(opts->n_chroms * sizeof(*chroms));
+	assert(chroms);
+
+	/* contigs shrink geometrically, like real chromosomes do (roughly) */
+	uint64_t total_len = 0;
+	double weight_sum = 0;
+	for (unsigned i = 0; i < opts->n_chroms; i++) {
+		weight_sum += 1.0/(1 + 0.2*i);
+	}
+	for (unsigned i = 0; i < opts->n_chroms; i++) {
+		uint64_t len = (uint64_t)(opts->genome_len * (1.0/(1 + 0.2*i)) / weight_sum);
+		/* the last one takes what truncating the others left, so they add up to `--genome` */
+		if (i == opts->n_chroms - 1)
+			len = (opts->genome_len > total_len) ? opts->genome_len - total_len : 0;
+		if (len < opts->read_len)
+			len = opts->read_len;
+		make_chrom(&chroms[i], i, len, opts, &rng);
+		total_len += len;
+	}
+
+	size_t n_snps = 0;
+	for (unsigned i = 0; i < opts->n_chroms; i++) {
+		n_snps += chroms[i].n_snps;
+	}
+
+	FILE *fa = open_output(prefix, ".fa");
+	write_fasta(chroms, opts->n_chroms, fa);
+	fclose(fa);
+
+	FILE *snps = open_output(prefix, ".snps.txt");
+	write_snps(chroms, opts->n_chroms, snps, &rng);
+	fclose(snps);
+
+	FILE *locs = open_output(prefix, ".snp_locs");
+	write_snp_locs(chroms, opts->n_chroms, total_len, locs);
+	fclose(locs);
+
+	FILE *truth = open_output(prefix, ".truth");
+	write_truth(chroms, opts->n_chroms, truth);
+	fclose(truth);
+
+	FILE *fq = open_output(prefix, ".fq");
+	write_reads(chroms, total_len, opts, fq, &rng);
+	fclose(fq);
+
+	printf("Simulated %lu bases in %u contigs, %lu SNPs and %lu reads of %u bases\n",
+	       total_len, opts->n_chroms, n_snps, (uint64_t)(opts->coverage * total_len / opts->read_len), opts->read_len);
+
+	for (unsigned i = 0; i < opts->n_chroms; i++) {
+		free(chroms[i].seq);
+		free(chroms[i].snps);
+	}
+	free(chroms);
+}
+
+/* === Concordance === */
+
+struct site_gt {
+	uint32_t chrom;  /* index into the calls' contig names */
+	uint64_t pos;
+	uint8_t genotype;
+};
+
+static int site_cmp(const void *p1, const void *p2)
+{
+	const struct site_gt *a = p1;
+	const struct site_gt *b = p2;
+	if (a->chrom != b->chrom)
+		return (a->chrom < b->chrom) ? -1 : 1;
+	return (a->pos < b->pos) ? -1 : (a->pos > b->pos);
+}
+
+static void read_bytes(FILE *in, void *p, const size_t size)
+{
+	if (fread(p, 1, size, in) != size) {
+		fprintf(stderr, "Truncated calls file (was it written with --binary?)\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void sim_concordance(FILE *truth, FILE *calls, FILE *out)
+{
+	uint64_t magic, n_names, n_calls;
+	read_bytes(calls, &magic, sizeof(magic));
+	if (magic != CALLS_MAGIC) {
+		fprintf(stderr, "Not a binary calls file (write it with `lava lava --binary`)\n");
+		exit(EXIT_FAILURE);
+	}
+
+	read_bytes(calls, &n_names, sizeof(n_names));
+	char **names = malloc(n_names * sizeof(*names));
+	assert(names);
+	for (uint64_t i = 0; i < n_names; i++) {
+		uint64_t len;
+		read_bytes(calls, &len, sizeof(len));
+		names[i] = malloc(len + 1);
+		assert(names[i]);
+		read_bytes(calls, names[i], len);
+		names[i][len] = '\0';
+	}
+
+	/* only non-reference calls are written; everything else counts as hom. ref. */
+	read_bytes(calls, &n_calls, sizeof(n_calls));
+	struct site_gt *called = malloc((n_calls + 1) * sizeof(*called));
+	assert(called);
+	for (uint64_t i = 0; i < n_calls; i++) {
+		uint32_t chrom;
+		uint64_t pos;
+		uint8_t gtype;
+		double confidence;
+		read_bytes(calls, &chrom, sizeof(chrom));
+		read_bytes(calls, &pos, sizeof(pos));
+		read_bytes(calls, &gtype, sizeof(gtype));
+		read_bytes(calls, &confidence, sizeof(confidence));
+		called[i] = (struct site_gt){.chrom = chrom, .pos = pos, .genotype = (gtype == GTYPE_HET) ? 1 : 2};
+	}
+	qsort(called, n_calls, sizeof(*called), site_cmp);
+
+	struct site_gt *sites = NULL;
+	size_t n_sites = 0;
+	size_t cap = 0;
+	char line[1024];
+	char name[512];
+
+	while (fgets(line, sizeof(line), truth)) {
+		uint64_t pos;
+		unsigned genotype;
+		if (sscanf(line, "%511s %lu %u", name, &pos, &genotype) != 3 || genotype > 2)
+			continue;
+
+		uint32_t chrom = 0;
+		while (chrom < n_names && !STREQ(names[chrom], name))
+			++chrom;
+		if (chrom == n_names)
+			continue;  /* no calls could have been made there */
+
+		if (n_sites == cap) {
+			cap = cap ? 2*cap : 1024;
+			sites = realloc(sites, cap * sizeof(*sites));
+			assert(sites);
+		}
+		sites[n_sites++] = (struct site_gt){.chrom = chrom, .pos = pos, .genotype = genotype};
+	}
+	qsort(sites, n_sites, sizeof(*sites), site_cmp);
+
+	/* matrix[truth][call] */
+	uint64_t matrix[3][3] = {{0}};
+	size_t c = 0;
+	uint64_t off_truth = 0;  /* calls at positions that aren't SNPs */
+
+	for (size_t i = 0; i < n_sites; i++) {
+		while (c < n_calls && site_cmp(&called[c], &sites[i]) < 0) {
+			++off_truth;
+			++c;
+		}
+
+		unsigned call = 0;
+		if (c < n_calls && site_cmp(&called[c], &sites[i]) == 0)
+			call = called[c++].genotype;
+
+		++matrix[sites[i].genotype][call];
+	}
+	off_truth += n_calls - c;
+
+	const uint64_t agree = matrix[0][0] + matrix[1][1] + matrix[2][2];
+	const uint64_t truth_nonref = matrix[1][0] + matrix[1][1] + matrix[1][2] + matrix[2][0] + matrix[2][1] + matrix[2][2];
+	const uint64_t found_nonref = matrix[1][1] + matrix[1][2] + matrix[2][1] + matrix[2][2];
+	const uint64_t called_nonref = found_nonref + matrix[0][1] + matrix[0][2] + off_truth;
+
+	fprintf(out, "sites %lu\n", n_sites);
+	fprintf(out, "calls %lu\n", n_calls);
+	fprintf(out, "concordance %f\n", n_sites ? agree/(double)n_sites : 0.0);
+	fprintf(out, "nonref_sensitivity %f\n", truth_nonref ? found_nonref/(double)truth_nonref : 0.0);
+	fprintf(out, "nonref_precision %f\n", called_nonref ? found_nonref/(double)called_nonref : 0.0);
+	fprintf(out, "# truth\\call  ref   het   alt\n");
+	static const char *gt_names[] = {"ref", "het", "alt"};
+	for (unsigned t = 0; t < 3; t++) {
+		fprintf(out, "# %-10s %5lu %5lu %5lu\n", gt_names[t], matrix[t][0], matrix[t][1], matrix[t][2]);
+	}
+
+	for (uint64_t i = 0; i < n_names; i++) {
+		free(names[i]);
+	}
+	free(names);
+	free(called);
+	free(sites);
+}
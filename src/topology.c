@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <assert.h>
+#include "topology.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+
+/* node numbers must fit in the masks we pass to `mbind` */
+#define MAX_NODE_ID (TOPO_MAX_NODES*8)
+#define MASK_WORDS  (MAX_NODE_ID/64)
+
+/* from <linux/mempolicy.h> */
+#define MPOL_BIND       2
+#define MPOL_INTERLEAVE 3
+
+/*
+ * Parses a sysfs CPU list such as "0-3,8,10-11", adding each CPU in
+ * `allowed` to `t` as belonging to `node`, and clearing `t->bind` if any
+ * isn't. Returns false if the list is malformed.
+ */
+static bool parse_cpulist(const char *s, Topology *t, const unsigned node, const cpu_set_t *allowed)
+{
+	while (*s && *s != '\n') {
+		char *end;
+		const long first = strtol(s, &end, 10);
+		long last = first;
+
+		if (end == s)
+			return false;
+		s = end;
+
+		if (*s == '-') {
+			last = strtol(s + 1, &end, 10);
+			if (end == s + 1)
+				return false;
+			s = end;
+		}
+
+		for (long cpu = first; cpu <= last; cpu++) {
+			if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, allowed)) {
+				t->bind = false;
+				continue;
+			}
+
+			t->cpus = realloc(t->cpus, (t->n_cpus + 1) * sizeof(*t->cpus));
+			assert(t->cpus);
+			t->cpu_node = realloc(t->cpu_node, (t->n_cpus + 1) * sizeof(*t->cpu_node));
+			assert(t->cpu_node);
+			t->cpus[t->n_cpus] = cpu;
+			t->cpu_node[t->n_cpus] = node;
+			++t->n_cpus;
+		}
+
+		if (*s == ',')
+			++s;
+	}
+
+	return true;
+}
+
+static void single_node(Topology *t)
+{
+	free(t->cpus);
+	free(t->cpu_node);
+	t->cpus = NULL;
+	t->cpu_node = NULL;
+	t->n_cpus = 0;
+	t->n_nodes = 1;
+	t->node_ids[0] = 0;
+	t->bind = false;
+}
+
+void topology_init(Topology *t)
+{
+	t->n_nodes = 0;
+	t->n_cpus = 0;
+	t->cpus = NULL;
+	t->cpu_node = NULL;
+	t->bind = true;
+
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		single_node(t);
+		return;
+	}
+
+	char path[256];
+	char line[4096];
+
+	for (int id = 0; id < MAX_NODE_ID && t->n_nodes < TOPO_MAX_NODES; id++) {
+		snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", id);
+		FILE *f = fopen(path, "r");
+		if (f == NULL)
+			continue;
+
+		const bool ok = (fgets(line, sizeof(line), f) != NULL);
+		fclose(f);
+
+		/* memory-only nodes have an empty list */
+		if (!ok || line[0] == '\n')
+			continue;
+
+		const unsigned n_cpus = t->n_cpus;
+		if (!parse_cpulist(line, t, t->n_nodes, &allowed)) {
+			single_node(t);
+			return;
+		}
+
+		/* as for memory-only nodes, we have no use for a node we can't run on */
+		if (t->n_cpus > n_cpus)
+			t->node_ids[t->n_nodes++] = id;
+	}
+
+	if (t->n_nodes <= 1)
+		single_node(t);
+}
+
+void topology_dealloc(Topology *t)
+{
+	free(t->cpus);
+	free(t->cpu_node);
+	t->cpus = NULL;
+	t->cpu_node = NULL;
+	t->n_cpus = 0;
+	t->n_nodes = 0;
+}
+
+uint64_t topology_node_free(const Topology *t, const unsigned node)
+{
+	char path[256];
+	char line[256];
+	uint64_t kb = 0;
+
+	snprintf(path, sizeof(path), NODE_DIR "/node%d/meminfo", t->node_ids[node]);
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		/* "Node <n> MemFree:   <kb> kB" */
+		const char *p = strstr(line, "MemFree:");
+		if (p != NULL) {
+			kb = strtoull(p + strlen("MemFree:"), NULL, 10);
+			break;
+		}
+	}
+
+	fclose(f);
+	return kb * 1024;
+}
+
+static bool mbind_nodes(void *p, const size_t len, const int mode, const unsigned long *mask)
+{
+	/* `mbind` wants a page-aligned start */
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t start = (uintptr_t)p & ~(page - 1);
+	const size_t span = len + ((uintptr_t)p - start);
+
+	return syscall(SYS_mbind, start, span, mode, mask, (unsigned long)MAX_NODE_ID + 1, 0) == 0;
+}
+
+bool numa_interleave(const Topology *t, void *p, const size_t len)
+{
+	if (t->n_nodes <= 1)
+		return true;
+
+	unsigned long mask[MASK_WORDS] = {0};
+	for (unsigned i = 0; i < t->n_nodes; i++) {
+		const int id = t->node_ids[i];
+		mask[id/64] |= 1UL << (id % 64);
+	}
+
+	return mbind_nodes(p, len, MPOL_INTERLEAVE, mask);
+}
+
+bool numa_bind(const Topology *t, void *p, const size_t len, const unsigned node)
+{
+	if (t->n_nodes <= 1)
+		return true;
+
+	unsigned long mask[MASK_WORDS] = {0};
+	const int id = t->node_ids[node];
+	mask[id/64] |= 1UL << (id % 64);
+
+	return mbind_nodes(p, len, MPOL_BIND, mask);
+}
+
+int topology_worker_cpu(const Topology *t, const unsigned i, unsigned *node)
+{
+	*node = 0;
+	if (t->n_cpus == 0)
+		return -1;
+
+	const unsigned n = i % t->n_nodes;
+	unsigned node_cpus = 0;
+	for (unsigned c = 0; c < t->n_cpus; c++) {
+		if (t->cpu_node[c] == n)
+			++node_cpus;
+	}
+
+	unsigned k = (i / t->n_nodes) % node_cpus;
+	for (unsigned c = 0; c < t->n_cpus; c++) {
+		if (t->cpu_node[c] == n && k-- == 0) {
+			*node = n;
+			return t->cpus[c];
+		}
+	}
+
+	assert(0);
+	return -1;
+}
+
+bool pin_thread(const int cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+bool topology_bind_node(const Topology *t, const unsigned node)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (unsigned c = 0; c < t->n_cpus; c++) {
+		if (t->cpu_node[c] == node)
+			CPU_SET(t->cpus[c], &set);
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <assert.h>
+#include "unixsock.h"
+
+static void unix_addr(const char *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Socket path is too long (limit: %lu characters): %s\n", sizeof(addr->sun_path) - 1, path);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(addr->sun_path, path);
+}
+
+int unixsock_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	unix_addr(path, &addr);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	assert(fd >= 0);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		if (errno != EADDRINUSE) {
+			fprintf(stderr, "Could not bind socket %s: %s\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		/* only take the path over if nobody is listening on it */
+		const int probe = unixsock_connect(path);
+		if (probe >= 0 || errno != ECONNREFUSED) {
+			fprintf(stderr, "Socket %s is in use\n", path);
+			exit(EXIT_FAILURE);
+		}
+
+		unlink(path);
+		if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			fprintf(stderr, "Could not bind socket %s: %s\n", path, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	assert(listen(fd, 64) == 0);
+	return fd;
+}
+
+int unixsock_accept(const int listener)
+{
+	return accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+}
+
+int unixsock_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	unix_addr(path, &addr);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	assert(fd >= 0);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		const int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	return fd;
+}
+
+static long elapsed_ms(const struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec)*1000 + (now.tv_nsec - since->tv_nsec)/1000000;
+}
+
+bool unixsock_read_line(const int fd, char *buf, const size_t len, const int timeout_ms)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	size_t n = 0;
+
+	/* byte by byte, so that nothing after the line is consumed */
+	while (n + 1 < len) {
+		const long left = timeout_ms - elapsed_ms(&start);
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+		if (left <= 0 || poll(&pfd, 1, left) <= 0)
+			return false;
+
+		char c;
+		const ssize_t got = recv(fd, &c, 1, 0);
+		if (got <= 0)
+			return false;
+
+		if (c == '\n') {
+			if (n > 0 && buf[n - 1] == '\r')
+				--n;
+			buf[n] = '\0';
+			return true;
+		}
+
+		buf[n++] = c;
+	}
+
+	return false;  /* too long */
+}
+
+bool unixsock_printf(const int fd, const char *fmt, ...)
+{
+	char line[UNIXSOCK_LINE_MAX];
+	va_list args;
+
+	va_start(args, fmt);
+	const int len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+	va_end(args);
+
+	if (len < 0 || (size_t)len >= sizeof(line) - 1)
+		return false;
+
+	line[len] = '\n';
+	return send(fd, line, len + 1, MSG_NOSIGNAL | MSG_DONTWAIT) == len + 1;
+}
@@ -49,6 +49,242 @@ uint8_t read_uint8(FILE *in)
 	return x;
 }
 
+/*
+ * Reads the header of the next optional dictionary section into `tag` and
+ * `len`, returning false if there are no more sections.
+ */
+bool read_section_header(FILE *in, uint64_t *tag, uint64_t *len)
+{
+	if (fread(tag, sizeof(uint64_t), 1, in) != 1)
+		return false;
+
+	*len = read_uint64(in);
+	return true;
+}
+
+void skip_bytes(FILE *in, uint64_t len)
+{
+	char buf[4096];
+	while (len > 0) {
+		const size_t n = MIN(len, sizeof(buf));
+		assert(fread(buf, 1, n, in) == n);
+		len -= n;
+	}
+}
+
+void serialize_section_header(FILE *out, const uint64_t tag, const uint64_t len)
+{
+	serialize_uint64(out, tag);
+	serialize_uint64(out, len);
+}
+
+void serialize_dict_header(FILE *out, const struct dict_header *h)
+{
+	serialize_uint64(out, DICT_MAGIC);
+	serialize_uint64(out, DICT_VERSION);
+	serialize_uint64(out, h->flags);
+	serialize_uint64(out, h->size);
+	serialize_uint64(out, h->aux_size);
+	serialize_uint64(out, h->jumpgate_bits);
+	serialize_uint64(out, h->aux_positions);
+	serialize_uint64(out, h->max_positions);
+	serialize_uint64(out, h->max_pos);
+}
+
+void read_dict_header(FILE *in, struct dict_header *h)
+{
+	const uint64_t first = read_uint64(in);
+
+	if (first != DICT_MAGIC) {
+		/* no header: `first` is the entry count */
+		h->version = 0;
+		h->flags = 0;
+		h->size = first;
+		h->aux_size = read_uint64(in);
+		h->jumpgate_bits = 0;
+		h->aux_positions = 0;
+		h->max_positions = AUX_TABLE_COLS;
+		h->max_pos = 0;
+		return;
+	}
+
+	h->version = read_uint64(in);
+
+	if (h->version > DICT_VERSION) {
+		fprintf(stderr, "Dictionary format version %lu is not supported (latest: %d)\n", h->version, DICT_VERSION);
+		exit(EXIT_FAILURE);
+	}
+
+	h->flags = read_uint64(in);
+	h->size = read_uint64(in);
+	h->aux_size = read_uint64(in);
+	h->jumpgate_bits = (h->version >= 2) ? read_uint64(in) : 0;
+	h->aux_positions = (h->version >= 3) ? read_uint64(in) : 0;
+	h->max_positions = (h->version >= 3) ? read_uint64(in) : AUX_TABLE_COLS;
+	h->max_pos = (h->version >= 4) ? read_uint64(in) : 0;
+
+	if (h->jumpgate_bits != 0 &&
+	    (h->jumpgate_bits < JUMPGATE_MIN_BITS || h->jumpgate_bits > JUMPGATE_MAX_BITS)) {
+		fprintf(stderr, "Dictionary has an invalid jumpgate width: %lu bits\n", h->jumpgate_bits);
+		exit(EXIT_FAILURE);
+	}
+
+	if (h->max_positions == 0 || h->max_positions > UINT32_MAX) {
+		fprintf(stderr, "Dictionary has an invalid cap on positions per k-mer: %lu\n", h->max_positions);
+		exit(EXIT_FAILURE);
+	}
+
+	if (h->flags & ~(uint64_t)(DICT_FLAG_WIDE_POS | DICT_FLAG_SNP)) {
+		fprintf(stderr, "Dictionary has unknown flags: 0x%lx\n", h->flags);
+		exit(EXIT_FAILURE);
+	}
+}
+
+void dict_check_kind(const struct dict_header *h, const bool snp)
+{
+	if (h->version >= 6 && !(h->flags & DICT_FLAG_SNP) == snp) {
+		fprintf(stderr, "Expected a %s dictionary, got a %s dictionary\n",
+		        snp ? "SNP" : "reference", snp ? "reference" : "SNP");
+		exit(EXIT_FAILURE);
+	}
+}
+
+unsigned jumpgate_bits_for(const uint64_t size)
+{
+	unsigned bits = JUMPGATE_MIN_BITS;
+	while (bits < JUMPGATE_MAX_BITS && ((uint64_t)JUMPGATE_BUCKET_TARGET << bits) < size)
+		++bits;
+	return bits;
+}
+
+unsigned half_jumpgate_bits_for(const uint64_t size)
+{
+	return MIN(jumpgate_bits_for(size), HALF_JUMPGATE_MAX_BITS);
+}
+
+/*
+ * Reads the size and jumpgate width at the start of a `SECTION_HALF_INDEX`
+ * of `len` bytes, and returns how many bytes that took. Sections written
+ * before version 5 have no width, and get the one we would give them.
+ */
+uint64_t read_half_index_header(FILE *in, const uint64_t len, uint64_t *size, unsigned *jumpgate_bits)
+{
+	*size = read_uint64(in);
+
+	if (len == sizeof(uint64_t) + *size*3*sizeof(uint32_t)) {
+		*jumpgate_bits = half_jumpgate_bits_for(*size);
+		return sizeof(uint64_t);
+	}
+
+	const uint64_t bits = read_uint64(in);
+	if (len != 2*sizeof(uint64_t) + *size*3*sizeof(uint32_t) || bits == 0 || bits > HALF_JUMPGATE_MAX_BITS) {
+		fprintf(stderr, "Dictionary has an invalid half index\n");
+		exit(EXIT_FAILURE);
+	}
+	*jumpgate_bits = bits;
+	return 2*sizeof(uint64_t);
+}
+
+/*
+ * Positions take 4 bytes in narrow dictionaries and 5 (low 32 bits, then
+ * the upper 8) in wide ones. `read_pos` maps the narrow form of
+ * `POS_AMBIGUOUS` back to the full value.
+ */
+void serialize_pos(FILE *out, const pos_t pos, const bool wide)
+{
+	serialize_uint32(out, (uint32_t)pos);
+	if (wide)
+		serialize_uint8(out, (uint8_t)(pos >> 32));
+}
+
+pos_t read_pos(FILE *in, const bool wide)
+{
+	const uint32_t lo = read_uint32(in);
+
+	if (wide)
+		return ((pos_t)read_uint8(in) << 32) | lo;
+
+	return (lo == (uint32_t)POS_AMBIGUOUS) ? POS_AMBIGUOUS : lo;
+}
+
+static uint64_t pos_bytes(const struct dict_header *h)
+{
+	return (h->flags & DICT_FLAG_WIDE_POS) ? 5 : 4;
+}
+
+uint64_t dict_entry_bytes(const struct dict_header *h, const bool snp)
+{
+	return sizeof(kmer_t) + pos_bytes(h) + (snp ? 4 : 1);
+}
+
+uint64_t dict_aux_bytes(const struct dict_header *h, const bool snp)
+{
+	if (h->version < 3)
+		return h->aux_size * (snp ? sizeof(kmer_t) + AUX_TABLE_COLS*(pos_bytes(h) + 3) : AUX_TABLE_COLS*pos_bytes(h));
+
+	return h->aux_size * sizeof(uint32_t) + h->aux_positions * (pos_bytes(h) + (snp ? sizeof(snp_info) : 0));
+}
+
+void aux_reader_init(AuxReader *r, FILE *in, const struct dict_header *h, const bool snp)
+{
+	r->in = in;
+	r->snp = snp;
+	r->wide = h->flags & DICT_FLAG_WIDE_POS;
+	r->fixed = (h->version < 3);
+	r->max_positions = h->max_positions;
+}
+
+size_t aux_read_row(AuxReader *r, pos_t *pos, snp_info *snps)
+{
+	if (r->fixed) {
+		if (r->snp)
+			read_uint64(r->in);  /* k-mer */
+
+		size_t n = 0;
+		bool ended = false;
+		for (size_t j = 0; j < AUX_TABLE_COLS; j++) {
+			const pos_t p = read_pos(r->in, r->wide);
+			const snp_info snp = r->snp ? read_uint8(r->in) : 0;
+			if (r->snp) {
+				read_uint8(r->in);  /* frequencies */
+				read_uint8(r->in);
+			}
+
+			ended = ended || (p == 0);
+			if (!ended) {
+				pos[n] = p;
+				if (r->snp)
+					snps[n] = snp;
+				++n;
+			}
+		}
+		return n;
+	}
+
+	const size_t n = read_uint32(r->in);
+	if (n > r->max_positions) {
+		fprintf(stderr, "Dictionary has an aux table row of %lu positions (limit: %lu)\n", n, r->max_positions);
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t j = 0; j < n; j++) {
+		pos[j] = read_pos(r->in, r->wide);
+		if (r->snp)
+			snps[j] = read_uint8(r->in);
+	}
+	return n;
+}
+
+void serialize_aux_row(FILE *out, const pos_t *pos, const snp_info *snps, const size_t n, const bool wide)
+{
+	serialize_uint32(out, (uint32_t)n);
+	for (size_t j = 0; j < n; j++) {
+		serialize_pos(out, pos[j], wide);
+		if (snps != NULL)
+			serialize_uint8(out, snps[j]);
+	}
+}
+
 int kmer_cmp(const void *p1, const void *p2)
 {
 	const kmer_t kmer1 = ((struct kmer_info *)p1)->kmer;
@@ -133,50 +369,17 @@ unsigned kmer_get_base(const kmer_t kmer, unsigned base)
 }
 
 /*
- * Adapted from:
- * https://github.com/yunwilliamyu/quartz/blob/master/misra_gries_dict.cpp#L106
+ * Bases are encoded so that a base's complement is its bitwise complement,
+ * so we complement the whole k-mer and then reverse the order of its 2-bit
+ * bases. There is no lookup table to set up, so this is safe to call from
+ * any thread.
  */
 kmer_t rev_compl(const kmer_t orig)
 {
-	static uint16_t table[0x10000] = {};
-	static bool init = false;
-	if (!init) {
-		uint16_t x;
-		uint16_t y;
-		for (unsigned i = 0; i < 0x10000; i++) {
-			x = 0;
-			y = i;
-			for (unsigned int j = 0; j < 8; j++) {
-				x <<= 2;
-				switch (y & 3) {
-					case 0:
-						x+=3;
-						break;
-					case 1:
-						x+=2;
-						break;
-					case 2:
-						x+=1;
-						break;
-					case 3:
-						break;
-				}
-				y >>= 2;
-			}
-			table[i] = x;
-		}
-		init = true;
-	}
-
-	kmer_t ans;
-	uint16_t *c_orig = (uint16_t*)(&orig);
-	uint16_t *c_ans = (uint16_t*)(&ans);
-
-	for (unsigned i = 0; i < 4; i++) {
-		c_ans[i] = table[c_orig[3-i]];
-	}
-
-	return ans;
+	kmer_t x = ~orig;
+	x = ((x >> 2) & 0x3333333333333333UL) | ((x & 0x3333333333333333UL) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FUL) | ((x & 0x0F0F0F0F0F0F0F0FUL) << 4);
+	return __builtin_bswap64(x);
 }
 
 void decode_kmer(const kmer_t kmer, char *buf)
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "writer.h"
+
+#define G_DIGITS 15  /* significant digits, as in "%.15g" */
+
+void writer_init(Writer *w, FILE *out)
+{
+	w->out = out;
+	w->len = 0;
+}
+
+void writer_flush(Writer *w)
+{
+	if (w->len > 0) {
+		assert(fwrite(w->buf, 1, w->len, w->out) == w->len);
+		w->len = 0;
+	}
+}
+
+/*
+ * Computes the `G_DIGITS` significant digits of `x` > 0 and its decimal
+ * exponent. Returns false if the result might not be correctly rounded,
+ * in which case the caller should fall back to `snprintf`.
+ *
+ * We scale by an exact power of 10 in extended precision, which leaves
+ * an error well below 10^-3 units in the last digit, so the only hard
+ * cases are those within that distance of a rounding tie.
+ */
+static bool g_digits(const double x, uint64_t *digits, int *exp10)
+{
+	/* powers of 10 are exact in a 64-bit mantissa up to 10^27 */
+	static const long double pow10[] = {
+		1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,  1e8L,  1e9L,
+		1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+		1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+	};
+
+	if (sizeof(long double) <= sizeof(double))
+		return false;
+
+	int e = (int)floor(log10(x));
+	long double m = 0.0L;
+	int attempt;
+
+	for (attempt = 0; attempt < 2; attempt++) {
+		const int k = (G_DIGITS - 1) - e;
+		if (k < 0 || k >= (int)(sizeof(pow10)/sizeof(pow10[0])))
+			return false;
+
+		m = (long double)x * pow10[k];
+
+		if (m >= pow10[G_DIGITS])
+			++e;
+		else if (m < pow10[G_DIGITS - 1])
+			--e;
+		else
+			break;
+	}
+
+	if (attempt == 2)
+		return false;
+
+	const long double frac = m - floorl(m);
+	if (fabsl(frac - 0.5L) < 1e-3L)
+		return false;
+
+	uint64_t r = (uint64_t)(m + 0.5L);
+	if (r == (uint64_t)pow10[G_DIGITS]) {
+		r /= 10;
+		++e;
+	}
+
+	*digits = r;
+	*exp10 = e;
+	return true;
+}
+
+void writer_put_double(Writer *w, double x)
+{
+	uint64_t digits;
+	int e;
+
+	if (!isfinite(x) || x == 0.0 || !g_digits(fabs(x), &digits, &e)) {
+		char *p = writer_reserve(w, 32);
+		w->len += snprintf(p, 32, "%.15g", x);
+		return;
+	}
+
+	char s[G_DIGITS];
+	for (int i = G_DIGITS - 1; i >= 0; i--) {
+		s[i] = '0' + (digits % 10);
+		digits /= 10;
+	}
+
+	/* significant digits that remain once trailing zeros are dropped */
+	int n = G_DIGITS;
+	while (n > 1 && s[n - 1] == '0')
+		--n;
+
+	char *p = writer_reserve(w, 32);
+	char *q = p;
+
+	if (x < 0.0)
+		*q++ = '-';
+
+	if (e < -4 || e >= G_DIGITS) {
+		*q++ = s[0];
+		if (n > 1) {
+			*q++ = '.';
+			memcpy(q, &s[1], n - 1);
+			q += n - 1;
+		}
+
+		*q++ = 'e';
+		*q++ = (e < 0) ? '-' : '+';
+		int a = (e < 0) ? -e : e;
+		if (a >= 100) {
+			*q++ = '0' + a/100;
+			a %= 100;
+		}
+		*q++ = '0' + a/10;
+		*q++ = '0' + a%10;
+	} else if (e >= 0) {
+		memcpy(q, s, e + 1);
+		q += e + 1;
+		if (n > e + 1) {
+			*q++ = '.';
+			memcpy(q, &s[e + 1], n - (e + 1));
+			q += n - (e + 1);
+		}
+	} else {
+		*q++ = '0';
+		*q++ = '.';
+		for (int i = 0; i < -e - 1; i++) {
+			*q++ = '0';
+		}
+		memcpy(q, s, n);
+		q += n;
+	}
+
+	w->len += q - p;
+}